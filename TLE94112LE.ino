@@ -13,25 +13,50 @@
 #include <Streaming.h>
 #include "commands.h"
 #include "motorcontrol.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "sequence.h"
+#include "speedcontrol.h"
+#include "timedmove.h"
+#include "controltick.h"
+#include "idle.h"
+#include "dither.h"
+#include "waveform.h"
+#include "soak.h"
 
 //! Motor control class instance
 MotorControl motor;
-
-//! Status LED
-#define LEDPIN 12
-//! Analog duty cycle input pin
-#define ANALOG_DCPIN A0
+//! Binary telemetry class instance
+Telemetry telemetry;
+//! Motion sequence interpreter instance
+MotionSequence sequence;
+//! Closed loop speed control instance
+SpeedControl speed;
+//! Timed moves instance
+TimedMove timedMove;
+//! Low power idle instance
+IdleGovernor idleGovernor;
+//! Duty cycle dithering instance
+DutyDither dither;
+//! Waveform generator instance
+WaveGenerator waveform;
+//! Soak test instance
+SoakTest soak;
 
 //! Max analog reading range with a 50K potentiometer
 #define MAX_ANALOG_RANGE 1024
 //! Min analog reading range with a 50K potentiometer
 #define MIN_ANALOG_RANGE 0
+//! Time (ms) between two readings of the analog duty cycle
+#define ANALOG_SAMPLE_TIME 150
+//! Time (ms) the error star is shown on the LCD
+#define ERROR_SHOW_TIME 100
 
 //! If defined every command is echoed on the serial terminal
 #define _SERIAL_ECHO
 
 //! LCD library initialisation
-ShiftLCD lcd(2, 3, 4);
+ShiftLCD lcd(LCD_DATA_PIN, LCD_CLOCK_PIN, LCD_LATCH_PIN);
 
 //! Duty cycle value read from the analog in
 uint8_t inputAnalogDC;
@@ -41,8 +66,30 @@ uint8_t lastAnalogDC;
 boolean isRunning;
 //! Running animation frame number
 int runningFrame;
-//! Running frames
-String runningFrames[] = { RUNNING1, RUNNING2, RUNNING3, RUNNING4 };
+//! Time (ms) when the last running animation frame has been shown
+unsigned long runningTime;
+//! Time (ms) of the last analog duty cycle reading
+unsigned long analogTime;
+//! Time (ms) when the error star has been shown, 0 if not shown
+unsigned long errorTime;
+//! Running frames, one character every frame
+const char runningFrames[] = RUNNING1 RUNNING2 RUNNING3 RUNNING4;
+
+//! Max length of a serial command line, including the string terminator.
+//! A line can contain a batch of commands
+#define CMD_BUFFER_SIZE 64
+//! Serial command line being received
+char commandBuffer[CMD_BUFFER_SIZE];
+//! Number of characters currently stored in the command buffer
+uint8_t commandLength;
+//! Time (us) when the last command line has been received
+unsigned long commandTime;
+//! A batch of commands is being executed, the messages are not sent
+boolean batchMode;
+//! The last command has been refused
+boolean commandFailed;
+//! The motor settings should be shown at the end of the batch
+boolean lcdPending;
 
 //! Duty cycle analog read should be ignore (bypass the analog reading)
 #define ANALOG_DCNONE 0
@@ -56,6 +103,42 @@ String runningFrames[] = { RUNNING1, RUNNING2, RUNNING3, RUNNING4 };
 //! Duty cycle analog value currently used during readings
 int analogDutyCycle;
 
+//! Fault stops already shown on the display
+unsigned int lastFaultStops;
+//! Fault restarts already shown on the display
+unsigned int lastFaultRetries;
+
+//! Fault classes names used by the fault reaction commands
+const char faultNameSPI[] PROGMEM = FAULT_NAME_SPI;
+const char faultNameLoad[] PROGMEM = FAULT_NAME_LOAD;
+const char faultNameUV[] PROGMEM = FAULT_NAME_UV;
+const char faultNameOV[] PROGMEM = FAULT_NAME_OV;
+const char faultNamePOR[] PROGMEM = FAULT_NAME_POR;
+const char faultNameTSD[] PROGMEM = FAULT_NAME_TSD;
+const char faultNameTW[] PROGMEM = FAULT_NAME_TW;
+const char* const faultNames[FAULT_CLASSES] PROGMEM = {
+  faultNameSPI, faultNameLoad, faultNameUV, faultNameOV, 
+  faultNamePOR, faultNameTSD, faultNameTW };
+
+//! Waveform shapes names, starting from WAVE_NONE that can't be set
+const char waveNameNone[] PROGMEM = "";
+const char waveNameSine[] PROGMEM = WAVE_NAME_SINE;
+const char waveNameTriangle[] PROGMEM = WAVE_NAME_TRIANGLE;
+const char waveNameSquare[] PROGMEM = WAVE_NAME_SQUARE;
+const char* const waveNames[WAVE_SHAPES] PROGMEM = {
+  waveNameNone, waveNameSine, waveNameTriangle, waveNameSquare };
+
+//! Fault reactions names used by the fault reaction commands
+const char faultActionIgnore[] PROGMEM = FAULT_ACTION_IGNORE;
+const char faultActionLog[] PROGMEM = FAULT_ACTION_LOG;
+const char faultActionDerate[] PROGMEM = FAULT_ACTION_DERATE;
+const char faultActionStop[] PROGMEM = FAULT_ACTION_STOP;
+const char faultActionStopAll[] PROGMEM = FAULT_ACTION_STOPALL;
+const char faultActionRetry[] PROGMEM = FAULT_ACTION_RETRY;
+const char* const faultActions[FAULT_ACTIONS] PROGMEM = {
+  faultActionIgnore, faultActionLog, faultActionDerate, 
+  faultActionStop, faultActionStopAll, faultActionRetry };
+
 // ==============================================
 // Initialisation
 // ==============================================
@@ -65,27 +148,57 @@ void setup() {
   // try with a lower communication speed
   Serial.begin(38400);
 
+  // Record the settings since the initialisation
+  trace.begin();
+
+  // initialize the motor class restoring the saved configuration,
+  // then start immediately if the configuration requires it
+  // The ramps are timed by the control tick
+  controlTick.begin();
+  motor.begin();  
+  if(motor.autoStart)
+    motor.startMotors();
+  lastFaultStops = motor.faultStopCount;
+  lastFaultRetries = motor.faultRetryCount;
+  telemetry.begin();
+  sequence.begin();
+  speed.begin();
+  timedMove.begin();
+  dither.begin();
+  waveform.begin();
+  soak.begin();
+  idleGovernor.begin();
+
   analogDutyCycle = ANALOG_DCNONE;
   pinMode(LEDPIN, OUTPUT);   // LED reading signal
   pinMode(ANALOG_DCPIN, INPUT);\
   analogReference(INTERNAL);
   inputAnalogDC = lastAnalogDC = readAnalogDutyCycle();
-  isRunning = false;
+  isRunning = motor.motorsRunning();
   runningFrame = 0;
+  runningTime = analogTime = millis();
+  errorTime = 0;
+  commandLength = 0;
 
   flashLED();
 
   // Print the initialisation message
-  Serial.println(APP_TITLE);
-
-  // initialize the motor class
-  motor.begin();  
+  Serial.println(F(APP_TITLE));
+  if(motor.configLoaded)
+    Serial << F(CMD_CONFIG_LOADED) << endl;
 
   // initialize the LCD
   lcd.begin(16, 2);
   lcd.setCursor(0,0);
 
-  lcdIntroMessage();
+  // Don't wait for the intro message while the motors are running
+  if(isRunning) {
+    lcdShowRunning();
+    if(motor.hasManualDC)
+      analogDutyCycle = ANALOG_DCMAN;
+  }
+  else
+    lcdIntroMessage();
 }
 
 // ==============================================
@@ -97,9 +210,6 @@ void setup() {
  * The scale reading is done at a specific frequence and is interrupt-driven
  */
 void loop() {
-  int j;
-  boolean isRunStatus;
-
   if(isRunning)
     lcdRunningAnim();
 
@@ -110,36 +220,106 @@ void loop() {
   // Note: It is possible to isolate the error status, if any,
   // for any motor. Here we make a simplification and check over
   // the motor without filtering
-  isRunStatus = false;
-  for(j = 0; j < MAX_MOTORS; j++) {
-    if(motor.internalStatus[j].isRunning) {
-      isRunStatus = true;
-      j = MAX_MOTORS; // Force exit from loop
-    } // check for running motors
-  } // motors loop
-  // If at least one motor is running check for diagnostic
-  if(isRunStatus) {
+  if(motor.motorsRunning()) {
+    // The fault reaction is applied by the check, the notification
+    // follows
     if(motor.tleCheckDiagnostic()) {
       //! Show the error star
       lcdShowError();
       motor.tleDiagnostic();
-      lcdClearError();
+    }
+  }
+  // The error star is cleared without waiting
+  if( (errorTime != 0) && ((millis() - errorTime) >= ERROR_SHOW_TIME) )
+    lcdClearError();
+  // Restart the motors stopped by a fault with retry reaction
+  motor.faultService();
+  // Release the brake when the brake time is expired
+  motor.brakeService();
+  // Keep the power demand of the running motors within the budget
+  motor.powerService();
+  // Align the display if a fault reaction has stopped or restarted the motors
+  if(lastFaultStops != motor.faultStopCount) {
+    lastFaultStops = motor.faultStopCount;
+    if(isRunning && !motor.motorsRunning()) {
+      lcdShowHalted();
+      isRunning = false;
+      analogDutyCycle = ANALOG_DCNONE;
+    }
+  }
+  if(lastFaultRetries != motor.faultRetryCount) {
+    lastFaultRetries = motor.faultRetryCount;
+    if(!isRunning && motor.motorsRunning()) {
+      lcdShowRunning();
+      isRunning = true;
     }
   }
   
+  // The sequence, the timed move, the soak test, the dithering and the
+  // waveforms are updated once every control tick
+  if(controlTick.due()) {
+    // Align the display when the sequence starts or stops the motors
+    if(sequence.update(motor)) {
+      if(motor.motorsRunning()) {
+        lcdShowRunning();
+        isRunning = true;
+        if(motor.hasManualDC)
+          analogDutyCycle = ANALOG_DCMAN;
+      }
+      else {
+        lcdShowHalted();
+        isRunning = false;
+        analogDutyCycle = ANALOG_DCNONE;
+      }
+    }
+
+    // The motors are stopped at the end of the timed move
+    if(timedMove.update(motor)) {
+      lcdShowHalted();
+      isRunning = false;
+      analogDutyCycle = ANALOG_DCNONE;
+    }
+
+    // Align the display when the soak test starts or stops the motors
+    if(soak.update(motor)) {
+      if(motor.motorsRunning()) {
+        lcdShowRunning();
+        isRunning = true;
+      }
+      else {
+        lcdShowHalted();
+        isRunning = false;
+      }
+    }
+    if(soak.reportDue())
+      showSoakSummary();
+
+    dither.update(motor);
+    waveform.update(motor);
+  }
+
+  // Speed control tick
+  speed.update(motor);
+
+  // Telemetry frames are sent without waiting for the serial
+  telemetry.update(motor);
+
   // -------------------------------------------------------------
   // BLOCK 2 : SERIAL PARSING
   // -------------------------------------------------------------
   // Serial commands parser
-  if(Serial.available() > 0){
-    parseCommand(Serial.readString());
-  } // serial available
+  if(readSerialCommand()) {
+    idleGovernor.activity();
+    parseCommandLine(commandBuffer);
+  } // command line available
 
   // -------------------------------------------------------------
   // BLOCK 3 : ANALOG READING
   // -------------------------------------------------------------
-  // Check if a reading should be done
-  if(analogDutyCycle != ANALOG_DCNONE) {
+  // Check if a reading should be done, once every ANALOG_SAMPLE_TIME
+  // without waiting so that the control tick is not delayed
+  if( (analogDutyCycle != ANALOG_DCNONE) && ((millis() - analogTime) >= ANALOG_SAMPLE_TIME) ) {
+    analogTime = millis();
     // Read new value
     inputAnalogDC = readAnalogDutyCycle();
     // Check if value has changed. We should avoid multiple updates 
@@ -170,6 +350,21 @@ void loop() {
     } // new reading should be updated
   } // Analog reading is active
 
+  // -------------------------------------------------------------
+  // BLOCK 4 : LOW POWER IDLE
+  // -------------------------------------------------------------
+  // Sleep until the next serial character when nothing is running
+  if(idleGovernor.expired(!motor.motorsIdle() || sequence.isRunning || 
+                          (timedMove.phase != MOVE_IDLE) || (soak.phase != SOAK_IDLE) || 
+                          (analogDutyCycle != ANALOG_DCNONE) || telemetry.isEnabled)) {
+    // The backlight is most of the LCD power, switched off with the display
+    lcd.noDisplay();
+    lcd.backlightOff();
+    idleGovernor.sleep(motor);
+    lcd.backlightOn();
+    lcd.display();
+  }
+
 } // Main loop
 
 //! Short loop flashing led for signal
@@ -184,9 +379,18 @@ void flashLED(void) {
   }
 }
 
+//! Send the message of a refused command to the serial
+void serialError(const __FlashStringHelper* title, const char* description) {
+  commandFailed = true;
+  serialMessage(title, description);
+}
+
 //! Send a message to the serial
-void serialMessage(String title, String description) {
+void serialMessage(const __FlashStringHelper* title, const char* description) {
 #ifdef _SERIAL_ECHO
+    // The batch is acknowledged once
+    if(batchMode)
+      return;
     Serial.print(title);
     Serial.print(" ");
     Serial.println(description);
@@ -210,25 +414,73 @@ void serialMessage(String title, String description) {
     readings += analogRead(ANALOG_DCPIN);
   }
   readings /= 5;
-  delay(150);
 
   return map(readings, MIN_ANALOG_RANGE, MAX_ANALOG_RANGE, DUTYCYCLE_MIN, DUTYCYCLE_MAX);
  }
 
+/**
+ * Collect the characters available on the serial in the command buffer
+ * without waiting for the rest of the line.
+ * 
+ * \note The line terminator can be CR, LF or both; empty lines are ignored.
+ * Characters exceeding the buffer size are discarded.
+ * 
+ * \return true when a complete command line is available in the buffer
+ */
+boolean readSerialCommand(void) {
+  char c;
+
+  while(Serial.available() > 0) {
+    c = Serial.read();
+    if( (c == '\r') || (c == '\n') ) {
+      if(commandLength > 0) {
+        commandBuffer[commandLength] = '\0';
+        commandLength = 0;
+        commandTime = micros();
+        return true;
+      }
+    }
+    else if(commandLength < (CMD_BUFFER_SIZE - 1))
+      commandBuffer[commandLength++] = c;
+  }
+
+  return false;
+}
+
+/**
+ * Compare the received command with a command name stored in flash
+ * 
+ * \param commandString the command received from the serial
+ * \param commandName the command name, a PSTR() flash string
+ * \return true if the two strings are the same
+ */
+boolean isCommand(const char* commandString, const char* commandName) {
+  return strcmp_P(commandString, commandName) == 0;
+}
+
+/**
+ * Check if the received command starts with a command name stored in flash
+ * 
+ * \param commandString the command received from the serial
+ * \param prefix the command name, a PSTR() flash string
+ * \return true if the command starts with the prefix
+ */
+boolean hasCommandPrefix(const char* commandString, const char* prefix) {
+  return strncmp_P(commandString, prefix, strlen_P(prefix)) == 0;
+}
+
 /** ***********************************************************
  * Parse the command string and echo the executing message or 
  * command unknown error.
  * 
- * \param commandString the string coming from the serial
+ * \param commandString the command line coming from the serial
  *  ***********************************************************
  */
- void parseCommand(String cmdString) {
-  int cmdlen;
-  String commandString;
+ void parseCommand(const char* commandString) {
+  unsigned long numericValue;
+  int j;
 
-  commandString = cmdString;
-  cmdlen = cmdString.length() - 2;
-  commandString.remove(cmdlen);
+  trace.recordCommand(commandString);
 
   // First disable the analog pot reading. Should be active
   // only when the duty cycle is set (or when running in manual
@@ -241,177 +493,208 @@ void serialMessage(String title, String description) {
   // =========================================================
   // Informative commands
   // =========================================================
-  if(commandString.equals(SHOW_CONF)) {
+  if(isCommand(commandString, PSTR(SHOW_CONF))) {
     motor.showInfo();
   }
   // =========================================================
   // Motor select
   // =========================================================
-  else if(commandString.equals(MOTOR_1)) {
+  else if(isCommand(commandString, PSTR(MOTOR_1))) {
     motor.currentMotor = 1;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(MOTOR_2)) {
+  else if(isCommand(commandString, PSTR(MOTOR_2))) {
     motor.currentMotor = 2;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(MOTOR_3)) {
+  else if(isCommand(commandString, PSTR(MOTOR_3))) {
     motor.currentMotor = 3;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(MOTOR_4)) {
+  else if(isCommand(commandString, PSTR(MOTOR_4))) {
     motor.currentMotor = 4;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(MOTOR_5)) {
+  else if(isCommand(commandString, PSTR(MOTOR_5))) {
     motor.currentMotor = 5;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(MOTOR_6)) {
+  else if(isCommand(commandString, PSTR(MOTOR_6))) {
     motor.currentMotor = 6;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
   // =========================================================
   // Motor enable
   // =========================================================
-  else if(commandString.equals(MOTOR_ALL)) {
+  else if(isCommand(commandString, PSTR(MOTOR_ALL))) {
     int j;
     motor.currentMotor = 0;
     for(j = 0; j < MAX_MOTORS; j++) {
       motor.internalStatus[j].isEnabled = true;
     }
-    lcd.clear();
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(MOTOR_NONE)) {
+  else if(isCommand(commandString, PSTR(MOTOR_NONE))) {
     int j;
     motor.currentMotor = 0;
     for(j = 0; j < MAX_MOTORS; j++) {
       motor.internalStatus[j].isEnabled = false;
     }
-    lcd.clear();
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(EN_MOTOR_1)) {
+  else if(isCommand(commandString, PSTR(EN_MOTOR_1))) {
     motor.currentMotor = 1;
     motor.internalStatus[0].isEnabled = true;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(EN_MOTOR_2)) {
+  else if(isCommand(commandString, PSTR(EN_MOTOR_2))) {
     motor.currentMotor = 2;
     motor.internalStatus[1].isEnabled = true;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(EN_MOTOR_3)) {
+  else if(isCommand(commandString, PSTR(EN_MOTOR_3))) {
     motor.currentMotor = 3;
     motor.internalStatus[2].isEnabled = true;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(EN_MOTOR_4)) {
+  else if(isCommand(commandString, PSTR(EN_MOTOR_4))) {
     motor.currentMotor = 4;
     motor.internalStatus[3].isEnabled = true;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(EN_MOTOR_5)) {
+  else if(isCommand(commandString, PSTR(EN_MOTOR_5))) {
     motor.currentMotor = 5;
     motor.internalStatus[4].isEnabled = true;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(EN_MOTOR_6)) {
+  else if(isCommand(commandString, PSTR(EN_MOTOR_6))) {
     motor.currentMotor = 6;
     motor.internalStatus[5].isEnabled = true;
     showMotorSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
   // =========================================================
   // PWM channel motors assignment
   // =========================================================
-  else if(commandString.equals(PWM_0)) {
+  else if(isCommand(commandString, PSTR(PWM_0))) {
     motor.setPWM(tle94112.TLE_NOPWM);
     showMotorSetting();
-    serialMessage(CMD_PWM, commandString);
+    serialMessage(F(CMD_PWM), commandString);
   }
-  else if(commandString.equals(PWM_80)) {
+  else if(isCommand(commandString, PSTR(PWM_80))) {
     motor.setPWM(tle94112.TLE_PWM1);
     showMotorSetting();
-    serialMessage(CMD_PWM, commandString);
+    serialMessage(F(CMD_PWM), commandString);
   }
-  else if(commandString.equals(PWM_100)) {
+  else if(isCommand(commandString, PSTR(PWM_100))) {
     motor.setPWM(tle94112.TLE_PWM2);
     showMotorSetting();
-    serialMessage(CMD_PWM, commandString);
+    serialMessage(F(CMD_PWM), commandString);
   }
-  else if(commandString.equals(PWM_200)) {
+  else if(isCommand(commandString, PSTR(PWM_200))) {
     motor.setPWM(tle94112.TLE_PWM3);
     showMotorSetting();
-    serialMessage(CMD_PWM, commandString);
+    serialMessage(F(CMD_PWM), commandString);
   }
   // =========================================================
   // PWM channel select for duty cycle setting
   // =========================================================
-  else if(commandString.equals(PWM80_DC)) {
-    motor.currentPWM = PWM80_CHID;
+  else if(isCommand(commandString, PSTR(PWM80_DC))) {
+    motor.currentPWM = PWM1_CHID;
     showPWMSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(PWM100_DC)) {
-    motor.currentPWM = PWM100_CHID;
+  else if(isCommand(commandString, PSTR(PWM100_DC))) {
+    motor.currentPWM = PWM2_CHID;
     showPWMSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(PWM200_DC)) {
-    motor.currentPWM = PWM200_CHID;
+  else if(isCommand(commandString, PSTR(PWM200_DC))) {
+    motor.currentPWM = PWM3_CHID;
     showPWMSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
   }
-  else if(commandString.equals(PWMALL_DC)) {
+  else if(isCommand(commandString, PSTR(PWMALL_DC))) {
     motor.currentPWM = 0;
     showPWMSetting();
-    serialMessage(CMD_SET, commandString);
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Motors duty cycle with automatic PWM channels allocation
+  // =========================================================
+  else if(isCommand(commandString, PSTR(MOTOR_DC_INFO))) {
+    showAllocation();
+  }
+  else if(hasCommandPrefix(commandString, PSTR(MOTOR_DC)) && 
+          parseNumber(commandString + strlen_P(PSTR(MOTOR_DC)), DUTYCYCLE_MAX, numericValue)) {
+    motor.setMotorDC((uint8_t)numericValue);
+    serialMessage(F(CMD_SET), commandString);
+    // A batch is acknowledged by a single reply
+    if(!batchMode)
+      showAllocation();
   }
   // =========================================================
   // Direction and acceleration setting
   // =========================================================
-  else if(commandString.equals(DIRECTION_CW)) {
+  else if(isCommand(commandString, PSTR(DIRECTION_CW))) {
     motor.setMotorDirection(MOTOR_DIRECTION_CW);
     showMotorSetting();
-    serialMessage(CMD_DIRECTION, commandString);
+    serialMessage(F(CMD_DIRECTION), commandString);
   }
-  else if(commandString.equals(DIRECTION_CCW)) {
+  else if(isCommand(commandString, PSTR(DIRECTION_CCW))) {
     motor.setMotorDirection(MOTOR_DIRECTION_CCW);
     showMotorSetting();
-    serialMessage(CMD_DIRECTION, commandString);
+    serialMessage(F(CMD_DIRECTION), commandString);
   }
   // =========================================================
   // Freewheeling mode
   // =========================================================
-  else if(commandString.equals(FW_ACTIVE)) {
+  else if(isCommand(commandString, PSTR(FW_ACTIVE))) {
     motor.setMotorFreeWheeling(MOTOR_FW_ACTIVE);
     showMotorSetting();
-    serialMessage(CMD_MODE, commandString);
+    serialMessage(F(CMD_MODE), commandString);
   }
-  else if(commandString.equals(FW_PASSIVE)) {
+  else if(isCommand(commandString, PSTR(FW_PASSIVE))) {
     motor.setMotorFreeWheeling(MOTOR_FW_PASSIVE);
     showMotorSetting();
-    serialMessage(CMD_MODE, commandString);
+    serialMessage(F(CMD_MODE), commandString);
+  }
+  // =========================================================
+  // Stop mode
+  // =========================================================
+  else if(isCommand(commandString, PSTR(STOP_MODE_COAST))) {
+    motor.setMotorStopMode(STOP_COAST, BRAKE_TIME);
+    showMotorSetting();
+    serialMessage(F(CMD_MODE), commandString);
+  }
+  else if(isCommand(commandString, PSTR(STOP_MODE_BRAKE))) {
+    motor.setMotorStopMode(STOP_BRAKE, BRAKE_TIME);
+    showMotorSetting();
+    serialMessage(F(CMD_MODE), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(STOP_MODE_BRAKE)) && 
+          parseNumber(commandString + strlen_P(PSTR(STOP_MODE_BRAKE)), 0xffff, numericValue)) {
+    motor.setMotorStopMode(STOP_BRAKE_FLOAT, (uint16_t)numericValue);
+    showMotorSetting();
+    serialMessage(F(CMD_MODE), commandString);
   }
   // =========================================================
   // Duty cycle and PWM ramp settings
   // =========================================================
-  else if(commandString.equals(MANUAL_DC)) {
+  else if(isCommand(commandString, PSTR(MANUAL_DC))) {
     motor.setPWMManualDC(MOTOR_MANUAL_DC);
     // Initialize the max duty cycle to the last analog read
     // by default
@@ -419,54 +702,60 @@ void serialMessage(String title, String description) {
     motor.setPWMMinDC(DUTYCYCLE_MIN);
     showPWMSetting();
     lcdShowDutyCycleManual();
-    serialMessage(CMD_MODE, commandString);
+    serialMessage(F(CMD_MODE), commandString);
   }
-  else if(commandString.equals(AUTO_DC)) {
+  else if(isCommand(commandString, PSTR(AUTO_DC))) {
     motor.setPWMManualDC(MOTOR_AUTO_DC);
     showPWMSetting();
     lcdShowDutyCycleAuto();
-    serialMessage(CMD_MODE, commandString);
+    serialMessage(F(CMD_MODE), commandString);
   }
-  else if(commandString.equals(MIN_DC)) {
+  else if(isCommand(commandString, PSTR(MIN_DC))) {
     analogDutyCycle = ANALOG_DCMIN;
     motor.setPWMMinDC(inputAnalogDC);
     showPWMSetting();
     lcdShowDutyCycleMin();
-    serialMessage(CMD_MODE, commandString);
+    serialMessage(F(CMD_MODE), commandString);
   }
-  else if(commandString.equals(MAX_DC)) {
+  else if(isCommand(commandString, PSTR(MAX_DC))) {
     analogDutyCycle = ANALOG_DCMAX;
     motor.setPWMMaxDC(inputAnalogDC);
     showPWMSetting();
     lcdShowDutyCycleMax();
-    serialMessage(CMD_MODE, commandString);
+    serialMessage(F(CMD_MODE), commandString);
   }
-  else if(commandString.equals(INFO_DC)) {
+  else if(isCommand(commandString, PSTR(INFO_DC))) {
     showPWMInfo();
-    serialMessage(CMD_MODE, commandString);
+    serialMessage(F(CMD_MODE), commandString);
   }
-  else if(commandString.equals(PWM_RAMP)) {
+  else if(isCommand(commandString, PSTR(PWM_RAMP))) {
     motor.setPWMRamp(RAMP_ON);
     showPWMSetting();
     lcdShowPWMRamp();
-    serialMessage(CMD_MODE, commandString);
+    serialMessage(F(CMD_MODE), commandString);
   }
-  else if(commandString.equals(PWM_NORAMP)) {
+  else if(isCommand(commandString, PSTR(PWM_NORAMP))) {
     motor.setPWMRamp(RAMP_OFF);
     showPWMSetting();
     lcdShowPWMRamp();
-    serialMessage(CMD_MODE, commandString);
+    serialMessage(F(CMD_MODE), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(PWM_FREQUENCY)) && 
+          parseNumber(commandString + strlen_P(PSTR(PWM_FREQUENCY)), 0xffff, numericValue) &&
+          motor.setPWMFrequency((unsigned int)numericValue)) {
+    showPWMSetting();
+    serialMessage(F(CMD_SET), commandString);
   }
   // =========================================================
   // Motor actions
   // =========================================================
-  else if(commandString.equals(MOTOR_RESET)) {
-    Serial << CMD_EXEC << " '" << commandString << "'" << endl;
+  else if(isCommand(commandString, PSTR(MOTOR_RESET))) {
+    Serial << F(CMD_EXEC) << F(" '") << commandString << F("'") << endl;
     lcdIntroMessage();
     motor.reset();
-    Serial << CMD_DONE << endl;
+    Serial << F(CMD_DONE) << endl;
   }
-  else if(commandString.equals(MOTOR_START)) {
+  else if(isCommand(commandString, PSTR(MOTOR_START))) {
     lcdShowStarting();
     motor.startMotors();
     lcdShowRunning();
@@ -474,29 +763,1031 @@ void serialMessage(String title, String description) {
     if(motor.hasManualDC)
       analogDutyCycle = ANALOG_DCMAN;
   }
-  else if(commandString.equals(MOTOR_STOP)) {
+  else if(isCommand(commandString, PSTR(MOTOR_STOP)) || isCommand(commandString, PSTR(SOAK_STOP))) {
+    sequence.stop();
+    timedMove.stop(motor);
+    soak.stop();
     lcdShowStopping();
     motor.stopMotors();
     lcdShowHalted();
     isRunning = false;
     analogDutyCycle = ANALOG_DCNONE;
   }
+  // =========================================================
+  // Binary telemetry
+  // =========================================================
+  else if(isCommand(commandString, PSTR(TELEMETRY_ON))) {
+    serialMessage(F(CMD_SET), commandString);
+    telemetry.enable(true);
+  }
+  else if(isCommand(commandString, PSTR(TELEMETRY_OFF))) {
+    telemetry.enable(false);
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(isCommand(commandString, PSTR(TELEMETRY_INFO))) {
+    Serial << F(INFO_TELEMETRY_SENT) << telemetry.sentFrames << F(INFO_TELEMETRY_DROPPED) << 
+              telemetry.droppedFrames << F(INFO_TELEMETRY_LOOP) << telemetry.maxLoopTime << F(" us") << endl;
+  }
+  else if(hasCommandPrefix(commandString, PSTR(TELEMETRY_RATE)) && 
+          parseNumber(commandString + strlen_P(PSTR(TELEMETRY_RATE)), 0xffff, numericValue)) {
+    telemetry.setPeriod((uint16_t)numericValue);
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Closed loop speed control of the selected motor
+  // =========================================================
+  else if(isCommand(commandString, PSTR(SPEED_INFO))) {
+    showSpeedInfo();
+  }
+  else if(isCommand(commandString, PSTR(SPEED_NOTACH)) && (motor.currentMotor > 0)) {
+    speed.detach(motor.currentMotor - 1);
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(SPEED_TACH)) && (motor.currentMotor > 0) &&
+          parseNumber(commandString + strlen_P(PSTR(SPEED_TACH)), 0xff, numericValue) &&
+          speed.attach(motor.currentMotor - 1, (uint8_t)numericValue)) {
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(SPEED_TARGET)) && (motor.currentMotor > 0) &&
+          parseNumber(commandString + strlen_P(PSTR(SPEED_TARGET)), 0xffff, numericValue) &&
+          speed.setTarget(motor.currentMotor - 1, (uint16_t)numericValue)) {
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(SPEED_KP_GAIN)) && 
+          parseNumber(commandString + strlen_P(PSTR(SPEED_KP_GAIN)), SPEED_MAX_GAIN, numericValue)) {
+    speed.kp = (uint16_t)numericValue;
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(SPEED_KI_GAIN)) && 
+          parseNumber(commandString + strlen_P(PSTR(SPEED_KI_GAIN)), SPEED_MAX_GAIN, numericValue)) {
+    speed.ki = (uint16_t)numericValue;
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Low power idle
+  // =========================================================
+  else if(isCommand(commandString, PSTR(IDLE_INFO))) {
+    Serial << F(INFO_IDLE_TITLE) << idleGovernor.quietTime << F(INFO_IDLE_SLEEPS) << 
+              idleGovernor.sleeps << F(INFO_IDLE_LATENCY) << idleGovernor.wakeLatency << 
+              F(INFO_IDLE_MAX_LATENCY) << idleGovernor.maxWakeLatency << F(" us") << endl;
+  }
+  else if(hasCommandPrefix(commandString, PSTR(IDLE_TIME)) && 
+          parseNumber(commandString + strlen_P(PSTR(IDLE_TIME)), IDLE_MAX_QUIET_TIME, numericValue)) {
+    idleGovernor.quietTime = (uint16_t)numericValue;
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Duty cycle dithering of the selected PWM channel
+  // =========================================================
+  else if(isCommand(commandString, PSTR(DITHER_INFO))) {
+    showDitherInfo();
+  }
+  else if(isCommand(commandString, PSTR(DITHER_OFF))) {
+    for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+      if((motor.currentPWM == 0) || (motor.currentPWM == (j + 1)))
+        dither.clear(motor, j);
+    }
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(DITHER_PERIOD)) && 
+          parseNumber(commandString + strlen_P(PSTR(DITHER_PERIOD)), DITHER_MAX_PERIOD, numericValue) &&
+          (numericValue > 0)) {
+    dither.period = (uint8_t)numericValue;
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(DITHER_SET)) && 
+          parseNumber(commandString + strlen_P(PSTR(DITHER_SET)), 0xffff, numericValue)) {
+    for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+      if((motor.currentPWM == 0) || (motor.currentPWM == (j + 1)))
+        dither.set(j, (uint16_t)numericValue);
+    }
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Waveform of the selected PWM channel
+  // =========================================================
+  else if(isCommand(commandString, PSTR(WAVE_INFO))) {
+    showWaveInfo();
+  }
+  else if(isCommand(commandString, PSTR(WAVE_OFF))) {
+    for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+      if((motor.currentPWM == 0) || (motor.currentPWM == (j + 1)))
+        waveform.waves[j].shape = WAVE_NONE;
+    }
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(WAVE_SET)) && 
+          parseWaveform(commandString + strlen_P(PSTR(WAVE_SET)))) {
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Soak test, started only when the motors are stopped
+  // =========================================================
+  else if(isCommand(commandString, PSTR(SOAK_INFO))) {
+    Serial << F(INFO_SOAK_SETTINGS) << soak.runTime << F(",") << soak.restTime << F(",") << 
+              soak.maxCycles << F(",") << soak.reportTime << endl;
+    showSoakSummary();
+  }
+  else if(isCommand(commandString, PSTR(SOAK_START)) && !isRunning) {
+    startMove(soak.start(motor), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(SOAK_SET)) && (soak.phase == SOAK_IDLE) &&
+          parseSoakCycle(commandString + strlen_P(PSTR(SOAK_SET)))) {
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Power budget
+  // =========================================================
+  else if(isCommand(commandString, PSTR(POWER_INFO))) {
+    showPowerInfo();
+  }
+  else if(hasCommandPrefix(commandString, PSTR(POWER_BUDGET)) && 
+          parseNumber(commandString + strlen_P(PSTR(POWER_BUDGET)), MAX_POWER_BUDGET, numericValue)) {
+    motor.setPowerBudget((uint16_t)numericValue);
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(POWER_WEIGHT)) && 
+          parseNumber(commandString + strlen_P(PSTR(POWER_WEIGHT)), MAX_POWER_WEIGHT, numericValue)) {
+    motor.setPowerWeight((uint8_t)numericValue);
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Control tick statistics
+  // =========================================================
+  else if(isCommand(commandString, PSTR(TICK_INFO))) {
+    Serial << F(INFO_TICK_TITLE) << controlTick.serviced << F(INFO_TICK_OVERRUNS) << 
+              controlTick.overruns << F(INFO_TICK_JITTER) << controlTick.maxJitter << 
+              F(INFO_TICK_LATENCY) << controlTick.maxLatency << F(" us") << endl;
+  }
+  else if(isCommand(commandString, PSTR(TICK_RESET))) {
+    controlTick.resetStats();
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Timed moves, only when the motors are stopped
+  // =========================================================
+  else if(isCommand(commandString, PSTR(MOVE_INFO))) {
+    showMoveInfo();
+  }
+  else if(hasCommandPrefix(commandString, PSTR(MOVE_BUDGET)) && !isRunning &&
+          parseNumber(commandString + strlen_P(PSTR(MOVE_BUDGET)), 0xffff, numericValue)) {
+    startMove(timedMove.runBudget(motor, numericValue), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(MOVE_TIME)) && !isRunning &&
+          parseNumber(commandString + strlen_P(PSTR(MOVE_TIME)), 0xffff, numericValue)) {
+    startMove(timedMove.runTime(motor, numericValue), commandString);
+  }
+  // =========================================================
+  // Motion sequence. The program can't be changed while running
+  // =========================================================
+  else if(hasCommandPrefix(commandString, PSTR(SEQUENCE_APPEND)) && !sequence.isRunning) {
+    if(sequence.append(commandString + strlen_P(PSTR(SEQUENCE_APPEND))))
+      serialMessage(F(CMD_SET), commandString);
+    else
+      serialError(F(CMD_BADSEQUENCE), commandString);
+  }
+  else if(isCommand(commandString, PSTR(SEQUENCE_CLEAR)) && !sequence.isRunning) {
+    sequence.begin();
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(isCommand(commandString, PSTR(SEQUENCE_RUN))) {
+    if(sequence.start(motor, speed))
+      serialMessage(F(CMD_EXEC), commandString);
+    else
+      serialError(F(CMD_BADSEQUENCE), commandString);
+  }
+  else if(isCommand(commandString, PSTR(SEQUENCE_STOP))) {
+    sequence.stop();
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(isCommand(commandString, PSTR(SEQUENCE_INFO))) {
+    Serial << F(INFO_SEQUENCE_SIZE) << sequence.programSize << 
+              (sequence.isRunning ? F(INFO_SEQUENCE_RUNNING) : F(INFO_SEQUENCE_STOPPED)) << 
+              sequence.pc << endl;
+    Serial << F(INFO_SEQUENCE_CYCLES) << sequence.cycles << F(INFO_SEQUENCE_OVERRUNS) << 
+              sequence.overruns << F(INFO_SEQUENCE_LATENESS) << sequence.maxLateness << F(" ms") << endl;
+  }
+  // =========================================================
+  // Configuration persistence
+  // =========================================================
+  else if(isCommand(commandString, PSTR(CONFIG_SAVE))) {
+    motor.saveConfig();
+    serialMessage(F(CMD_DONE), commandString);
+  }
+  else if(isCommand(commandString, PSTR(CONFIG_LOAD)) && !isRunning) {
+    if(motor.loadConfig()) {
+      showMotorSetting();
+      serialMessage(F(CMD_DONE), commandString);
+    }
+    else
+      serialError(F(CMD_NOCONFIG), commandString);
+  }
+  else if(isCommand(commandString, PSTR(CONFIG_AUTOSTART))) {
+    motor.autoStart = true;
+    serialMessage(F(CMD_MODE), commandString);
+  }
+  else if(isCommand(commandString, PSTR(CONFIG_NOAUTOSTART))) {
+    motor.autoStart = false;
+    serialMessage(F(CMD_MODE), commandString);
+  }
+  // =========================================================
+  // Configuration profiles
+  // =========================================================
+  else if(hasCommandPrefix(commandString, PSTR(PROFILE_SAVE)) && 
+          parseSaveProfile(commandString + strlen_P(PSTR(PROFILE_SAVE)))) {
+    serialMessage(F(CMD_DONE), commandString);
+  }
+  // A name not found is a wrong command
+  else if(hasCommandPrefix(commandString, PSTR(PROFILE_SELECT)) && 
+          ((j = parseProfile(commandString + strlen_P(PSTR(PROFILE_SELECT)))) != NO_PROFILE)) {
+    if(motor.selectProfile(j)) {
+      serialMessage(F(CMD_SET), commandString);
+      if(!batchMode)
+        Serial << F(INFO_PROFILE_WRITES) << motor.registerWrites << endl;
+      // The profile could have no motors enabled
+      if(isRunning && !motor.motorsRunning()) {
+        lcdShowHalted();
+        isRunning = false;
+      }
+      if(isRunning && motor.hasManualDC)
+        analogDutyCycle = ANALOG_DCMAN;
+      else
+        analogDutyCycle = ANALOG_DCNONE;
+    }
+    else
+      serialError(F(CMD_NOPROFILE), commandString);
+  }
+  else if(isCommand(commandString, PSTR(PROFILE_LIST))) {
+    showProfiles();
+  }
+  // =========================================================
+  // Flight recorder
+  // =========================================================
+  else if(isCommand(commandString, PSTR(TRACE_DUMP))) {
+    Serial << F(INFO_TRACE_TITLE);
+    if(trace.isFrozen)
+      Serial << F(INFO_TRACE_FROZEN);
+    Serial << endl;
+    trace.dump();
+  }
+  else if(isCommand(commandString, PSTR(TRACE_CLEAR))) {
+    trace.begin();
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(isCommand(commandString, PSTR(TRACE_STOP))) {
+    trace.freeze(false);
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Fault reactions
+  // =========================================================
+  else if(isCommand(commandString, PSTR(FAULT_INFO))) {
+    showFaultInfo();
+  }
+  else if(isCommand(commandString, PSTR(FAULT_DEFAULT))) {
+    motor.resetFaultPolicy();
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(FAULT_SET)) && 
+          parseFaultPolicy(commandString + strlen_P(PSTR(FAULT_SET)))) {
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(FAULT_FILTER)) && 
+          parseFaultFilter(commandString + strlen_P(PSTR(FAULT_FILTER)))) {
+    serialMessage(F(CMD_SET), commandString);
+  }
+  // =========================================================
+  // Half bridges layout. Can't be changed while running
+  // =========================================================
+  else if(isCommand(commandString, PSTR(HB_STANDARD)) && !isRunning) {
+    motor.setBridgeLayout(LAYOUT_STANDARD);
+    motor.resetHB();
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(isCommand(commandString, PSTR(HB_HIGHCURRENT)) && !isRunning) {
+    motor.setBridgeLayout(LAYOUT_HIGHCURRENT);
+    motor.resetHB();
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(isCommand(commandString, PSTR(HB_REMOVE)) && !isRunning && (motor.currentMotor > 0)) {
+    motor.clearMotorLayout(motor.currentMotor - 1);
+    motor.resetHB();
+    serialMessage(F(CMD_SET), commandString);
+  }
+  else if(hasCommandPrefix(commandString, PSTR(HB_LAYOUT)) && !isRunning && 
+          parseMotorLayout(commandString + strlen_P(PSTR(HB_LAYOUT)))) {
+    motor.resetHB();
+    serialMessage(F(CMD_SET), commandString);
+  }
   
-  else
-    Serial << CMD_WRONGCMD << " '" << commandString << "'" << endl;
+  else {
+    commandFailed = true;
+    if(!batchMode)
+      Serial << F(CMD_WRONGCMD) << F(" '") << commandString << F("'") << endl;
+  }
  }
 
+/** ***********************************************************
+ * Execute a command line, with an optional tag. A tagged line
+ * is followed by a reply with the tag, the result and the times
+ * (us) when the line has been received, when the execution has
+ * started and when the execution has been completed, including
+ * the TLE94112 registers written by the command.
+ * 
+ * \param line the command line coming from the serial, split
+ * in place
+ *  ***********************************************************
+ */
+void parseCommandLine(char* line) {
+  unsigned long tag, dispatchTime;
+  char* command;
+  boolean tagged;
+
+  // e.g. #12 m1+
+  command = line;
+  tagged = (*line == COMMAND_TAG_PREFIX);
+  if(tagged) {
+    command = strchr(line, ' ');
+    if(command != NULL)
+      *command++ = '\0';
+    if( (command == NULL) || !parseNumber(line + 1, COMMAND_TAG_MAX, tag) ) {
+      Serial << F(CMD_WRONGCMD) << F(" '") << line << F("'") << endl;
+      return;
+    }
+  }
+
+  commandFailed = false;
+  dispatchTime = micros();
+  if(strchr(command, BATCH_SEPARATOR) != NULL)
+    parseBatch(command);
+  else
+    parseCommand(command);
+
+  if(tagged)
+    Serial << F(CMD_TAG) << tag << (commandFailed ? F(CMD_TAG_FAILED) : F(CMD_TAG_DONE)) <<
+              commandTime << F(" ") << dispatchTime << F(" ") << micros() << endl;
+}
+
+/**
+ * Check a command of a batch, without executing it. A batch contains
+ * only the motors and PWM settings that are restored when a command is
+ * refused; the motor actions, which can't be undone, are accepted only
+ * as the last command
+ * 
+ * \param command The command
+ * \param last true if the command is the last of the batch
+ * \return true if the command and its value are valid in a batch
+ */
+boolean checkBatchCommand(const char* command, boolean last) {
+  unsigned long numericValue;
+  profileRecord record;
+  int profile;
+
+  // Motor actions
+  if( isCommand(command, PSTR(MOTOR_START)) || isCommand(command, PSTR(MOTOR_STOP)) ||
+      isCommand(command, PSTR(SEQUENCE_RUN)) || isCommand(command, PSTR(SOAK_START)) )
+    return last;
+  if(hasCommandPrefix(command, PSTR(MOVE_BUDGET)))
+    return last && parseNumber(command + strlen_P(PSTR(MOVE_BUDGET)), 0xffff, numericValue) &&
+           (numericValue > 0);
+  if(hasCommandPrefix(command, PSTR(MOVE_TIME)))
+    return last && parseNumber(command + strlen_P(PSTR(MOVE_TIME)), 0xffff, numericValue) &&
+           (numericValue > 0);
+
+  // Settings without value
+  if( isCommand(command, PSTR(MOTOR_1)) || isCommand(command, PSTR(MOTOR_2)) ||
+      isCommand(command, PSTR(MOTOR_3)) || isCommand(command, PSTR(MOTOR_4)) ||
+      isCommand(command, PSTR(MOTOR_5)) || isCommand(command, PSTR(MOTOR_6)) ||
+      isCommand(command, PSTR(EN_MOTOR_1)) || isCommand(command, PSTR(EN_MOTOR_2)) ||
+      isCommand(command, PSTR(EN_MOTOR_3)) || isCommand(command, PSTR(EN_MOTOR_4)) ||
+      isCommand(command, PSTR(EN_MOTOR_5)) || isCommand(command, PSTR(EN_MOTOR_6)) ||
+      isCommand(command, PSTR(MOTOR_ALL)) || isCommand(command, PSTR(MOTOR_NONE)) ||
+      isCommand(command, PSTR(PWM_0)) || isCommand(command, PSTR(PWM_80)) ||
+      isCommand(command, PSTR(PWM_100)) || isCommand(command, PSTR(PWM_200)) ||
+      isCommand(command, PSTR(PWM80_DC)) || isCommand(command, PSTR(PWM100_DC)) ||
+      isCommand(command, PSTR(PWM200_DC)) || isCommand(command, PSTR(PWMALL_DC)) ||
+      isCommand(command, PSTR(DIRECTION_CW)) || isCommand(command, PSTR(DIRECTION_CCW)) ||
+      isCommand(command, PSTR(FW_ACTIVE)) || isCommand(command, PSTR(FW_PASSIVE)) ||
+      isCommand(command, PSTR(STOP_MODE_COAST)) || isCommand(command, PSTR(STOP_MODE_BRAKE)) ||
+      isCommand(command, PSTR(AUTO_DC)) || isCommand(command, PSTR(PWM_RAMP)) ||
+      isCommand(command, PSTR(PWM_NORAMP)) )
+    return true;
+
+  // Settings with a value
+  if(hasCommandPrefix(command, PSTR(MOTOR_DC)))
+    return parseNumber(command + strlen_P(PSTR(MOTOR_DC)), DUTYCYCLE_MAX, numericValue);
+  if(hasCommandPrefix(command, PSTR(STOP_MODE_BRAKE)))
+    return parseNumber(command + strlen_P(PSTR(STOP_MODE_BRAKE)), 0xffff, numericValue);
+  if(hasCommandPrefix(command, PSTR(PWM_FREQUENCY)))
+    return parseNumber(command + strlen_P(PSTR(PWM_FREQUENCY)), 0xffff, numericValue) &&
+           (motor.findPWMFrequency((unsigned int)numericValue) >= 0);
+  if(hasCommandPrefix(command, PSTR(POWER_WEIGHT)))
+    return parseNumber(command + strlen_P(PSTR(POWER_WEIGHT)), MAX_POWER_WEIGHT, numericValue);
+  // The profile should be saved and valid, else the batch would be rolled back
+  if(hasCommandPrefix(command, PSTR(PROFILE_SELECT))) {
+    profile = parseProfile(command + strlen_P(PSTR(PROFILE_SELECT)));
+    return (profile != NO_PROFILE) && motor.readProfile(profile, record);
+  }
+
+  return false;
+}
+
+/** ***********************************************************
+ * Execute a batch of commands separated by BATCH_SEPARATOR as a
+ * single configuration change. Every command is checked before
+ * executing the batch (see checkBatchCommand()); the execution
+ * stops at the first refused command and the motors and PWM
+ * settings are restored as before the batch. The LCD is updated
+ * once at the end and the batch is acknowledged with the status
+ * of every command.
+ * 
+ * \param batch the command line coming from the serial, split
+ * in place
+ *  ***********************************************************
+ */
+void parseBatch(char* batch) {
+  char* commands[BATCH_MAX_COMMANDS];
+  char status[BATCH_MAX_COMMANDS + 1];
+  profileRecord settings;
+  int count, selected, channel, profile, j;
+  boolean failed;
+
+  // Split and check the commands, an empty command is not valid
+  count = 0;
+  failed = false;
+  while(batch != NULL) {
+    if( (count == BATCH_MAX_COMMANDS) || (*batch == '\0') || (*batch == BATCH_SEPARATOR) ) {
+      failed = true;
+      break;
+    }
+    commands[count++] = batch;
+    batch = strchr(batch, BATCH_SEPARATOR);
+    if(batch != NULL)
+      *batch++ = '\0';
+  }
+  memset(status, BATCH_SKIPPED, count);
+  status[count] = '\0';
+  // Dry run: no command is executed if one is not valid
+  for(j = 0; (j < count) && !failed; j++) {
+    if(!checkBatchCommand(commands[j], j == (count - 1))) {
+      status[j] = BATCH_FAILED;
+      failed = true;
+    }
+  }
+  if(failed) {
+    commandFailed = true;
+    Serial << F(CMD_BATCH) << status << F(CMD_BATCH_INVALID) << endl;
+    return;
+  }
+
+  motor.copySettings(settings);
+  selected = motor.currentMotor;
+  channel = motor.currentPWM;
+  profile = motor.activeProfile;
+  batchMode = true;
+  lcdPending = false;
+  for(j = 0; (j < count) && !failed; j++) {
+    commandFailed = false;
+    parseCommand(commands[j]);
+    failed = commandFailed;
+    status[j] = failed ? BATCH_FAILED : BATCH_DONE;
+  }
+  batchMode = false;
+
+  if(failed) {
+    motor.applySettings(settings);
+    motor.currentMotor = selected;
+    motor.currentPWM = channel;
+    motor.activeProfile = profile;
+    lcdPending = true;
+  }
+  if(lcdPending)
+    showMotorSetting();
+
+  Serial << F(CMD_BATCH) << status;
+  if(failed)
+    Serial << F(CMD_BATCH_ROLLBACK);
+  Serial << endl;
+}
+
+/**
+ * Parse a decimal number
+ * 
+ * \param number The string with the number only
+ * \param maxValue The max accepted value
+ * \param value The parsed value
+ * \return true if the string is a valid number not greater than maxValue
+ */
+boolean parseNumber(const char* number, unsigned long maxValue, unsigned long &value) {
+  if(*number == '\0')
+    return false;
+
+  value = 0;
+  while(isdigit(*number)) {
+    value = value * 10 + (*number++ - '0');
+    if(value > maxValue)
+      return false;
+  }
+
+  return *number == '\0';
+}
+
+/**
+ * Search a name in a flash table of flash strings
+ * 
+ * \param name The name to search
+ * \param nameLength The number of characters of the name to compare
+ * \param table The PROGMEM array of PROGMEM strings
+ * \param entries The number of strings in the table
+ * \return The index of the name in the table, -1 if not found
+ */
+int findName(const char* name, int nameLength, const char* const* table, int entries) {
+  int j;
+  const char* tableName;
+
+  for(j = 0; j < entries; j++) {
+    tableName = (const char*)pgm_read_ptr(&table[j]);
+    if( (strlen_P(tableName) == (size_t)nameLength) && (strncmp_P(name, tableName, nameLength) == 0) )
+      return j;
+  }
+
+  return -1;
+}
+
+/**
+ * Parse a fault reaction in the format class=action, e.g. "uv=stopall".
+ * The retry action can be followed by the delay in ms, e.g. "tsd=retry500"
+ * 
+ * \param policy The policy string, without the command prefix
+ * \return true if the policy is valid and has been applied
+ */
+boolean parseFaultPolicy(const char* policy) {
+  const char* action;
+  const char* delayValue;
+  int fault, reaction;
+  unsigned long retryDelay;
+
+  action = strchr(policy, '=');
+  if(action == NULL)
+    return false;
+  fault = findName(policy, action - policy, faultNames, FAULT_CLASSES);
+  if(fault < 0)
+    return false;
+
+  // The action name is followed by the optional delay
+  action++;
+  delayValue = action;
+  while(isalpha(*delayValue))
+    delayValue++;
+  reaction = findName(action, delayValue - action, faultActions, FAULT_ACTIONS);
+  if(reaction < 0)
+    return false;
+
+  retryDelay = FAULT_RETRY_DELAY;
+  if(*delayValue != '\0') {
+    if( (reaction != FAULT_RETRY) || !parseNumber(delayValue, 0xffff, retryDelay) )
+      return false;
+  }
+
+  motor.setFaultPolicy(fault, reaction, (uint16_t)retryDelay);
+  return true;
+}
+
+/**
+ * Parse the diagnostic filter of a fault class and apply it. The format
+ * is class=samples,ramp,rate e.g. "load=3,50,1000"
+ * 
+ * \param filter The filter string, without the command prefix
+ * \return true if the filter is valid and has been applied
+ */
+boolean parseFaultFilter(const char* filter) {
+  static const unsigned long maxValues[3] = { FAULT_MAX_SAMPLES, 0xffff, 0xffff };
+  unsigned long values[3];
+  const char* equal;
+  int fault;
+
+  equal = strchr(filter, '=');
+  if(equal == NULL)
+    return false;
+  fault = findName(filter, equal - filter, faultNames, FAULT_CLASSES);
+  if( (fault < 0) || !parseValues(equal + 1, values, maxValues, 3) || (values[0] == 0) )
+    return false;
+
+  motor.setFaultFilter(fault, (uint8_t)values[0], (uint16_t)values[1], (uint16_t)values[2]);
+  return true;
+}
+
+/**
+ * Parse the waveform of the selected PWM channel (all the channels if
+ * none is selected) and apply it. The format is shape=amplitude,offset,
+ * period,phase e.g. "sine=100,128,2000,90"
+ * 
+ * \param wave The waveform string, without the command prefix
+ * \return true if the waveform is valid and has been applied
+ */
+boolean parseWaveform(const char* wave) {
+  static const unsigned long maxValues[4] = { DUTYCYCLE_MAX, DUTYCYCLE_MAX, WAVE_MAX_PERIOD, WAVE_MAX_PHASE };
+  unsigned long values[4];
+  waveChannel settings;
+  const char* equal;
+  int shape, j;
+
+  equal = strchr(wave, '=');
+  if(equal == NULL)
+    return false;
+  shape = findName(wave, equal - wave, waveNames, WAVE_SHAPES);
+  if( (shape <= WAVE_NONE) || !parseValues(equal + 1, values, maxValues, 4) || 
+      (values[2] < WAVE_MIN_PERIOD) )
+    return false;
+
+  settings.shape = (uint8_t)shape;
+  settings.amplitude = (uint8_t)values[0];
+  settings.offset = (uint8_t)values[1];
+  settings.period = (uint16_t)values[2];
+  settings.phase = (uint16_t)values[3];
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if((motor.currentPWM == 0) || (motor.currentPWM == (j + 1)))
+      waveform.set(j, settings);
+  }
+  return true;
+}
+
+/**
+ * Parse the soak test cycle in the format run,rest,cycles,report
+ * e.g. "2000,1000,500,60"
+ * 
+ * \param cycle The cycle string, without the command prefix
+ * \return true if the cycle is valid and has been applied
+ */
+boolean parseSoakCycle(const char* cycle) {
+  static const unsigned long maxValues[4] = { SOAK_MAX_TIME, SOAK_MAX_TIME, SOAK_MAX_CYCLES, SOAK_MAX_REPORT };
+  unsigned long values[4];
+
+  if(!parseValues(cycle, values, maxValues, 4))
+    return false;
+
+  soak.runTime = (uint16_t)values[0];
+  soak.restTime = (uint16_t)values[1];
+  soak.maxCycles = values[2];
+  soak.reportTime = (uint16_t)values[3];
+  return true;
+}
+
+/**
+ * Parse a list of numbers separated by VALUES_SEPARATOR
+ * 
+ * \param text The list of numbers
+ * \param values The parsed numbers
+ * \param maxValues The max value of every number
+ * \param count The number of values in the list
+ * \return true if the list has exactly count valid numbers
+ */
+boolean parseValues(const char* text, unsigned long* values, const unsigned long* maxValues, int count) {
+  char buffer[CMD_BUFFER_SIZE];
+  char* value;
+  char* next;
+  int j;
+
+  strncpy(buffer, text, CMD_BUFFER_SIZE - 1);
+  buffer[CMD_BUFFER_SIZE - 1] = '\0';
+  value = buffer;
+  for(j = 0; j < count; j++) {
+    next = strchr(value, VALUES_SEPARATOR);
+    if( (next == NULL) != (j == (count - 1)) )
+      return false;
+    if(next != NULL)
+      *next++ = '\0';
+    if(!parseNumber(value, maxValues[j], values[j]))
+      return false;
+    value = next;
+  }
+
+  return true;
+}
+
+/**
+ * Parse a profile number, a single digit
+ * 
+ * \param profile The profile string
+ * \return The profile number, NO_PROFILE if not valid
+ */
+int parseProfileNumber(const char* profile) {
+  if( isdigit(profile[0]) && ((profile[1] == '\0') || (profile[1] == '-')) && 
+      ((profile[0] - '0') < PROFILES) )
+    return profile[0] - '0';
+  else
+    return NO_PROFILE;
+}
+
+/**
+ * Parse a profile selection, the profile number or name
+ * 
+ * \param profile The profile string, without the command prefix
+ * \return The profile number, NO_PROFILE if not valid or not found
+ */
+int parseProfile(const char* profile) {
+  if(isdigit(profile[0]) && (profile[1] == '\0'))
+    return parseProfileNumber(profile);
+  else
+    return motor.findProfile(profile);
+}
+
+/**
+ * Save the current settings as a profile in the format number[-name], e.g. "2-slow"
+ * 
+ * \param profile The profile string, without the command prefix
+ * \return true if the profile string is valid and the profile has been saved
+ */
+boolean parseSaveProfile(const char* profile) {
+  int number;
+
+  number = parseProfileNumber(profile);
+  if(number == NO_PROFILE)
+    return false;
+
+  if(profile[1] == '-')
+    motor.saveProfile(number, profile + 2);
+  else
+    motor.saveProfile(number, "");
+  return true;
+}
+
+/**
+ * Show the saved profiles
+ */
+void showProfiles(void) {
+  int j;
+  profileRecord record;
+
+  Serial << F(INFO_PROFILE_TITLE) << endl;
+  for(j = 0; j < PROFILES; j++) {
+    Serial << j << F(" ");
+    if(motor.readProfile(j, record))
+      Serial << record.name;
+    else
+      Serial << F(INFO_PROFILE_EMPTY);
+    if(j == motor.activeProfile)
+      Serial << F(INFO_PROFILE_ACTIVE);
+    Serial << endl;
+  }
+}
+
+/**
+ * Show the requested duty cycle of the enabled motors, the allocated PWM
+ * channel and the duty cycle error
+ */
+void showAllocation(void) {
+  int j;
+
+  Serial << F(INFO_ALLOC_TITLE) << endl;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(!motor.internalStatus[j].isEnabled)
+      continue;
+    Serial << F("M") << (j + 1) << F(INFO_ALLOC_TARGET) << motor.internalStatus[j].targetDC << 
+              F(INFO_ALLOC_CHANNEL) << motor.internalStatus[j].channelPWM;
+    if(motor.internalStatus[j].channelPWM != tle94112.TLE_NOPWM)
+      Serial << F(INFO_ALLOC_DC) << motor.dutyCyclePWM[motor.internalStatus[j].channelPWM - 1].maxDC;
+    Serial << F(INFO_ALLOC_ERROR) << motor.motorDCError(j) << endl;
+  }
+}
+
+/**
+ * Show the speed control gains and the status of the control loops
+ */
+void showSpeedInfo(void) {
+  int j;
+
+  Serial << F(INFO_SPEED_TITLE) << speed.kp << F(INFO_SPEED_KI) << speed.ki << 
+            F(INFO_SPEED_LATE) << speed.lateTicks << endl;
+  for(j = 0; j < SPEED_INPUTS; j++) {
+    if(speed.loops[j].motor == NO_MOTOR)
+      continue;
+    Serial << F("M") << (speed.loops[j].motor + 1) << F(INFO_SPEED_PIN) << speed.loops[j].pin << 
+              F(INFO_SPEED_TARGET) << speed.loops[j].target << F(INFO_SPEED_SPEED) << speed.loops[j].speed <<
+              F(INFO_SPEED_DC) << speed.loops[j].dc << endl;
+  }
+}
+
+/**
+ * Notify the start of a timed move and align the display
+ * 
+ * \param started The move has been started
+ * \param cmd The command string
+ */
+void startMove(boolean started, const char* cmd) {
+  if(!started) {
+    serialError(F(CMD_NOMOVE), cmd);
+    return;
+  }
+  serialMessage(F(CMD_EXEC), cmd);
+  lcdShowRunning();
+  isRunning = true;
+}
+
+/**
+ * Show the running timed move, or the duration and budget of the last one
+ */
+void showMoveInfo(void) {
+  int j;
+
+  if(timedMove.phase != MOVE_IDLE) {
+    Serial << F(INFO_MOVE_RUNNING);
+    for(j = 0; j < MAX_MOTORS; j++) {
+      if(timedMove.motors & (1 << j))
+        Serial << F("M") << (j + 1) << F(" ");
+    }
+    Serial << endl;
+  }
+  else
+    Serial << F(INFO_MOVE_IDLE) << endl;
+  Serial << F(INFO_MOVE_DURATION) << timedMove.lastDuration << F(INFO_MOVE_BUDGET) << 
+            timedMove.lastBudget << F(" ms") << endl;
+}
+
+/**
+ * Show the dithering period, the write rate and the setpoint of every
+ * PWM channel
+ */
+void showDitherInfo(void) {
+  int j;
+
+  Serial << F(INFO_DITHER_TITLE) << dither.period << F(INFO_DITHER_WRITES) << dither.writes << 
+            F(INFO_DITHER_RATE) << dither.writeRate << F("/s") << endl;
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    Serial << F("PWM") << (j + 1) << F(" ");
+    if(dither.channels & (1 << j))
+      Serial << dither.setpoint[j] << F("/") << DITHER_SCALE << endl;
+    else
+      Serial << F(INFO_DITHER_OFF) << endl;
+  }
+}
+
+/**
+ * Show the soak test summary on a single line: the completed and aborted
+ * cycles, the cycles every minute, the min/avg/max cycle time and the
+ * faults of every class since the start of the test
+ */
+void showSoakSummary(void) {
+  int j;
+
+  Serial << F(INFO_SOAK_TITLE) << (soak.phase != SOAK_IDLE ? F(INFO_SOAK_RUNNING) : F(INFO_SOAK_STOPPED)) <<
+            F(INFO_SOAK_CYCLES) << soak.cycles << F(INFO_SOAK_ABORTED) << soak.aborted << 
+            F(INFO_SOAK_CPM) << soak.cyclesPerMinute() << F(INFO_SOAK_TIMES) << soak.minCycle << F("/") << 
+            (soak.cycles > 0 ? soak.totalTime / soak.cycles : 0) << F("/") << soak.maxCycle << F(INFO_SOAK_FAULTS);
+  for(j = 0; j < FAULT_CLASSES; j++) {
+    if(j > 0)
+      Serial << F(",");
+    Serial << soak.faults(motor, j);
+  }
+  Serial << endl;
+}
+
+/**
+ * Show the waveform of every PWM channel
+ */
+void showWaveInfo(void) {
+  int j;
+
+  Serial << F(INFO_WAVE_TITLE) << waveform.writes << endl;
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    Serial << F("PWM") << (j + 1) << F(" ");
+    if(waveform.waves[j].shape == WAVE_NONE) {
+      Serial << F(INFO_WAVE_OFF) << endl;
+      continue;
+    }
+    Serial << (const __FlashStringHelper*)pgm_read_ptr(&waveNames[waveform.waves[j].shape]) << 
+              F(" ") << waveform.waves[j].amplitude << F(",") << waveform.waves[j].offset << 
+              F(",") << waveform.waves[j].period << F(",") << waveform.waves[j].phase << endl;
+  }
+}
+
+/**
+ * Show the power budget, the demand of the running motors and the weight
+ * of every motor
+ */
+void showPowerInfo(void) {
+  int j;
+
+  Serial << F(INFO_POWER_TITLE) << motor.powerBudget << F(INFO_POWER_DEMAND) << motor.powerDemand << 
+            F(INFO_POWER_FACTOR) << motor.budgetFactor << F("%") << F(INFO_POWER_LIMITS) << 
+            motor.budgetLimits << endl;
+  Serial << F(INFO_POWER_WEIGHTS);
+  for(j = 0; j < MAX_MOTORS; j++) {
+    Serial << F(" ") << motor.internalStatus[j].powerWeight;
+  }
+  Serial << endl;
+}
+
+/**
+ * Show the fault reactions, the fault counters and the reaction times
+ */
+void showFaultInfo(void) {
+  int j;
+
+  Serial << F(INFO_FAULT_TITLE) << endl;
+  for(j = 0; j < FAULT_CLASSES; j++) {
+    Serial << (const __FlashStringHelper*)pgm_read_ptr(&faultNames[j]) << F("=") <<
+              (const __FlashStringHelper*)pgm_read_ptr(&faultActions[motor.faultPolicy[j].action]);
+    if(motor.faultPolicy[j].action == FAULT_RETRY)
+      Serial << motor.faultPolicy[j].retryDelay;
+    Serial << F(INFO_FAULT_FILTER) << motor.faultPolicy[j].samples << F(",") << 
+              motor.faultPolicy[j].rampWindow << F(",") << motor.faultPolicy[j].rateLimit;
+    Serial << F(" count ") << motor.faultCount[j] << F(INFO_FAULT_FILTERED) << motor.faultFiltered[j] << 
+              F(INFO_FAULT_MUTED) << motor.faultMuted[j] << endl;
+  }
+  Serial << F(INFO_FAULT_STOPS) << motor.faultStopCount << 
+            F(INFO_FAULT_RETRIES) << motor.faultRetryCount << 
+            F(INFO_FAULT_GIVEUPS) << motor.faultRetryFailures << endl;
+  Serial << F(INFO_FAULT_TIME) << motor.faultReactionTime << 
+            F(INFO_FAULT_MAXTIME) << motor.maxFaultReactionTime << F(" us") << endl;
+  Serial << F(INFO_FAULT_DERATE) << motor.derateFactor << F("%") << endl;
+}
+
+/**
+ * Parse the half bridges assigned to the selected motor and apply them
+ * to the motor layout. The format is A[+A]/B[+B] where A and B are the half
+ * bridges numbers (1-12) of the two poles, e.g. "1/2" or "1+2/3+4"
+ * 
+ * \param layout The layout string, without the command prefix
+ * \return true if the layout is valid and has been applied
+ */
+boolean parseMotorLayout(const char* layout) {
+  uint8_t poles[2][MAX_POLE_HB];
+  int pole, hb, digits;
+  uint8_t value;
+  char c;
+
+  if(motor.currentMotor == 0)
+    return false;
+
+  memset(poles, HB_NONE, sizeof(poles));
+  pole = hb = digits = 0;
+  value = 0;
+
+  do {
+    c = *layout++;
+    if(isdigit(c)) {
+      // Half bridges numbers have max two digits
+      if(++digits > 2)
+        return false;
+      value = value * 10 + (c - '0');
+    }
+    else {
+      if(digits == 0)
+        return false;
+      poles[pole][hb] = value;
+      value = 0;
+      digits = 0;
+      if(c == '+') {
+        if(++hb >= MAX_POLE_HB)
+          return false;
+      }
+      else if(c == '/') {
+        if(pole > 0)
+          return false;
+        pole = 1;
+        hb = 0;
+      }
+      else if(c != '\0')
+        return false;
+    }
+  } while(c != '\0');
+
+  // Both the poles should be set
+  if(pole == 0)
+    return false;
+
+  return motor.setMotorLayout(motor.currentMotor - 1, poles[0], poles[1]);
+}
+
 // ***********************************************************
 // LCD Dispay manager methods
 // ***********************************************************
 
+//! PWM channel names shown when setting the duty cycle
+const char pwmChannelNames[][7] PROGMEM = { "  80Hz", " 100Hz", " 200Hz", "  2kHz" };
+//! PWM channel names shown in the motor settings
+const char motorPWMNames[][6] PROGMEM = { " No", " 80Hz", "100Hz", "200Hz", " 2kHz" };
+
+/**
+ * Name of the PWM frequency of a motor
+ * 
+ * \param motorID the motor (base 0)
+ * \return the index in motorPWMNames
+ */
+int motorPWMName(int motorID) {
+  if(motor.internalStatus[motorID].channelPWM == tle94112.TLE_NOPWM)
+    return 0;
+  return motor.dutyCyclePWM[motor.internalStatus[motorID].channelPWM - 1].frequency;
+}
+
 //! Show the reset introductory message
 void lcdIntroMessage() {
   lcd.clear();
   lcd.setCursor(0, 0);
-  lcd.print(L_APP_NAME1);
+  lcd.print(F(L_APP_NAME1));
   lcd.setCursor(0, 1);
-  lcd.print(L_APP_NAME2);
+  lcd.print(F(L_APP_NAME2));
   delay(3000);
   lcd.clear();
 }
@@ -506,6 +1797,11 @@ void lcdIntroMessage() {
  * only show the setting display mode
  */
 void showMotorSetting() {
+  // A batch updates the LCD once at the end
+  if(batchMode) {
+    lcdPending = true;
+    return;
+  }
   lcd.clear();
   lcdShowMotor();
   lcdShowMotorPWM();
@@ -518,6 +1814,11 @@ void showMotorSetting() {
  * else only show the setting display mode
  */
 void showPWMSetting() {
+  // A batch updates the LCD once at the end
+  if(batchMode) {
+    lcdPending = true;
+    return;
+  }
   lcd.clear();
   lcdShowPWM();
 }
@@ -525,111 +1826,109 @@ void showPWMSetting() {
 //! Show setting mode of current motor (or all)
 void lcdShowMotor() {
   lcd.setCursor(0, 0);
-  lcd << "M";
+  lcd << F("M");
   // Show the current motor settings
   if(motor.currentMotor > 0) {
     lcd << motor.currentMotor;
     // Check if motor is enabled
     if(motor.internalStatus[motor.currentMotor - 1].isEnabled)
-      lcd << " ena"; // motor is enabled
+      lcd << F(" ena"); // motor is enabled
     else
-      lcd << " dis"; // Motor is disabled
+      lcd << F(" dis"); // Motor is disabled
   }
   else {
     // Check if motor is enabled
     if(motor.internalStatus[0].isEnabled)
-      lcd << "* ena"; // motor is enabled
+      lcd << F("* ena"); // motor is enabled
     else
-      lcd << "* dis"; // Motor is disabled
+      lcd << F("* dis"); // Motor is disabled
   }
 }
 
 //! Show setting mode of current PWM channel (or all)
 void lcdShowPWM() {
-  String pwmNames[] = { "  80Hz", " 100Hz", " 200Hz" };
 
   lcd.setCursor(0, 0);
-  lcd << "Set PWM[";
+  lcd << F("Set PWM[");
   // Show the current motor settings
   if(motor.currentPWM > 0) {
-    lcd << motor.currentPWM << "]" << pwmNames[motor.currentPWM - 1];
+    lcd << motor.currentPWM << F("]") << (const __FlashStringHelper*)pwmChannelNames[motor.dutyCyclePWM[motor.currentPWM - 1].frequency - 1];
   }
   else {
-      lcd << "*] All";
+      lcd << F("*] All");
   }
 }
 
 //! Show setting mode of current PWM channel (or all)
 void lcdShowMotorPWM() {
-  String pwmNames[] = { " No", " 80Hz", "100Hz", "200Hz" };
   lcd.setCursor(7, 0);
   if(motor.currentMotor > 0)
-    lcd << "PWM " << pwmNames[motor.internalStatus[motor.currentMotor - 1].channelPWM];
+    lcd << F("PWM ") << (const __FlashStringHelper*)motorPWMNames[motorPWMName(motor.currentMotor - 1)];
   else
-    lcd << "PWM " << pwmNames[motor.internalStatus[0].channelPWM];
+    lcd << F("PWM ") << (const __FlashStringHelper*)motorPWMNames[motorPWMName(0)];
 }
 
 //! Show the manual duty cycle setting
 void lcdShowDutyCycleManual() {
   lcd.setCursor(0, 1);
-  lcd << "Duty Cyc. manual";
+  lcd << F("Duty Cyc. manual");
 }
 
 //! Set duty cycle min value from analog input
 void lcdShowDutyCycleMin() {
   lcd.setCursor(0, 1);
-  lcd << "DC min =";
+  lcd << F("DC min =");
   if(inputAnalogDC < 100)
-    lcd.print(" ");
+    lcd.print(F(" "));
   lcd << inputAnalogDC;
 }
 
 //! Set duty cycle min value from analog input
 void lcdShowDutyCycleValue() {
   lcd.setCursor(0, 1);
-  lcd << "DutyCycle =";
+  lcd << F("DutyCycle =");
   if(inputAnalogDC < 100)
-    lcd.print(" ");
+    lcd.print(F(" "));
   lcd << inputAnalogDC;
 }
 
 //! Set duty cycle Max value from analog input
 void lcdShowDutyCycleMax() {
   lcd.setCursor(0, 1);
-  lcd << "DC Max =";
+  lcd << F("DC Max =");
   if(inputAnalogDC < 100)
-    lcd.print(" ");
+    lcd.print(F(" "));
   lcd << inputAnalogDC;
 }
 
 //! Show the default duty cycle automatic range
 void lcdShowDutyCycleAuto() {
+  if(batchMode)
+    return;
   lcd.setCursor(0, 1);
-  lcd << "DutyCyc. " << motor.dutyCyclePWM[motor.currentPWM - 1].minDC << 
+  lcd << F("DutyCyc. ") << motor.dutyCyclePWM[motor.currentPWM - 1].minDC << 
       "-" << motor.dutyCyclePWM[motor.currentPWM - 1].maxDC;
 }
 
 //! Show the duty cycle values for the selected PWM channel
 void showPWMInfo() {
-  String pwmNames[] = { "  80Hz", " 100Hz", " 200Hz" };
-
   lcd.clear();
   lcd.setCursor(0, 0);
-  lcd << "PWM[";
+  lcd << F("PWM[");
   // Show the current motor settings
   if(motor.currentPWM > 0) {
-    lcd << motor.currentPWM << "]" << pwmNames[motor.currentPWM - 1];
+    lcd << motor.currentPWM << F("]") << (const __FlashStringHelper*)pwmChannelNames[motor.dutyCyclePWM[motor.currentPWM - 1].frequency - 1];
     lcd.setCursor(0, 1);
-    lcd << "DutyCyc. ";
+    lcd << F("DutyCyc. ");
     if(motor.dutyCyclePWM[motor.currentPWM - 1].manDC)
-      lcd << " manual";
+      lcd << F(" manual");
     else
-      lcd << motor.dutyCyclePWM[motor.currentPWM - 1].minDC << "-" << motor.dutyCyclePWM[motor.currentPWM - 1].maxDC;
+      lcd << motor.dutyCyclePWM[motor.currentPWM - 1].minDC << F("-") << motor.dutyCyclePWM[motor.currentPWM - 1].maxDC;
   }
   else {
-      lcd << "*] None";
+      lcd << F("*] None");
       lcd.setCursor(0, 1);
-      lcd << "Select a PWM";
+      lcd << F("Select a PWM");
   }
 }
 
@@ -637,6 +1936,8 @@ void showPWMInfo() {
 void lcdShowPWMRamp() {
   boolean ramp;
   
+  if(batchMode)
+    return;
   if(motor.currentPWM > 0)
     ramp = motor.dutyCyclePWM[motor.currentPWM - 1].useRamp;
   else
@@ -644,9 +1945,9 @@ void lcdShowPWMRamp() {
 
   lcd.setCursor(0, 1);
   if(ramp)
-    lcd << "Ramp start/stop";
+    lcd << F("Ramp start/stop");
   else
-    lcd << "Inst. start/stop";
+    lcd << F("Inst. start/stop");
 }
 
 
@@ -660,11 +1961,11 @@ void lcdShowFreeWheeling() {
     fw = motor.internalStatus[0].freeWheeling;
 
   lcd.setCursor(0, 1);
-  lcd << "FreeWh."; 
+  lcd << F("FreeWh."); 
   if(fw)
-    lcd << "+";
+    lcd << F("+");
   else
-    lcd << "-";
+    lcd << F("-");
 }
 
 //! Show the rotatin direction of the motor
@@ -677,60 +1978,68 @@ void lcdShowDirection() {
     dir = motor.internalStatus[0].motorDirection;
 
   lcd.setCursor(9, 1);
-  lcd << "Dir.";
+  lcd << F("Dir.");
   if(dir == MOTOR_DIRECTION_CW)
-    lcd << " CW";
+    lcd << F(" CW");
   else
-    lcd << "CCW";
+    lcd << F("CCW");
 }
 
 //! Show the starting state
 void lcdShowStarting() {
   lcd.clear();
   lcd.setCursor(0, 0);
-  lcd << TLE_MOTOR_STARTING;
+  lcd << F(TLE_MOTOR_STARTING);
 }
 
 //! Show the stopping state
 void lcdShowStopping() {
   lcd.clear();
   lcd.setCursor(0, 0);
-  lcd << TLE_MOTOR_STOPPING;
+  lcd << F(TLE_MOTOR_STOPPING);
 }
 
 //! Show the running state
 void lcdShowRunning() {
+  lcdPending = false;
   lcd.clear();
   lcd.setCursor(0, 0);
-  lcd << TLE_MOTOR_RUN;
+  lcd << F(TLE_MOTOR_RUN);
 }
 
 //! Show the halt state
 void lcdShowHalted() {
+  lcdPending = false;
   lcd.clear();
   lcd.setCursor(0, 0);
-  lcd << TLE_MOTOR_HALT;
+  lcd << F(TLE_MOTOR_HALT);
 }
 
-//! Show the error star
+//! Clear the error star
 void lcdClearError() {
   lcd.setCursor(0, 15);
-  lcd << " ";
+  lcd << F(" ");
+  errorTime = 0;
 }
 
-//! Show the error star
+//! Show the error star, cleared by the main loop after ERROR_SHOW_TIME
 void lcdShowError() {
   lcd.setCursor(0, 15);
-  lcd << "*";
-  delay(100);
+  lcd << F("*");
+  // Never 0, that means not shown
+  errorTime = millis() | 1;
 }
 
-//! Update the running animation on the LCD
+//! Update the running animation on the LCD once every RUNNING_STEP ms, 
+//! without waiting so that the control tick is not delayed
 void lcdRunningAnim() {
+  if((millis() - runningTime) < RUNNING_STEP)
+    return;
+
+  runningTime = millis();
   lcd.setCursor(15,0);
   lcd << runningFrames[runningFrame++];
   if(runningFrame > 3)
     runningFrame = 0;
-  delay(100);
 }
 
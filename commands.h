@@ -24,6 +24,29 @@
 #define CMD_DIRECTION "Direction "
 #define CMD_PWM "PWM: "
 #define CMD_WRONGCMD "wrong command "
+#define CMD_NOCONFIG "no saved configuration "
+#define CMD_NOPROFILE "no saved profile "
+#define CMD_BADSEQUENCE "invalid sequence "
+#define CMD_NOMOVE "no motors to move "
+#define CMD_CONFIG_LOADED "Saved configuration loaded"
+#define CMD_BATCH "batch "
+#define CMD_BATCH_ROLLBACK " settings restored"
+#define CMD_BATCH_INVALID " invalid"
+#define CMD_TAG "#"
+#define CMD_TAG_DONE " done "
+#define CMD_TAG_FAILED " failed "
+
+// Command tag, e.g. #12 m1+. The tagged commands are followed by the reply
+// #tag done|failed <received> <dispatched> <applied>, times in us
+#define COMMAND_TAG_PREFIX '#'  ///< First character of a tagged command line
+#define COMMAND_TAG_MAX 0xffff  ///< Max tag value
+
+// Batch of commands on one line, e.g. m1+;cw;80;start
+#define BATCH_SEPARATOR ';'     ///< Separator of the commands
+#define BATCH_MAX_COMMANDS 16   ///< Max commands in a batch
+#define BATCH_DONE '+'          ///< Status of an executed command
+#define BATCH_FAILED '-'        ///< Status of a refused command
+#define BATCH_SKIPPED '.'       ///< Status of a command not executed
 
 // Direction control
 #define DIRECTION_CW "cw"     ///< clockwise rotation
@@ -41,13 +64,18 @@
 #define MAX_DC "dcmax"          ///< Set the max duty cycle value via pot
 #define INFO_DC "dcinfo"        ///< Set the current duty cycle values
 
+// Duty cycle of the selected motor, the PWM channels are allocated automatically
+#define MOTOR_DC "mdc"            ///< Set the motor duty cycle, e.g. mdc128
+#define MOTOR_DC_INFO "mdcinfo"   ///< Show the PWM channels allocation
+
 // PWM channel selection for duty cycle settings
-#define PWM80_DC "dc80"         ///< Set the duty cycle to the PWM channel 80Hz
-#define PWM100_DC "dc100"       ///< Set the duty cycle to the PWM channel 100Hz
-#define PWM200_DC "dc200"       ///< Set the duty cycle to the PWM channel 200Hz
+#define PWM80_DC "dc80"         ///< Set the duty cycle to the PWM channel 1 (80Hz by default)
+#define PWM100_DC "dc100"       ///< Set the duty cycle to the PWM channel 2 (100Hz by default)
+#define PWM200_DC "dc200"       ///< Set the duty cycle to the PWM channel 3 (200Hz by default)
 #define PWMALL_DC "dcPWM"       ///< Set the duty cycle to the all the PWM channels
 #define PWM_RAMP "accel"        ///< Enable the acceleration
 #define PWM_NORAMP "noaccel"    ///< Disable the acceleration
+#define PWM_FREQUENCY "hz"      ///< Set the frequency (80, 100, 200 or 2000 Hz), e.g. hz2000
 
 // Motor select flag for settings
 #define MOTOR_ALL "all"     ///< All motors selected and enabled
@@ -69,15 +97,155 @@
 
 // PWM Frequency selector (assign PWM channels to motors)
 #define PWM_0    "noPWM"  ///< No PWM
-#define PWM_80   "80"     ///< PWM 80 Hz
-#define PWM_100  "100"    ///<PWM 100 Hz
-#define PWM_200  "200"    ///< PWM 200 Hz
+#define PWM_80   "80"     ///< PWM channel 1 (80 Hz by default)
+#define PWM_100  "100"    ///< PWM channel 2 (100 Hz by default)
+#define PWM_200  "200"    ///< PWM channel 3 (200 Hz by default)
 
 // Freewheeling mode motor(s) setting
 #define FW_ACTIVE "fwactive"    ///< Fereewheeling active
 #define FW_PASSIVE "fwpassive"  ///< Freewheeling passive
 
+// Stop mode motor(s) setting
+#define STOP_MODE_COAST "coast"     ///< Float the poles on stop
+#define STOP_MODE_BRAKE "brake"     ///< Brake on stop, brakeN to float after N ms
+
+// Half bridges layout (wiring of the motors to the TLE94112 half bridges)
+#define HB_STANDARD "hbstd"     ///< 6 motors, one half bridge every pole
+#define HB_HIGHCURRENT "hbhigh" ///< 3 motors, two half bridges every pole
+#define HB_REMOVE "hb-"         ///< Remove the half bridges from the selected motor
+#define HB_LAYOUT "hb"          ///< hbA/B or hbA+A/B+B set the half bridges of the selected motor
+
+// Fault reactions: fault-<class>=<action>, e.g. fault-uv=stopall or fault-tsd=retry500
+#define FAULT_INFO "fault"        ///< Show the fault reactions and counters
+#define FAULT_DEFAULT "faultreset"  ///< Restore the default fault reactions and filters
+#define FAULT_SET "fault-"        ///< Set the reaction of a fault class
+
+// Diagnostic filters: filter-<class>=<samples>,<ramp window>,<rate limit>, e.g.
+// filter-load=3,50,1000 (times in ms)
+#define FAULT_FILTER "filter-"    ///< Set the diagnostic filter of a fault class
+
+#define VALUES_SEPARATOR ','      ///< Separator of the values of a command
+
+// Fault classes
+#define FAULT_NAME_SPI "spi"      ///< SPI communication error
+#define FAULT_NAME_LOAD "load"    ///< Open load
+#define FAULT_NAME_UV "uv"        ///< Under voltage
+#define FAULT_NAME_OV "ov"        ///< Over voltage
+#define FAULT_NAME_POR "por"      ///< Power on reset
+#define FAULT_NAME_TSD "tsd"      ///< Temperature shutdown
+#define FAULT_NAME_TW "twarn"     ///< Temperature warning
+
+// Fault reactions
+#define FAULT_ACTION_IGNORE "ignore"    ///< Clear the fault silently
+#define FAULT_ACTION_LOG "log"          ///< Notify the fault
+#define FAULT_ACTION_DERATE "derate"    ///< Reduce the duty cycle
+#define FAULT_ACTION_STOP "stop"        ///< Stop the faulty motor
+#define FAULT_ACTION_STOPALL "stopall"  ///< Stop all motors
+#define FAULT_ACTION_RETRY "retry"      ///< Stop all motors and restart after a delay (ms)
+
+// Binary telemetry frames
+#define TELEMETRY_ON "tlmon"      ///< Start sending the telemetry frames
+#define TELEMETRY_OFF "tlmoff"    ///< Stop sending the telemetry frames
+#define TELEMETRY_INFO "tlminfo"  ///< Show the sent and dropped frames
+#define TELEMETRY_RATE "tlm"      ///< tlmN set the time between two frames (ms)
+
+// Flight recorder of settings, diagnostics and commands
+#define TRACE_DUMP "trace"        ///< Dump the recorded events
+#define TRACE_CLEAR "traceclear"  ///< Clear the recorder and restart recording
+#define TRACE_STOP "tracestop"    ///< Freeze the recorder
+
+// Closed loop speed control of the selected motor
+#define SPEED_TACH "tach"         ///< Connect the tachometer pin, e.g. tach3
+#define SPEED_NOTACH "tach-"      ///< Disconnect the tachometer
+#define SPEED_TARGET "spd"        ///< Target speed (pulses/s), spd0 for open loop
+#define SPEED_KP_GAIN "kp"        ///< Proportional gain (1/256 units)
+#define SPEED_KI_GAIN "ki"        ///< Integral gain (1/256 units)
+#define SPEED_INFO "spdinfo"      ///< Show the speed control loops
+
+// Motion sequence
+#define SEQUENCE_APPEND "seq+"        ///< Add the hex bytes to the sequence program
+#define SEQUENCE_CLEAR "seqclear"     ///< Clear the sequence program
+#define SEQUENCE_RUN "seqrun"         ///< Run the sequence from the beginning
+#define SEQUENCE_STOP "seqstop"       ///< Stop the sequence, the motors keep their state
+#define SEQUENCE_INFO "seqinfo"       ///< Show the sequence status and timing
+
+// Low power idle
+#define IDLE_TIME "idle"          ///< Time (s) without activity before sleeping, idle0 to never sleep
+#define IDLE_INFO "idleinfo"      ///< Show the sleeps and the wake up latency
+
+// Control tick
+#define TICK_INFO "tickinfo"      ///< Show the control tick overruns and jitter
+#define TICK_RESET "tickreset"    ///< Reset the control tick statistics
+
+// Sigma-delta dithering of the selected PWM channel (all the channels with dcPWM)
+#define DITHER_SET "dith"         ///< Dither to a setpoint (duty cycle * 256), e.g. dith2600
+#define DITHER_OFF "dithoff"      ///< Stop dithering
+#define DITHER_PERIOD "dithp"     ///< Control ticks between two updates, e.g. dithp4
+#define DITHER_INFO "dithinfo"    ///< Show the setpoints and the write rate
+
+// Waveform of the selected PWM channel (all the channels with dcPWM):
+// wave-<shape>=<amplitude>,<offset>,<period>,<phase>, e.g. wave-sine=100,128,2000,90
+// (period in ms, phase in degrees)
+#define WAVE_SET "wave-"          ///< Set the waveform
+#define WAVE_OFF "waveoff"        ///< Stop the waveform
+#define WAVE_INFO "waveinfo"      ///< Show the waveforms
+
+// Waveform shapes
+#define WAVE_NAME_SINE "sine"     ///< Sine
+#define WAVE_NAME_TRIANGLE "tri"  ///< Triangle
+#define WAVE_NAME_SQUARE "square" ///< Square
+
+// Soak test of the enabled motors: soak-<run>,<rest>,<cycles>,<report>, e.g.
+// soak-2000,1000,500,60 (times in ms, report in s, 0 cycles = until stopped)
+#define SOAK_SET "soak-"          ///< Set the soak test cycle
+#define SOAK_START "soakon"       ///< Start the soak test
+#define SOAK_STOP "soakoff"       ///< Stop the soak test and the motors
+#define SOAK_INFO "soakinfo"      ///< Show the soak test summary
+
+// Power budget of the running motors
+#define POWER_BUDGET "budget"     ///< Set the power budget, budget0 to not limit the duty cycle
+#define POWER_WEIGHT "weight"     ///< Set the weight of the selected motor, e.g. weight25
+#define POWER_INFO "budgetinfo"   ///< Show the power demand, the budget factor and the weights
+
+// Timed moves of the selected motor, all the enabled motors if none is selected
+#define MOVE_TIME "run"           ///< Run for a time (ms), e.g. run1500
+#define MOVE_BUDGET "runb"        ///< Run until a duty cycle budget (ms at max duty cycle) is consumed
+#define MOVE_INFO "runinfo"       ///< Show the last move duration and budget
+
+// Configuration persistence in EEPROM
+#define CONFIG_SAVE "save"                ///< Save motors, PWM, layout, fault and budget settings
+#define CONFIG_LOAD "load"                ///< Restore the saved settings
+#define CONFIG_AUTOSTART "autostart"      ///< Start the motors on power up (effective after save)
+#define CONFIG_NOAUTOSTART "noautostart"  ///< Don't start the motors on power up
+
+// Configuration profiles
+#define PROFILE_SAVE "psave-"   ///< Save the motors and PWM settings as profile number-name
+#define PROFILE_SELECT "prof-"  ///< Switch to the profile number or name
+#define PROFILE_LIST "plist"    ///< List the saved profiles
+
 // Configuration command
 #define SHOW_CONF "conf"    ///< Dump the current settings
 
+// Command keywords recorded by the flight recorder, separated by a space: the
+// event has the index of the longest keyword the command starts with, so the
+// new keywords should be added at the end to not change the recorded indexes
+#define COMMAND_KEYWORDS DIRECTION_CW " " DIRECTION_CCW " " MOTOR_START " " MOTOR_STOP " " \
+  MOTOR_RESET " " MANUAL_DC " " AUTO_DC " " MIN_DC " " MAX_DC " " INFO_DC " " MOTOR_DC " " \
+  MOTOR_DC_INFO " " PWM80_DC " " PWM100_DC " " PWM200_DC " " PWMALL_DC " " PWM_RAMP " " \
+  PWM_NORAMP " " PWM_FREQUENCY " " MOTOR_ALL " " MOTOR_NONE " " MOTOR_1 " " MOTOR_2 " " \
+  MOTOR_3 " " MOTOR_4 " " MOTOR_5 " " MOTOR_6 " " EN_MOTOR_1 " " EN_MOTOR_2 " " EN_MOTOR_3 " " \
+  EN_MOTOR_4 " " EN_MOTOR_5 " " EN_MOTOR_6 " " PWM_0 " " PWM_80 " " PWM_100 " " PWM_200 " " \
+  FW_ACTIVE " " FW_PASSIVE " " STOP_MODE_COAST " " STOP_MODE_BRAKE " " HB_STANDARD " " \
+  HB_HIGHCURRENT " " HB_REMOVE " " HB_LAYOUT " " FAULT_INFO " " FAULT_DEFAULT " " FAULT_SET " " \
+  FAULT_FILTER " " TELEMETRY_ON " " TELEMETRY_OFF " " TELEMETRY_INFO " " TELEMETRY_RATE " " \
+  TRACE_DUMP " " TRACE_CLEAR " " TRACE_STOP " " SPEED_TACH " " SPEED_NOTACH " " SPEED_TARGET " " \
+  SPEED_KP_GAIN " " SPEED_KI_GAIN " " SPEED_INFO " " SEQUENCE_APPEND " " SEQUENCE_CLEAR " " \
+  SEQUENCE_RUN " " SEQUENCE_STOP " " SEQUENCE_INFO " " IDLE_TIME " " IDLE_INFO " " TICK_INFO " " \
+  TICK_RESET " " DITHER_SET " " DITHER_OFF " " DITHER_PERIOD " " DITHER_INFO " " WAVE_SET " " \
+  WAVE_OFF " " WAVE_INFO " " SOAK_SET " " SOAK_START " " SOAK_STOP " " SOAK_INFO " " \
+  POWER_BUDGET " " POWER_WEIGHT " " POWER_INFO " " MOVE_TIME " " MOVE_BUDGET " " MOVE_INFO " " \
+  CONFIG_SAVE " " CONFIG_LOAD " " CONFIG_AUTOSTART " " CONFIG_NOAUTOSTART " " PROFILE_SAVE " " \
+  PROFILE_SELECT " " PROFILE_LIST " " SHOW_CONF
+#define COMMAND_UNKNOWN 0xff    ///< Index of a command not starting with a keyword
+
 #endif
@@ -0,0 +1,103 @@
+/**
+ *  \file controltick.cpp
+ *  \brief This file defines functions and predefined instances from controltick.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "controltick.h"
+
+ControlTick controlTick;
+
+//! Ticks counted by the timer interrupt
+static volatile unsigned long tickCount;
+//! Time (us) of the last timer interrupt
+static volatile unsigned long tickTime;
+
+//! Timer 2 compare match, once every tick
+ISR(TIMER2_COMPA_vect) {
+  tickCount++;
+  tickTime = micros();
+}
+
+void ControlTick::begin(void) {
+  noInterrupts();
+  tickCount = 0;
+  // CTC mode, clock / TICK_PRESCALER
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22);
+  OCR2A = (F_CPU / TICK_PRESCALER / TICK_FREQUENCY) - 1;
+  TCNT2 = 0;
+  TIMSK2 = _BV(OCIE2A);
+  interrupts();
+
+  lastTick = 0;
+  resetStats();
+}
+
+boolean ControlTick::due(void) {
+  unsigned long count, time, now, interval;
+
+  noInterrupts();
+  count = tickCount;
+  time = tickTime;
+  interrupts();
+
+  if(count == lastTick)
+    return false;
+
+  now = micros();
+  // The lost ticks are not executed
+  if((count - lastTick) > 1) {
+    overruns += count - lastTick - 1;
+  }
+  else if(serviceTime != 0) {
+    interval = now - serviceTime;
+    interval = (interval > TICK_PERIOD) ? (interval - TICK_PERIOD) : (TICK_PERIOD - interval);
+    if(interval > maxJitter)
+      maxJitter = interval;
+  }
+  if((now - time) > maxLatency)
+    maxLatency = now - time;
+
+  lastTick = count;
+  serviced++;
+  serviceTime = now;
+  return true;
+}
+
+unsigned long ControlTick::ticks(void) {
+  unsigned long count;
+
+  noInterrupts();
+  count = tickCount;
+  interrupts();
+
+  return count;
+}
+
+void ControlTick::waitTicks(unsigned long start, unsigned int count) {
+  while((ticks() - start) < count)
+    ;
+}
+
+void ControlTick::suspend(void) {
+  TIMSK2 &= ~_BV(OCIE2A);
+}
+
+void ControlTick::resume(void) {
+  TCNT2 = 0;
+  TIMSK2 |= _BV(OCIE2A);
+  lastTick = ticks();
+  serviceTime = 0;
+}
+
+void ControlTick::resetStats(void) {
+  serviced = overruns = maxJitter = maxLatency = 0;
+  // The jitter is measured again from the next tick
+  serviceTime = 0;
+}
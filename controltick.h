@@ -0,0 +1,98 @@
+/**
+ *  \file controltick.h
+ *  \brief Fixed rate control tick generated by a hardware timer
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _CONTROLTICK
+#define _CONTROLTICK
+
+#include <Arduino.h>
+
+#define TICK_FREQUENCY 1000   ///< Control tick frequency (Hz)
+#define TICK_PERIOD 1000      ///< Control tick period (us)
+#define TICK_PRESCALER 64     ///< Timer 2 prescaler
+
+/**
+ * \brief Control tick of the main loop
+ *
+ * The timer 2 interrupt counts the ticks at TICK_FREQUENCY and the main
+ * loop executes the timed work once every tick, so the ramps and the
+ * timed moves are updated at a fixed rate independently from the time
+ * spent in the SPI transfers. The ticks not executed because the main
+ * loop has been busy for more than a period are counted as overruns and
+ * are not recovered. The timer 2 can't be used by tone() or by
+ * analogWrite() on its pins (3 and 11 on the UNO, 9 and 10 on the MEGA).
+ */
+class ControlTick {
+  public:
+
+    //! Ticks executed by the main loop, the overruns are not included
+    unsigned long serviced;
+    //! Ticks lost because the main loop was late more than a period
+    unsigned long overruns;
+    //! Max difference (us) between the execution of two ticks and the period
+    unsigned long maxJitter;
+    //! Max delay (us) between the timer interrupt and the tick execution
+    unsigned long maxLatency;
+
+    /**
+     * \brief Start the timer and reset the statistics
+     */
+    void begin(void);
+
+    /**
+     * \brief Check if a tick should be executed, updating the statistics.
+     * Should be called once every main loop
+     *
+     * \return true if a tick has elapsed since the last call
+     */
+    boolean due(void);
+
+    /**
+     * \brief Number of ticks counted by the timer since begin()
+     */
+    unsigned long ticks(void);
+
+    /**
+     * \brief Wait until a number of ticks are elapsed. The time spent
+     * since the start tick is part of the wait
+     *
+     * \param start The tick from which the wait is counted
+     * \param count The number of ticks to wait
+     */
+    void waitTicks(unsigned long start, unsigned int count);
+
+    /**
+     * \brief Reset the statistics
+     */
+    void resetStats(void);
+
+    /**
+     * \brief Stop the timer interrupt, e.g. to not wake up the MCU while sleeping
+     */
+    void suspend(void);
+
+    /**
+     * \brief Restart the timer interrupt after suspend(). The ticks are
+     * counted again from the current one, without overruns
+     */
+    void resume(void);
+
+  private:
+
+    //! Time (us) of the last executed tick
+    unsigned long serviceTime;
+    //! Timer tick count at the last executed tick
+    unsigned long lastTick;
+};
+
+//! Control tick predefined instance
+extern ControlTick controlTick;
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ *  \file dither.cpp
+ *  \brief This file defines functions and predefined instances from dither.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "dither.h"
+
+void DutyDither::begin(void) {
+  int j;
+
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    setpoint[j] = 0;
+    accumulator[j] = 0;
+  }
+  channels = 0;
+  period = 1;
+  ticks = 0;
+  writes = rateWrites = 0;
+  writeRate = 0;
+  rateTime = millis();
+}
+
+void DutyDither::set(int channel, uint16_t value) {
+  setpoint[channel] = value;
+  channels |= 1 << channel;
+}
+
+void DutyDither::clear(MotorControl &motor, int channel) {
+  if(!(channels & (1 << channel)))
+    return;
+
+  channels &= ~(1 << channel);
+  if(channelRunning(motor, channel) && (motor.channelDC[channel] != (setpoint[channel] / DITHER_SCALE))) {
+    motor.motorPWMDither(channel, setpoint[channel] / DITHER_SCALE);
+    writes++;
+  }
+}
+
+void DutyDither::update(MotorControl &motor) {
+  int j;
+  uint8_t dc;
+  unsigned int sum;
+
+  // The write rate is measured on the clock, as the control ticks can be
+  // lost, also without dithering
+  if((millis() - rateTime) >= DITHER_RATE_TIME) {
+    writeRate = ((writes - rateWrites) * 1000) / (millis() - rateTime);
+    rateWrites = writes;
+    rateTime = millis();
+  }
+
+  if( (channels == 0) || (++ticks < period) )
+    return;
+  ticks = 0;
+
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if(!(channels & (1 << j)))
+      continue;
+    if(!channelRunning(motor, j)) {
+      accumulator[j] = 0;
+      continue;
+    }
+
+    dc = setpoint[j] / DITHER_SCALE;
+    sum = accumulator[j] + (setpoint[j] % DITHER_SCALE);
+    if(sum >= DITHER_SCALE) {
+      if(dc < DUTYCYCLE_MAX)
+        dc++;
+      sum -= DITHER_SCALE;
+    }
+    accumulator[j] = sum;
+
+    if(dc != motor.channelDC[j]) {
+      motor.motorPWMDither(j, dc);
+      writes++;
+    }
+  }
+}
+
+boolean DutyDither::channelRunning(MotorControl &motor, int channel) {
+  int j;
+
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(motor.internalStatus[j].isRunning && (motor.internalStatus[j].channelPWM == (channel + 1)))
+      return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,99 @@
+/**
+ *  \file dither.h
+ *  \brief Sigma-delta dithering of the PWM duty cycle for a higher resolution
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _DITHER
+#define _DITHER
+
+#include "motorcontrol.h"
+
+#define DITHER_SCALE 256        ///< Setpoint units every duty cycle step
+#define DITHER_MAX_PERIOD 100   ///< Max control ticks between two updates
+#define DITHER_RATE_TIME 1000   ///< Time (ms) of the write rate measure
+
+/**
+ * \brief First order sigma-delta modulation of the PWM channels
+ *
+ * The setpoint of a dithered channel is a 16 bit value, the duty cycle
+ * multiplied by DITHER_SCALE. Every update the fractional part is added
+ * to an accumulator, and the duty cycle written to the TLE94112 is the
+ * integer part, plus one when the accumulator overflows: the average duty
+ * cycle is the setpoint with a resolution of 1/DITHER_SCALE, filtered by
+ * the inertia of the motor. The channel is dithered only while a motor
+ * using it is running, replacing the max duty cycle after the start; the
+ * duty cycle is written only when it changes. The period (control ticks
+ * between two updates) trades the ripple frequency against the SPI write
+ * rate, which is measured every second.
+ */
+class DutyDither {
+  public:
+
+    //! Setpoint of every PWM channel (duty cycle * DITHER_SCALE)
+    uint16_t setpoint[AVAIL_PWM_CHANNELS];
+    //! Dithered PWM channels (bit 0 = first channel)
+    uint8_t channels;
+    //! Control ticks between two updates
+    uint8_t period;
+    //! Duty cycle writes to the TLE94112
+    unsigned long writes;
+    //! Duty cycle writes in the last second
+    unsigned int writeRate;
+
+    /**
+     * \brief Initialise without dithered channels, updated every control tick
+     */
+    void begin(void);
+
+    /**
+     * \brief Dither a PWM channel
+     *
+     * \param channel The PWM channel (base 0)
+     * \param value The setpoint, duty cycle * DITHER_SCALE
+     */
+    void set(int channel, uint16_t value);
+
+    /**
+     * \brief Stop dithering a PWM channel. The channel keeps the
+     * integer part of the setpoint until changed
+     *
+     * \param motor The motor control class
+     * \param channel The PWM channel (base 0)
+     */
+    void clear(MotorControl &motor, int channel);
+
+    /**
+     * \brief Update the dithered channels. Should be called once every
+     * control tick
+     *
+     * \param motor The motor control class
+     */
+    void update(MotorControl &motor);
+
+  private:
+
+    //! Sigma-delta accumulator of every PWM channel
+    uint8_t accumulator[AVAIL_PWM_CHANNELS];
+    //! Control ticks since the last update
+    uint8_t ticks;
+    //! Time (ms) of the last write rate measure
+    unsigned long rateTime;
+    //! Writes at the last write rate measure
+    unsigned long rateWrites;
+
+    /**
+     * Check if a running motor uses a PWM channel
+     *
+     * \param motor The motor control class
+     * \param channel The PWM channel (base 0)
+     */
+    boolean channelRunning(MotorControl &motor, int channel);
+};
+
+#endif
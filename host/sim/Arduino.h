@@ -0,0 +1,155 @@
+/**
+ *  \file Arduino.h
+ *  \brief Arduino core of the host simulation, with the UNO pins
+ *
+ *  Only the functions used by the sketch are declared. The time is a
+ *  virtual clock controlled by the checks, see sim.h. As the Arduino core
+ *  defines min and max as macros, the C++ standard headers should be
+ *  included before this file.
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SIM_ARDUINO
+#define _SIM_ARDUINO
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// The flash strings are in RAM
+#define PROGMEM
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_ptr(p) (*(void* const*)(p))
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define DEFAULT 1
+#define INTERNAL 3
+#define DEC 10
+#define HEX 16
+
+// UNO pins
+#define NUM_DIGITAL_PINS 20
+#define NUM_ANALOG_INPUTS 6
+#define A0 14
+static const uint8_t SS = 10;
+static const uint8_t MOSI = 11;
+static const uint8_t MISO = 12;
+static const uint8_t SCK = 13;
+#define NOT_AN_INTERRUPT -1
+#define EXTERNAL_NUM_INTERRUPTS 2
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+
+// ATmega328 timer 2, the compare interrupt is emulated on the virtual clock
+#define F_CPU 16000000UL
+#define E2END 1023
+#define _BV(bit) (1 << (bit))
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define OCIE2A 1
+extern volatile uint8_t TCCR2A, TCCR2B, OCR2A, TCNT2, TIMSK2;
+#define ISR(vector) extern "C" void vector(void); extern "C" void vector(void)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogReference(uint8_t mode);
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts(void);
+void interrupts(void);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh);
+
+/**
+ * Heap allocated string, as the Arduino String
+ */
+class String {
+  public:
+    String(const char* text = "");
+    String(const String &other);
+    ~String();
+    String &operator=(const String &other);
+    String &operator+=(const char* text);
+    unsigned int length(void) const;
+    const char* c_str(void) const;
+
+  private:
+    char* buffer;
+};
+
+/**
+ * Base class of the character outputs
+ */
+class Print {
+  public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* text);
+    size_t print(const __FlashStringHelper* text);
+    size_t print(const String &text);
+    size_t print(const char* text);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+    size_t println(void);
+    template<class T> size_t println(T value) { return print(value) + println(); }
+    template<class T> size_t println(T value, int base) { return print(value, base) + println(); }
+};
+
+/**
+ * Serial port, connected to the buffers of sim.h
+ */
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long baud);
+    int available(void);
+    int read(void);
+    int peek(void);
+    int availableForWrite(void);
+    void flush(void);
+    size_t write(uint8_t c);
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,43 @@
+/**
+ *  \file EEPROM.h
+ *  \brief EEPROM of the host simulation, E2END + 1 bytes erased to 0xff
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SIM_EEPROM
+#define _SIM_EEPROM
+
+#include <Arduino.h>
+
+class EEPROMClass {
+  public:
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);
+    uint16_t length(void);
+
+    template<class T> T &get(int address, T &value) {
+      uint8_t* bytes = (uint8_t*)&value;
+      for(size_t j = 0; j < sizeof(T); j++) {
+        bytes[j] = read(address + j);
+      }
+      return value;
+    }
+
+    template<class T> const T &put(int address, const T &value) {
+      const uint8_t* bytes = (const uint8_t*)&value;
+      for(size_t j = 0; j < sizeof(T); j++) {
+        update(address + j, bytes[j]);
+      }
+      return value;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ *  \file ShiftLCD.h
+ *  \brief Shift register LCD of the host simulation, the output is discarded
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SIM_SHIFTLCD
+#define _SIM_SHIFTLCD
+
+#include <Arduino.h>
+
+class ShiftLCD : public Print {
+  public:
+    ShiftLCD(uint8_t data, uint8_t clock, uint8_t latch);
+    void begin(uint8_t columns, uint8_t rows);
+    void clear(void);
+    void setCursor(uint8_t column, uint8_t row);
+    void display(void);
+    void noDisplay(void);
+    void backlightOn(void);
+    void backlightOff(void);
+    size_t write(uint8_t c);
+    using Print::write;
+};
+
+#endif
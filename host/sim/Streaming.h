@@ -0,0 +1,30 @@
+/**
+ *  \file Streaming.h
+ *  \brief Stream operators of the host simulation, as the Streaming library
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SIM_STREAMING
+#define _SIM_STREAMING
+
+#include <Arduino.h>
+
+template<class T> inline Print &operator <<(Print &stream, T arg) {
+  stream.print(arg);
+  return stream;
+}
+
+enum _EndLineCode { eol };
+#define endl eol
+
+inline Print &operator <<(Print &stream, _EndLineCode) {
+  stream.println();
+  return stream;
+}
+
+#endif
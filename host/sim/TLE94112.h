@@ -0,0 +1,43 @@
+/**
+ *  \file TLE94112.h
+ *  \brief TLE94112 library of the host simulation: the half bridges and PWM
+ *  settings are kept in simTle (sim.h), where the checks inject the faults
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SIM_TLE94112
+#define _SIM_TLE94112
+
+#include <Arduino.h>
+
+class Tle94112 {
+  public:
+
+    enum HalfBridge { TLE_NOHB = 0, TLE_HB1, TLE_HB2, TLE_HB3, TLE_HB4, TLE_HB5, TLE_HB6,
+                      TLE_HB7, TLE_HB8, TLE_HB9, TLE_HB10, TLE_HB11, TLE_HB12 };
+    enum HBState { TLE_FLOATING = 0, TLE_LOW, TLE_HIGH };
+    enum PWMChannel { TLE_NOPWM = 0, TLE_PWM1, TLE_PWM2, TLE_PWM3 };
+    enum PWMFreq { TLE_FREQ80HZ = 1, TLE_FREQ100HZ, TLE_FREQ200HZ, TLE_FREQ2KHZ };
+    enum DiagFlag { TLE_SPI_ERROR = 0x80, TLE_LOAD_ERROR = 0x40, TLE_UNDER_VOLTAGE = 0x20,
+                    TLE_OVER_VOLTAGE = 0x10, TLE_POWER_ON_RESET = 0x08, TLE_TEMP_SHUTDOWN = 0x04,
+                    TLE_TEMP_WARNING = 0x02 };
+    static const uint8_t TLE_STATUS_OK = 0;
+
+    void begin(void);
+    void end(void);
+    void configHB(HalfBridge hb, HBState state, PWMChannel pwm, uint8_t activeFW = 0);
+    void configPWM(PWMChannel pwm, PWMFreq frequency, uint8_t dutyCycle);
+    uint8_t getSysDiagnosis(void);
+    uint8_t getHBOverCurrent(HalfBridge hb);
+    uint8_t getHBOpenLoad(HalfBridge hb);
+    void clearErrors(void);
+};
+
+extern Tle94112 tle94112;
+
+#endif
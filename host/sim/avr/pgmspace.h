@@ -0,0 +1,12 @@
+/**
+ *  \file pgmspace.h
+ *  \brief Flash memory access of the host simulation, see Arduino.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include <Arduino.h>
@@ -0,0 +1,25 @@
+/**
+ *  \file sleep.h
+ *  \brief Sleep modes of the host simulation: sleeping advances the virtual
+ *  clock by 1 ms, as the millis() timer interrupt wakes up the MCU
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SIM_SLEEP
+#define _SIM_SLEEP
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_DOWN 2
+
+void set_sleep_mode(int mode);
+void sleep_enable(void);
+void sleep_disable(void);
+void sleep_cpu(void);
+void sleep_mode(void);
+
+#endif
@@ -0,0 +1,471 @@
+/**
+ *  \file sim.cpp
+ *  \brief This file defines functions and predefined instances from sim.h
+ *  and from the fake libraries of the host simulation
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <ShiftLCD.h>
+#include <TLE94112.h>
+#include <avr/sleep.h>
+#include "sim.h"
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+Tle94112 tle94112;
+
+simChip simTle;
+uint8_t simPinLevel[NUM_DIGITAL_PINS];
+int simAnalog[NUM_ANALOG_INPUTS];
+
+volatile uint8_t TCCR2A, TCCR2B, OCR2A, TCNT2, TIMSK2;
+
+//! Timer 2 compare interrupt, defined by the sketch if it uses the timer
+extern "C" void TIMER2_COMPA_vect(void) __attribute__((weak));
+
+//! Virtual clock (us)
+static unsigned long clockTime;
+//! Time (us) of the last timer 2 compare match
+static unsigned long compareTime;
+//! Timer interrupt being executed
+static boolean inInterrupt;
+//! Time (us) returned by micros() inside the timer interrupt
+static unsigned long interruptTime;
+//! Handlers of the external interrupts
+static void (*externalHandler[EXTERNAL_NUM_INTERRUPTS])(void);
+//! Serial input ring buffer
+static char serialInput[SIM_SERIAL_INPUT];
+static unsigned int inputHead, inputCount;
+//! Serial output
+static char serialOutput[SIM_SERIAL_OUTPUT];
+static unsigned int outputSize;
+//! Number of failed checks
+static int failures;
+//! EEPROM content, erased by the first access
+static uint8_t eeprom[E2END + 1];
+static boolean eepromErased;
+
+// ===============================================================
+// Virtual clock and timer 2
+// ===============================================================
+
+//! Timer 2 compare period (us), 0 if the timer is stopped
+static unsigned long comparePeriod(void) {
+  static const unsigned int prescaler[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+  return ((unsigned long)OCR2A + 1) * prescaler[TCCR2B & 0x07] / (F_CPU / 1000000UL);
+}
+
+//! Execute the timer interrupts elapsed up to the current time
+static void runTimer(void) {
+  unsigned long period;
+
+  period = comparePeriod();
+  if( inInterrupt || !TIMER2_COMPA_vect || !(TIMSK2 & _BV(OCIE2A)) || (period == 0) ) {
+    // The counting restarts when the interrupt is enabled
+    compareTime = clockTime;
+    return;
+  }
+
+  inInterrupt = true;
+  while((clockTime - compareTime) >= period) {
+    compareTime += period;
+    interruptTime = compareTime;
+    TIMER2_COMPA_vect();
+  }
+  inInterrupt = false;
+}
+
+unsigned long simTime(void) {
+  return clockTime;
+}
+
+void simAdvance(unsigned long us) {
+  clockTime += us;
+  runTimer();
+}
+
+unsigned long micros(void) {
+  if(inInterrupt)
+    return interruptTime;
+  simAdvance(SIM_CALL_TIME);
+  return clockTime;
+}
+
+unsigned long millis(void) {
+  if(inInterrupt)
+    return interruptTime / 1000;
+  simAdvance(SIM_CALL_TIME);
+  return clockTime / 1000;
+}
+
+void delay(unsigned long ms) {
+  simAdvance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  simAdvance(us);
+}
+
+void noInterrupts(void) {
+}
+
+void interrupts(void) {
+  simAdvance(1);
+}
+
+void set_sleep_mode(int mode) {
+}
+
+void sleep_enable(void) {
+}
+
+void sleep_disable(void) {
+}
+
+void sleep_cpu(void) {
+  simAdvance(SIM_SLEEP_TIME);
+}
+
+void sleep_mode(void) {
+  simAdvance(SIM_SLEEP_TIME);
+}
+
+// ===============================================================
+// Pins and external interrupts
+// ===============================================================
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if(pin < NUM_DIGITAL_PINS)
+    simPinLevel[pin] = value;
+}
+
+int digitalRead(uint8_t pin) {
+  return (pin < NUM_DIGITAL_PINS) ? simPinLevel[pin] : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  if(pin >= A0)
+    pin -= A0;
+  return (pin < NUM_ANALOG_INPUTS) ? simAnalog[pin] : 0;
+}
+
+void analogReference(uint8_t mode) {
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode) {
+  if(interrupt < EXTERNAL_NUM_INTERRUPTS)
+    externalHandler[interrupt] = handler;
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  if(interrupt < EXTERNAL_NUM_INTERRUPTS)
+    externalHandler[interrupt] = NULL;
+}
+
+void simPulse(uint8_t pin) {
+  int interrupt;
+
+  interrupt = digitalPinToInterrupt(pin);
+  if( (interrupt != NOT_AN_INTERRUPT) && (externalHandler[interrupt] != NULL) )
+    externalHandler[interrupt]();
+}
+
+long map(long value, long fromLow, long fromHigh, long toLow, long toHigh) {
+  return (value - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
+}
+
+// ===============================================================
+// String and Print
+// ===============================================================
+
+String::String(const char* text) {
+  buffer = (char*)malloc(strlen(text) + 1);
+  strcpy(buffer, text);
+}
+
+String::String(const String &other) {
+  buffer = (char*)malloc(strlen(other.buffer) + 1);
+  strcpy(buffer, other.buffer);
+}
+
+String::~String() {
+  free(buffer);
+}
+
+String &String::operator=(const String &other) {
+  if(this != &other) {
+    free(buffer);
+    buffer = (char*)malloc(strlen(other.buffer) + 1);
+    strcpy(buffer, other.buffer);
+  }
+  return *this;
+}
+
+String &String::operator+=(const char* text) {
+  buffer = (char*)realloc(buffer, strlen(buffer) + strlen(text) + 1);
+  strcat(buffer, text);
+  return *this;
+}
+
+unsigned int String::length(void) const {
+  return strlen(buffer);
+}
+
+const char* String::c_str(void) const {
+  return buffer;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t j;
+
+  for(j = 0; j < size; j++) {
+    write(buffer[j]);
+  }
+  return size;
+}
+
+size_t Print::write(const char* text) {
+  return write((const uint8_t*)text, strlen(text));
+}
+
+size_t Print::print(const __FlashStringHelper* text) {
+  return write((const char*)text);
+}
+
+size_t Print::print(const String &text) {
+  return write(text.c_str());
+}
+
+size_t Print::print(const char* text) {
+  return write(text);
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char value, int base) {
+  return print((unsigned long)value, base);
+}
+
+size_t Print::print(int value, int base) {
+  return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+  return print((unsigned long)value, base);
+}
+
+size_t Print::print(long value, int base) {
+  char text[24];
+
+  if(base == DEC) {
+    snprintf(text, sizeof(text), "%ld", value);
+    return write(text);
+  }
+  return print((unsigned long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  char text[24];
+
+  snprintf(text, sizeof(text), (base == HEX) ? "%lX" : "%lu", value);
+  return write(text);
+}
+
+size_t Print::print(double value, int digits) {
+  char text[32];
+
+  snprintf(text, sizeof(text), "%.*f", digits, value);
+  return write(text);
+}
+
+size_t Print::println(void) {
+  return write("\r\n");
+}
+
+// ===============================================================
+// Serial
+// ===============================================================
+
+void HardwareSerial::begin(unsigned long baud) {
+}
+
+int HardwareSerial::available(void) {
+  return inputCount;
+}
+
+int HardwareSerial::read(void) {
+  char c;
+
+  if(inputCount == 0)
+    return -1;
+  c = serialInput[inputHead];
+  inputHead = (inputHead + 1) % SIM_SERIAL_INPUT;
+  inputCount--;
+  return (uint8_t)c;
+}
+
+int HardwareSerial::peek(void) {
+  return (inputCount == 0) ? -1 : (uint8_t)serialInput[inputHead];
+}
+
+int HardwareSerial::availableForWrite(void) {
+  return 63;
+}
+
+void HardwareSerial::flush(void) {
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if(outputSize < (SIM_SERIAL_OUTPUT - 1))
+    serialOutput[outputSize++] = c;
+  return 1;
+}
+
+boolean simInput(const char* text) {
+  if((inputCount + strlen(text)) > SIM_SERIAL_INPUT)
+    return false;
+  while(*text != '\0') {
+    serialInput[(inputHead + inputCount) % SIM_SERIAL_INPUT] = *text++;
+    inputCount++;
+  }
+  return true;
+}
+
+const char* simOutput(void) {
+  serialOutput[outputSize] = '\0';
+  return serialOutput;
+}
+
+void simClearOutput(void) {
+  outputSize = 0;
+}
+
+// ===============================================================
+// LCD and EEPROM
+// ===============================================================
+
+ShiftLCD::ShiftLCD(uint8_t data, uint8_t clock, uint8_t latch) {
+}
+
+void ShiftLCD::begin(uint8_t columns, uint8_t rows) {
+}
+
+void ShiftLCD::clear(void) {
+}
+
+void ShiftLCD::setCursor(uint8_t column, uint8_t row) {
+}
+
+void ShiftLCD::display(void) {
+}
+
+void ShiftLCD::noDisplay(void) {
+}
+
+void ShiftLCD::backlightOn(void) {
+}
+
+void ShiftLCD::backlightOff(void) {
+}
+
+size_t ShiftLCD::write(uint8_t c) {
+  return 1;
+}
+
+uint8_t EEPROMClass::read(int address) {
+  if(!eepromErased) {
+    memset(eeprom, 0xff, sizeof(eeprom));
+    eepromErased = true;
+  }
+  return ((address >= 0) && (address <= E2END)) ? eeprom[address] : 0xff;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  read(address);
+  if((address >= 0) && (address <= E2END))
+    eeprom[address] = value;
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+  if(read(address) != value)
+    write(address, value);
+}
+
+uint16_t EEPROMClass::length(void) {
+  return E2END + 1;
+}
+
+// ===============================================================
+// TLE94112
+// ===============================================================
+
+void Tle94112::begin(void) {
+}
+
+void Tle94112::end(void) {
+}
+
+void Tle94112::configHB(HalfBridge hb, HBState state, PWMChannel pwm, uint8_t activeFW) {
+  simAdvance(simTle.transferTime);
+  if(hb <= SIM_HALFBRIDGES) {
+    simTle.hbState[hb] = state;
+    simTle.hbPWM[hb] = pwm;
+  }
+  simTle.hbWrites++;
+}
+
+void Tle94112::configPWM(PWMChannel pwm, PWMFreq frequency, uint8_t dutyCycle) {
+  simAdvance(simTle.transferTime);
+  if(pwm <= SIM_PWM_CHANNELS) {
+    simTle.pwmFrequency[pwm] = frequency;
+    simTle.pwmDC[pwm] = dutyCycle;
+  }
+  simTle.pwmWrites++;
+}
+
+uint8_t Tle94112::getSysDiagnosis(void) {
+  simAdvance(simTle.transferTime);
+  return simTle.diagnosis;
+}
+
+uint8_t Tle94112::getHBOverCurrent(HalfBridge hb) {
+  simAdvance(simTle.transferTime);
+  return (simTle.overCurrent >> hb) & 1;
+}
+
+uint8_t Tle94112::getHBOpenLoad(HalfBridge hb) {
+  simAdvance(simTle.transferTime);
+  return (simTle.openLoad >> hb) & 1;
+}
+
+void Tle94112::clearErrors(void) {
+  simAdvance(simTle.transferTime);
+}
+
+// ===============================================================
+// Checks
+// ===============================================================
+
+void simCheck(boolean condition, const char* what) {
+  printf("%s %s\n", condition ? "PASS" : "FAIL", what);
+  if(!condition)
+    failures++;
+}
+
+int simReport(void) {
+  printf("%d failures\n", failures);
+  return failures ? 1 : 0;
+}
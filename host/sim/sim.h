@@ -0,0 +1,111 @@
+/**
+ *  \file sim.h
+ *  \brief Host simulation of the board, to run the sketch modules in the
+ *  checks of host/tests without the hardware
+ *
+ *  The fake Arduino core, TLE94112, ShiftLCD, EEPROM and Streaming headers
+ *  of this folder replace the libraries, so the sketch sources are built by
+ *  the host compiler with -Ihost/sim. The time is a virtual clock in us,
+ *  advanced by the checks with simAdvance(); every call of micros() and
+ *  millis() takes SIM_CALL_TIME us and every interrupts() 1 us, so the busy
+ *  waits of the firmware end. The timer 2 compare interrupt is executed at
+ *  the compare times of its registers, with micros() returning the compare
+ *  time inside the interrupt.
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SIM
+#define _SIM
+
+#include <Arduino.h>
+
+#define SIM_CALL_TIME 4             ///< Time (us) of a micros() or millis() call
+#define SIM_SLEEP_TIME 1000         ///< Time (us) of a sleep, until the millis() timer interrupt
+#define SIM_SERIAL_INPUT 256        ///< Serial input buffer size
+#define SIM_SERIAL_OUTPUT 16384     ///< Serial output buffer size, the following output is discarded
+#define SIM_HALFBRIDGES 12          ///< Half bridges of the simulated TLE94112
+#define SIM_PWM_CHANNELS 3          ///< PWM channels of the simulated TLE94112
+
+/**
+ * State of the simulated TLE94112. The arrays are indexed with the library
+ * enums, so the element 0 is the half bridge or channel not used
+ */
+struct simChip {
+  uint8_t hbState[SIM_HALFBRIDGES + 1];     ///< Half bridges state (Tle94112::HBState)
+  uint8_t hbPWM[SIM_HALFBRIDGES + 1];       ///< Half bridges PWM channel (Tle94112::PWMChannel)
+  uint8_t pwmFrequency[SIM_PWM_CHANNELS + 1]; ///< PWM channels frequency (Tle94112::PWMFreq)
+  uint8_t pwmDC[SIM_PWM_CHANNELS + 1];      ///< PWM channels duty cycle
+  unsigned long hbWrites;                   ///< Number of configHB() calls
+  unsigned long pwmWrites;                  ///< Number of configPWM() calls
+  uint8_t diagnosis;                        ///< Status returned by getSysDiagnosis(), set by the checks
+  uint16_t openLoad;                        ///< Half bridges in open load, bit 1 to SIM_HALFBRIDGES
+  uint16_t overCurrent;                     ///< Half bridges in over current, bit 1 to SIM_HALFBRIDGES
+  unsigned int transferTime;                ///< Time (us) of every library call, as the SPI transfers
+};
+
+//! Simulated TLE94112
+extern simChip simTle;
+//! Levels read by digitalRead(), set by the checks
+extern uint8_t simPinLevel[NUM_DIGITAL_PINS];
+//! Values read by analogRead(), set by the checks
+extern int simAnalog[NUM_ANALOG_INPUTS];
+
+/**
+ * \brief Current time of the virtual clock (us), without advancing it
+ */
+unsigned long simTime(void);
+
+/**
+ * \brief Advance the virtual clock, executing the timer interrupts
+ *
+ * \param us The time to advance (us)
+ */
+void simAdvance(unsigned long us);
+
+/**
+ * \brief Execute the handler attached to the interrupt of a pin, as a
+ * rising edge
+ *
+ * \param pin The digital pin, 2 or 3
+ */
+void simPulse(uint8_t pin);
+
+/**
+ * \brief Add characters to the serial input
+ *
+ * \param text The characters, e.g. a command line ending with \n
+ * \return false if the input buffer is full
+ */
+boolean simInput(const char* text);
+
+/**
+ * \brief Serial output since the last simClearOutput(), null terminated
+ */
+const char* simOutput(void);
+
+/**
+ * \brief Discard the serial output
+ */
+void simClearOutput(void);
+
+/**
+ * \brief Print the result of a check of host/tests
+ *
+ * \param condition The check result
+ * \param what Description of the check
+ */
+void simCheck(boolean condition, const char* what);
+
+/**
+ * \brief Print the number of failed checks
+ *
+ * \return The exit code of the check program, 1 if a check has failed
+ */
+int simReport(void);
+
+#endif
@@ -0,0 +1,35 @@
+#!/usr/bin/env python3
+#
+#  \file sketch.py
+#  \brief Convert the sketch to a C++ source for the host simulation, adding
+#  the prototypes of its functions after the includes as the Arduino IDE does:
+#
+#      python3 host/sim/sketch.py TLE94112LE.ino > sketch.cpp
+#
+#  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+#  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+#  \date July 2017
+#  \version 1.0
+#  Licensed under GNU LGPL 3.0
+
+import re
+import sys
+
+# A function definition: return type, name and arguments, then the body
+DEFINITION = re.compile(r'^\s*([A-Za-z_][\w\s\*&:<>]*?\b([A-Za-z_]\w*)\s*\([^;{)]*\))\s*\{', re.M)
+# Keywords followed by a parenthesis that are not functions
+STATEMENTS = ('if', 'for', 'while', 'switch', 'return', 'else')
+
+path = sys.argv[1]
+source = open(path).read()
+
+prototypes = []
+for match in DEFINITION.finditer(source):
+    if match.group(2) in STATEMENTS or match.group(1).split()[0] in STATEMENTS:
+        continue
+    prototypes.append(match.group(1).strip() + ';')
+
+lines = source.split('\n')
+last = max(j for j, line in enumerate(lines) if line.startswith('#include'))
+output = lines[:last + 1] + prototypes + ['#line %d "%s"' % (last + 2, path)] + lines[last + 1:]
+sys.stdout.write('\n'.join(output))
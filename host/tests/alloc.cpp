@@ -0,0 +1,123 @@
+/**
+ *  \file alloc.cpp
+ *  \brief Check that the sketch doesn't allocate memory after setup(),
+ *  running commands and faults on the host simulation with the heap
+ *  allocations counted (glibc):
+ *
+ *      python3 host/sim/sketch.py TLE94112LE.ino > /tmp/sketch.cpp
+ *      g++ -std=gnu++11 -Ihost/sim -I. -o alloc host/tests/alloc.cpp /tmp/sketch.cpp \
+ *          *.cpp host/sim/sim.cpp
+ *      ./alloc
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "sim.h"
+#include "commands.h"
+#include "motor.h"
+#include <TLE94112.h>
+
+#define LOOP_TIME 500         ///< Time (us) between two main loops
+#define COMMAND_LOOPS 400     ///< Main loops executed after every command
+
+void setup(void);
+void loop(void);
+
+extern "C" {
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t count, size_t size);
+  void* __libc_realloc(void* pointer, size_t size);
+}
+
+//! Count the allocations
+static boolean counting;
+//! Allocations counted
+static unsigned long allocations;
+
+// The operator new of the C++ library allocates with malloc()
+extern "C" void* malloc(size_t size) {
+  if(counting)
+    allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  if(counting)
+    allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) {
+  if(counting)
+    allocations++;
+  return __libc_realloc(pointer, size);
+}
+
+//! Commands covering the parser, the settings, the actions and the tables
+static const char* const commands[] = {
+  SHOW_CONF, "m1+", "m2+", DIRECTION_CW, PWM_80, "mdc128", MOTOR_DC_INFO, PWM80_DC, INFO_DC,
+  PWM_RAMP, "hz100", STOP_MODE_BRAKE, "brake300", MOTOR_START, FAULT_INFO, "fault-load=stop",
+  "filter-load=2,50,1000", TELEMETRY_ON, "tlm20", TELEMETRY_INFO, TELEMETRY_OFF, TRACE_DUMP, SPEED_INFO,
+  "seq+0105E803", SEQUENCE_RUN, SEQUENCE_INFO, "dith2600", DITHER_INFO, "wave-sine=100,128,2000,90",
+  WAVE_INFO, WAVE_OFF, "budget50", "weight25", POWER_INFO, MOTOR_STOP, "run500", MOVE_INFO,
+  TICK_INFO, IDLE_INFO, "soak-200,100,3,1", SOAK_START, SOAK_INFO, SOAK_STOP, CONFIG_SAVE,
+  CONFIG_LOAD, "psave-1-test", PROFILE_LIST, "prof-1", "m1+;cw;80;mdc100", TRACE_CLEAR,
+  "#12 conf", MOTOR_RESET
+};
+
+/**
+ * \brief Run the main loop
+ *
+ * \param loops The number of loops
+ */
+static void run(int loops) {
+  int j;
+
+  for(j = 0; j < loops; j++) {
+    simAdvance(LOOP_TIME);
+    loop();
+  }
+}
+
+int main(void) {
+  size_t j;
+
+  setup();
+  simClearOutput();
+  counting = true;
+
+  for(j = 0; j < sizeof(commands) / sizeof(commands[0]); j++) {
+    simInput(commands[j]);
+    simInput("\n");
+    run(COMMAND_LOOPS);
+  }
+
+  // Diagnostic errors notified while running
+  simInput(MOTOR_START "\n");
+  run(COMMAND_LOOPS);
+  simTle.diagnosis = Tle94112::TLE_TEMP_WARNING;
+  run(COMMAND_LOOPS);
+  simTle.diagnosis = Tle94112::TLE_LOAD_ERROR;
+  simTle.openLoad = 0x02;
+  run(COMMAND_LOOPS);
+  simTle.diagnosis = Tle94112::TLE_STATUS_OK;
+  simTle.openLoad = 0;
+  simInput(MOTOR_STOP "\n");
+  run(COMMAND_LOOPS);
+  // The output before has the binary telemetry frames
+  simClearOutput();
+  simInput("bogus\n");
+  run(COMMAND_LOOPS);
+
+  counting = false;
+  simCheck(strstr(simOutput(), CMD_WRONGCMD) != NULL, "commands executed");
+  simCheck(allocations == 0, "no allocations after setup()");
+  if(allocations != 0)
+    printf("%lu allocations\n", allocations);
+
+  return simReport();
+}
@@ -0,0 +1,218 @@
+/**
+ *  \file roundtrip.cpp
+ *  \brief Round trip check of the host library against a simulated firmware
+ *  on a pseudo terminal. The firmware side replies with the tags and the
+ *  telemetry frames as the sketch does, so the client is checked without
+ *  the board:
+ *
+ *      g++ -std=c++11 -pthread -o roundtrip host/tests/roundtrip.cpp host/tleclient.cpp -lutil
+ *      ./roundtrip
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include "../tleclient.h"
+
+#define DROP_COMMAND "drop"   ///< Command the simulated firmware loses
+#define MAX_GAIN 0x7fff       ///< Max gain, as SPEED_MAX_GAIN in speedcontrol.h
+
+//! Command lines received by the simulated firmware
+static std::vector<std::string> received;
+static std::mutex receivedLock;
+//! Number of failed checks
+static int failures = 0;
+
+/**
+ * \brief Print the result of a check
+ */
+static void check(bool condition, const char* what) {
+  printf("%s %s\n", condition ? "PASS" : "FAIL", what);
+  if(!condition)
+    failures++;
+}
+
+/**
+ * \brief Send a telemetry frame, with the layout of telemetry.h
+ */
+static void sendFrame(int fd, uint8_t sequence, uint8_t dc) {
+  uint8_t frame[TLE_TELEMETRY_SIZE];
+  uint8_t checksum;
+  int j;
+
+  memset(frame, 0, sizeof(frame));
+  frame[0] = TLE_TELEMETRY_SYNC1;
+  frame[1] = TLE_TELEMETRY_SYNC2;
+  frame[2] = TLE_TELEMETRY_SIZE;
+  frame[3] = sequence;
+  frame[4] = 0x10;                        // 10000 ms
+  frame[5] = 0x27;
+  frame[8] = 3;                           // Motor 1 enabled and running
+  frame[8 + MAX_MOTORS] = dc;             // Channel 1 requested duty cycle
+  frame[8 + MAX_MOTORS + AVAIL_PWM_CHANNELS] = dc / 2;  // Channel 1 applied duty cycle
+  frame[8 + MAX_MOTORS + AVAIL_PWM_CHANNELS * 2] = 100; // Derate
+  frame[8 + MAX_MOTORS + AVAIL_PWM_CHANNELS * 2 + 1] = 50; // Budget
+  checksum = 0;
+  for(j = 0; j < (TLE_TELEMETRY_SIZE - 1); j++) {
+    checksum ^= frame[j];
+  }
+  frame[TLE_TELEMETRY_SIZE - 1] = checksum;
+  write(fd, frame, sizeof(frame));
+}
+
+/**
+ * \brief Simulated firmware on the master side of the pseudo terminal
+ *
+ * The gains above MAX_GAIN and the unknown commands fail, the start
+ * sends a telemetry frame before the reply and DROP_COMMAND is lost
+ */
+static void firmware(int fd) {
+  std::string line, command, tag, reply;
+  unsigned long time;
+  size_t space;
+  bool failed;
+  char c;
+
+  time = 1000;
+  while(read(fd, &c, 1) == 1) {
+    if(c != '\n') {
+      line += c;
+      continue;
+    }
+    command = line;
+    tag.clear();
+    line.clear();
+    if(command[0] == COMMAND_TAG_PREFIX) {
+      space = command.find(' ');
+      tag = command.substr(1, space - 1);
+      command = command.substr(space + 1);
+    }
+    {
+      std::lock_guard<std::mutex> guard(receivedLock);
+      received.push_back(command);
+    }
+    if(command == DROP_COMMAND)
+      continue;
+
+    failed = false;
+    if( (command.compare(0, strlen(SPEED_KP_GAIN), SPEED_KP_GAIN) == 0) ||
+        (command.compare(0, strlen(SPEED_KI_GAIN), SPEED_KI_GAIN) == 0) ) {
+      failed = atol(command.c_str() + 2) > MAX_GAIN;
+      reply = failed ? std::string(CMD_WRONGCMD) + "'" + command + "'\r\n" :
+                       std::string(CMD_SET) + "'" + command + "'\r\n";
+    }
+    else if(command == MOTOR_START) {
+      sendFrame(fd, 7, 200);
+      reply = std::string(CMD_EXEC) + "'" + command + "'\r\n";
+    }
+    else if(command == SHOW_CONF)
+      reply = "|Motor|Enabled|\r\n|  1  |  yes  |\r\n";
+    else if( (command == MOTOR_STOP) || (command.compare(0, strlen(STOP_MODE_BRAKE), STOP_MODE_BRAKE) == 0) ||
+             (command.compare(0, strlen(MOTOR_DC), MOTOR_DC) == 0) )
+      reply = std::string(CMD_SET) + "'" + command + "'\r\n";
+    else {
+      failed = true;
+      reply = std::string(CMD_WRONGCMD) + "'" + command + "'\r\n";
+    }
+
+    if(!tag.empty()) {
+      reply += CMD_TAG + tag + (failed ? CMD_TAG_FAILED : CMD_TAG_DONE) + std::to_string(time) + " " +
+               std::to_string(time + 20) + " " + std::to_string(time + 50) + "\r\n";
+      time += 100;
+    }
+    write(fd, reply.data(), reply.size());
+  }
+}
+
+int main(void) {
+  std::vector<std::future<TleReply>> replies;
+  std::atomic<int> frames, frameDC, frameApplied;
+  TleReply reply, lost, after;
+  TleStation* station;
+  int master, slave;
+  char name[64];
+  int j, ok;
+
+  if(openpty(&master, &slave, name, NULL, NULL) < 0) {
+    printf("FAIL no pseudo terminal\n");
+    return 1;
+  }
+  std::thread(firmware, master).detach();
+
+  TleClient client;
+  station = client.open(name);
+  check(station != NULL, "open the pseudo terminal");
+  if(station == NULL)
+    return 1;
+  frames = frameDC = frameApplied = 0;
+  station->onTelemetry([&](const TleTelemetry &telemetry) {
+    frames++;
+    frameDC = telemetry.channelDC[0];
+    frameApplied = telemetry.appliedDC[0];
+  });
+
+  // Reply keyword, lines and firmware time stamps
+  reply = station->showConf().get();
+  check(reply.ok && (reply.lines.size() == 2), "informative command lines");
+  reply = station->start().get();
+  check(reply.ok && (reply.status + " " == CMD_EXEC), "action command status");
+  check((reply.appliedTime - reply.receiveTime) == 50, "firmware time stamps");
+  check((frames == 1) && (frameDC == 200) && (frameApplied == 100), "telemetry frame decoded");
+  reply = station->submit("bogus").get();
+  check(!reply.ok, "wrong command failed");
+
+  // A lost command fails when the tag of the following one is received
+  {
+    std::future<TleReply> first = station->submit(DROP_COMMAND);
+    std::future<TleReply> second = station->stop();
+    lost = first.get();
+    after = second.get();
+  }
+  check(!lost.ok && after.ok, "lost command detected by the next tag");
+
+  // Both gains are acknowledged before the reply
+  reply = station->gains(64, 16).get();
+  check(reply.ok, "gains set");
+  check(reply.command == std::string(SPEED_KP_GAIN) + "64" + BATCH_SEPARATOR + SPEED_KI_GAIN + "16",
+        "gains reply of both commands");
+  reply = station->gains(MAX_GAIN + 1, 16).get();
+  check(!reply.ok, "gains failed when kp fails");
+  reply = station->gains(64, MAX_GAIN + 1).get();
+  check(!reply.ok, "gains failed when ki fails");
+
+  // The float stop mode needs a brake time
+  reply = station->stopMode(STOP_BRAKE_FLOAT, 0).get();
+  check(!reply.ok, "brake0 rejected");
+  reply = station->stopMode(STOP_BRAKE_FLOAT, 300).get();
+  check(reply.ok, "brake300 set");
+  {
+    std::lock_guard<std::mutex> guard(receivedLock);
+    check(std::find(received.begin(), received.end(), std::string(STOP_MODE_BRAKE) + "0") == received.end(),
+          "brake0 not sent");
+  }
+
+  // Pipelined commands, more than the receive window
+  for(j = 0; j < 50; j++) {
+    replies.push_back(station->motorDC(j));
+  }
+  ok = 0;
+  for(j = 0; j < 50; j++) {
+    reply = replies[j].get();
+    if(reply.ok && (reply.command == std::string(MOTOR_DC) + std::to_string(j)))
+      ok++;
+  }
+  check(ok == 50, "pipelined commands completed in order");
+
+  printf("%d failures\n", failures);
+  return failures ? 1 : 0;
+}
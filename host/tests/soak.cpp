@@ -0,0 +1,121 @@
+/**
+ *  \file soak.cpp
+ *  \brief Check of the soak test statistics on the virtual clock of the host
+ *  simulation, with the ramps aligned to the control tick and a fault
+ *  injected during a cycle:
+ *
+ *      g++ -std=gnu++11 -Ihost/sim -I. -o soak host/tests/soak.cpp soak.cpp \
+ *          motorcontrol.cpp controltick.cpp trace.cpp host/sim/sim.cpp
+ *      ./soak
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "sim.h"
+#include "motorcontrol.h"
+#include "controltick.h"
+#include "soak.h"
+
+#define LOOP_TIME 1000        ///< Time (us) of a main loop
+#define RUN_TIME 500          ///< Run time (ms) every cycle
+#define REST_TIME 200         ///< Rest time (ms) every cycle
+#define CYCLES 5              ///< Cycles of every test
+#define RAMP_MAX_DC 50        ///< Duty cycle at the end of the acceleration
+#define MAX_LOOPS 100000      ///< Main loops before giving up a test
+
+MotorControl motor;
+SoakTest soak;
+
+//! Statistics of a soak test
+struct soakResult {
+  unsigned long cycles;
+  unsigned long aborted;
+  unsigned long minCycle;
+  unsigned long maxCycle;
+  unsigned long totalTime;
+  unsigned long cyclesPerMinute;
+};
+
+/**
+ * \brief Run a soak test to the end with the main loop services
+ *
+ * \param faultCycle The cycle (base 1) when an under voltage is detected, 0 = none
+ * \return The statistics of the test
+ */
+static soakResult runSoak(unsigned long faultCycle) {
+  unsigned long j;
+  soakResult result;
+
+  soak.begin();
+  soak.runTime = RUN_TIME;
+  soak.restTime = REST_TIME;
+  soak.maxCycles = CYCLES;
+  simCheck(soak.start(motor), "soak test started");
+
+  for(j = 0; (j < MAX_LOOPS) && (soak.phase != SOAK_IDLE); j++) {
+    simAdvance(LOOP_TIME);
+    // The chip reports the fault once, in the middle of the run
+    if( (faultCycle > 0) && (soak.phase == SOAK_RUN) &&
+        ((soak.cycles + soak.aborted + 1) == faultCycle) ) {
+      simTle.diagnosis = Tle94112::TLE_UNDER_VOLTAGE;
+      motor.tleCheckDiagnostic();
+      simTle.diagnosis = Tle94112::TLE_STATUS_OK;
+      faultCycle = 0;
+    }
+    soak.update(motor);
+    motor.brakeService();
+  }
+
+  result.cycles = soak.cycles;
+  result.aborted = soak.aborted;
+  result.minCycle = soak.minCycle;
+  result.maxCycle = soak.maxCycle;
+  result.totalTime = soak.totalTime;
+  result.cyclesPerMinute = soak.cyclesPerMinute();
+  return result;
+}
+
+int main(void) {
+  soakResult first, second, faulty;
+  unsigned long ramp, cycle;
+
+  controlTick.begin();
+  motor.begin();
+  motor.internalStatus[0].isEnabled = true;
+  motor.internalStatus[0].channelPWM = PWM1_CHID;
+  motor.dutyCyclePWM[0].useRamp = true;
+  motor.dutyCyclePWM[0].minDC = 0;
+  motor.dutyCyclePWM[0].maxDC = RAMP_MAX_DC;
+
+  // Every cycle is the run and rest time plus the acceleration and deceleration
+  ramp = (unsigned long)RAMP_MAX_DC * RAMP_STEP_DELAY * TICK_PERIOD / 1000;
+  cycle = RUN_TIME + REST_TIME + 2 * ramp;
+  first = runSoak(0);
+  simCheck((first.cycles == CYCLES) && (first.aborted == 0), "all the cycles completed");
+  simCheck((first.minCycle >= cycle - LOOP_TIME / 1000 - 2) && (first.maxCycle <= cycle + 2 * LOOP_TIME / 1000 + 2),
+           "cycle time of run, rest and ramps");
+  simCheck((first.totalTime >= first.minCycle * CYCLES) && (first.totalTime <= first.maxCycle * CYCLES),
+           "total time of the completed cycles");
+  simCheck(first.cyclesPerMinute == 60000 * CYCLES / first.totalTime, "cycles every minute");
+  simCheck(!motor.motorsRunning(), "motors stopped at the end");
+
+  // The virtual clock makes the statistics reproducible
+  second = runSoak(0);
+  simCheck((second.cycles == first.cycles) && (second.minCycle == first.minCycle) &&
+           (second.maxCycle == first.maxCycle) && (second.totalTime == first.totalTime) &&
+           (second.cyclesPerMinute == first.cyclesPerMinute), "statistics reproduced");
+
+  // A fault reaction stopping the motors aborts the cycle
+  faulty = runSoak(3);
+  simCheck((faulty.cycles == CYCLES - 1) && (faulty.aborted == 1), "faulty cycle aborted");
+  simCheck(soak.faults(motor, FAULT_UNDERVOLTAGE) == 1, "fault counted");
+  simCheck((faulty.minCycle == first.minCycle) && (faulty.maxCycle == first.maxCycle),
+           "aborted cycle not in the cycle times");
+  simCheck(!motor.motorsRunning(), "motors stopped after the fault");
+
+  return simReport();
+}
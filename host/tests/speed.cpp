@@ -0,0 +1,113 @@
+/**
+ *  \file speed.cpp
+ *  \brief Check of the PI speed control against a first order motor model
+ *  driven by the duty cycle of the simulated TLE94112, which generates the
+ *  tachometer pulses:
+ *
+ *      g++ -std=gnu++11 -Ihost/sim -I. -o speed host/tests/speed.cpp speedcontrol.cpp \
+ *          motorcontrol.cpp controltick.cpp trace.cpp host/sim/sim.cpp
+ *      ./speed
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include <math.h>
+#include "sim.h"
+#include "motorcontrol.h"
+#include "speedcontrol.h"
+
+#define TACH_PIN 2            ///< Tachometer pin, external interrupt 0
+#define STEP_TIME 1000        ///< Simulation step (us), a main loop
+#define MOTOR_GAIN 4.0        ///< Motor speed (pulses/s) every duty cycle unit at full supply
+#define MOTOR_TAU 0.2         ///< Motor time constant (s)
+#define TARGET_SPEED 500      ///< Target speed (pulses/s)
+#define SPEED_TOLERANCE 25    ///< Max error (pulses/s) when settled
+
+MotorControl motor;
+SpeedControl speed;
+
+//! Motor speed (pulses/s)
+static double motorSpeed;
+//! Fraction of the next tachometer pulse
+static double pulseFraction;
+//! Motor gain, reduced to simulate a supply drop
+static double motorGain = MOTOR_GAIN;
+
+/**
+ * \brief Run the main loop with the motor model
+ *
+ * \param time The time to run (ms)
+ * \return The max error (pulses/s) in the last half of the time
+ */
+static double run(unsigned long time) {
+  unsigned long j;
+  double dt, error, maxError;
+
+  dt = STEP_TIME / 1000000.0;
+  maxError = 0;
+  for(j = 0; j < time; j++) {
+    simAdvance(STEP_TIME);
+    // First order response to the duty cycle applied by the chip
+    motorSpeed += (motorGain * simTle.pwmDC[Tle94112::TLE_PWM1] - motorSpeed) * dt / MOTOR_TAU;
+    pulseFraction += motorSpeed * dt;
+    while(pulseFraction >= 1) {
+      simPulse(TACH_PIN);
+      pulseFraction -= 1;
+    }
+    speed.update(motor);
+
+    error = motorSpeed - speed.loops[0].target;
+    if( (j >= time / 2) && (fabs(error) > maxError) )
+      maxError = fabs(error);
+  }
+  return maxError;
+}
+
+int main(void) {
+  unsigned long writes;
+  double error;
+
+  motor.begin();
+  motor.internalStatus[0].isEnabled = true;
+  motor.internalStatus[0].channelPWM = PWM1_CHID;
+  motor.dutyCyclePWM[0].useRamp = false;
+  motor.dutyCyclePWM[0].maxDC = 50;
+  motor.startMotors();
+
+  speed.begin();
+  simCheck(!speed.attach(0, 4), "pin without interrupt refused");
+  simCheck(speed.attach(0, TACH_PIN), "tachometer attached");
+  simCheck(speed.setTarget(0, TARGET_SPEED), "target set");
+
+  error = run(3000);
+  simCheck(error < SPEED_TOLERANCE, "target speed reached");
+  simCheck(abs((int)speed.loops[0].speed - TARGET_SPEED) < 2 * SPEED_TOLERANCE, "speed measured");
+  simCheck(speed.lateTicks == 0, "no late control ticks");
+
+  // The duty cycle follows a supply drop
+  motorGain = MOTOR_GAIN * 0.75;
+  error = run(3000);
+  simCheck(error < SPEED_TOLERANCE, "target speed kept after a supply drop");
+  simCheck(simTle.pwmDC[Tle94112::TLE_PWM1] > TARGET_SPEED / MOTOR_GAIN, "duty cycle increased");
+
+  // The integral doesn't wind up while saturated
+  speed.setTarget(0, 2000);
+  run(2000);
+  simCheck(simTle.pwmDC[Tle94112::TLE_PWM1] == DUTYCYCLE_MAX, "duty cycle saturated");
+  speed.setTarget(0, TARGET_SPEED);
+  error = run(2000);
+  simCheck(error < SPEED_TOLERANCE, "target speed reached after the saturation");
+
+  // Open loop: the duty cycle is not written any more
+  speed.setTarget(0, 0);
+  run(100);
+  writes = simTle.pwmWrites;
+  run(1000);
+  simCheck(simTle.pwmWrites == writes, "no writes in open loop");
+
+  return simReport();
+}
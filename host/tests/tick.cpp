@@ -0,0 +1,116 @@
+/**
+ *  \file tick.cpp
+ *  \brief Check of the control tick with the timer 2 emulated on the
+ *  virtual clock of the host simulation:
+ *
+ *      g++ -std=gnu++11 -Ihost/sim -I. -o tick host/tests/tick.cpp controltick.cpp \
+ *          motorcontrol.cpp trace.cpp host/sim/sim.cpp
+ *      ./tick
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "sim.h"
+#include "motorcontrol.h"
+#include "controltick.h"
+
+#define LOOP_TIME 200       ///< Time (us) of a main loop
+#define RAMP_MAX_DC 100     ///< Duty cycle at the end of the checked ramp
+
+MotorControl motor;
+
+/**
+ * \brief Run the main loop, executing the due ticks
+ *
+ * \param time The time (us) to run
+ * \return The number of executed ticks
+ */
+static unsigned long runLoop(unsigned long time) {
+  unsigned long start, executed;
+
+  executed = 0;
+  start = simTime();
+  while((simTime() - start) < time) {
+    simAdvance(LOOP_TIME);
+    if(controlTick.due())
+      executed++;
+  }
+  return executed;
+}
+
+/**
+ * \brief Duration of the acceleration ramp of the motor 1
+ *
+ * \param transferTime Time (us) of every TLE94112 SPI access
+ * \return The ramp duration (us)
+ */
+static unsigned long rampTime(unsigned int transferTime) {
+  unsigned long start;
+
+  simTle.transferTime = transferTime;
+  start = simTime();
+  motor.startMotors();
+  start = simTime() - start;
+  motor.stopMotors();
+  simTle.transferTime = 0;
+  return start;
+}
+
+int main(void) {
+  unsigned long ticks, executed, time;
+
+  controlTick.begin();
+
+  // The period is set by the timer 2 registers
+  ticks = controlTick.ticks();
+  simAdvance(10 * TICK_PERIOD);
+  simCheck((controlTick.ticks() - ticks) == 10, "one tick every TICK_PERIOD us");
+
+  // A loop faster than the tick executes every tick once
+  controlTick.due();
+  controlTick.resetStats();
+  executed = runLoop(100 * TICK_PERIOD);
+  simCheck((executed >= 99) && (executed <= 101) && (controlTick.serviced == executed),
+           "every tick executed by a fast loop");
+  simCheck(controlTick.overruns == 0, "no overruns with a fast loop");
+  simCheck(controlTick.maxLatency <= LOOP_TIME + 2 * SIM_CALL_TIME, "latency within a loop time");
+  simCheck(controlTick.maxJitter <= LOOP_TIME + 2 * SIM_CALL_TIME, "jitter within a loop time");
+
+  // A loop busy for 3.5 periods loses the ticks elapsed in between
+  controlTick.due();
+  controlTick.resetStats();
+  simAdvance(TICK_PERIOD * 7 / 2);
+  controlTick.due();
+  simCheck(controlTick.overruns == 2, "lost ticks counted as overruns");
+
+  // No ticks while suspended, no overruns after the resume
+  controlTick.suspend();
+  ticks = controlTick.ticks();
+  simAdvance(50 * TICK_PERIOD);
+  simCheck(controlTick.ticks() == ticks, "no ticks while suspended");
+  controlTick.resume();
+  controlTick.resetStats();
+  runLoop(10 * TICK_PERIOD);
+  simCheck(controlTick.overruns == 0, "no overruns after the resume");
+
+  // The ramp steps are aligned to the tick, the SPI transfers are part of the step
+  motor.begin();
+  motor.internalStatus[0].isEnabled = true;
+  motor.internalStatus[0].channelPWM = PWM1_CHID;
+  motor.dutyCyclePWM[0].useRamp = true;
+  motor.dutyCyclePWM[0].minDC = 0;
+  motor.dutyCyclePWM[0].maxDC = RAMP_MAX_DC;
+  time = (unsigned long)RAMP_MAX_DC * RAMP_STEP_DELAY * TICK_PERIOD;
+  executed = rampTime(0);
+  simCheck((executed >= time - TICK_PERIOD) && (executed <= time + TICK_PERIOD),
+           "ramp of RAMP_STEP_DELAY ticks every step");
+  executed = rampTime(300);
+  simCheck((executed >= time - TICK_PERIOD) && (executed <= time + TICK_PERIOD),
+           "ramp time not changed by the SPI transfers");
+
+  return simReport();
+}
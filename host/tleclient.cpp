@@ -0,0 +1,922 @@
+/**
+ *  \file tleclient.cpp
+ *  \brief This file defines functions and predefined instances from tleclient.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "tleclient.h"
+
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+//! Reply keywords of the firmware
+static const char* replies[] = {
+  // "setting " should be checked before "set "
+  CMD_SET,
+  CMD_MODE,
+  CMD_EXEC,
+  CMD_DONE,
+  CMD_DIRECTION,
+  CMD_PWM,
+  CMD_WRONGCMD,
+  CMD_NOCMD,
+  CMD_NOCONFIG,
+  CMD_NOPROFILE,
+  CMD_BADSEQUENCE,
+  CMD_NOMOVE,
+  CMD_BATCH,
+};
+
+//! Fault classes and reactions names, in the firmware order
+static const char* faultNames[FAULT_CLASSES] = {
+  FAULT_NAME_SPI, FAULT_NAME_LOAD, FAULT_NAME_UV, FAULT_NAME_OV,
+  FAULT_NAME_POR, FAULT_NAME_TSD, FAULT_NAME_TW };
+static const char* faultActions[FAULT_ACTIONS] = {
+  FAULT_ACTION_IGNORE, FAULT_ACTION_LOG, FAULT_ACTION_DERATE,
+  FAULT_ACTION_STOP, FAULT_ACTION_STOPALL, FAULT_ACTION_RETRY };
+
+//! Keyword of a command event index, see COMMAND_KEYWORDS
+static std::string commandKeyword(uint8_t index) {
+  const char* keyword;
+  size_t length;
+
+  keyword = COMMAND_KEYWORDS;
+  while(index-- > 0) {
+    keyword = strchr(keyword, ' ');
+    if(keyword == NULL)
+      return "?";
+    keyword++;
+  }
+  length = strcspn(keyword, " ");
+  return std::string(keyword, length);
+}
+
+//! Current time (us) of a monotonic clock
+static uint64_t clockMicros(void) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! Remove the spaces and the quotes around a string
+static std::string trim(const std::string &s) {
+  size_t first, last;
+
+  first = s.find_first_not_of(" '\r");
+  if(first == std::string::npos)
+    return std::string();
+  last = s.find_last_not_of(" '\r");
+  return s.substr(first, last - first + 1);
+}
+
+// ===============================================================
+// Flight recorder dump
+// ===============================================================
+
+bool tleDecodeTrace(const std::string &line, TleTraceEvent &event) {
+  std::string text;
+  size_t j;
+  int k;
+
+  text = trim(line);
+  if(text.size() != TLE_TRACE_LINE_SIZE)
+    return false;
+  for(j = 0; j < text.size(); j++) {
+    if( (j != 8) && !isxdigit((unsigned char)text[j]) )
+      return false;
+  }
+
+  event.time = strtoul(text.substr(0, 8).c_str(), NULL, 16);
+  event.type = text[8];
+  for(k = 0; k < 3; k++) {
+    event.data[k] = (uint8_t)strtoul(text.substr(9 + k * 2, 2).c_str(), NULL, 16);
+  }
+  return true;
+}
+
+std::vector<std::string> tleTraceTimeline(const std::vector<std::string> &dump) {
+  std::vector<std::string> timeline;
+  TleTraceEvent event;
+  uint32_t start;
+  char time[16], text[64];
+  size_t j;
+
+  start = 0;
+  for(j = 0; j < dump.size(); j++) {
+    if(!tleDecodeTrace(dump[j], event))
+      continue;
+    if(timeline.empty())
+      start = event.time;
+
+    switch(event.type) {
+      case 'H':
+        snprintf(text, sizeof(text), "configHB hb %u state %u pwm %u fw %u", event.data[0],
+                 event.data[1], event.data[2] & 0x0f, event.data[2] >> 4);
+      break;
+      case 'P':
+        snprintf(text, sizeof(text), "configPWM channel %u frequency %u dc %u", event.data[0],
+                 event.data[1], event.data[2]);
+      break;
+      case 'D':
+        snprintf(text, sizeof(text), "diagnostic status 0x%02X", event.data[0]);
+      break;
+      case 'F':
+        snprintf(text, sizeof(text), "fault %s reaction %s",
+                 (event.data[0] < FAULT_CLASSES) ? faultNames[event.data[0]] : "?",
+                 (event.data[1] < FAULT_ACTIONS) ? faultActions[event.data[1]] : "?");
+      break;
+      case 'C':
+        // The argument is shown if not 0
+        snprintf(text, sizeof(text), "command %s",
+                 (event.data[0] == COMMAND_UNKNOWN) ? "unknown" : commandKeyword(event.data[0]).c_str());
+        if(event.data[1] | event.data[2])
+          snprintf(text + strlen(text), sizeof(text) - strlen(text), " %u",
+                   event.data[1] | (event.data[2] << 8));
+      break;
+      case 'Z':
+        strcpy(text, event.data[0] ? "frozen by a fault" : "frozen");
+      break;
+      default:
+        snprintf(text, sizeof(text), "event %c %02X %02X %02X", event.type, event.data[0],
+                 event.data[1], event.data[2]);
+      break;
+    }
+    snprintf(time, sizeof(time), "+%u ms ", (unsigned int)(event.time - start));
+    timeline.push_back(std::string(time) + text);
+  }
+
+  return timeline;
+}
+
+// ===============================================================
+// Station
+// ===============================================================
+
+TleStation::TleStation(TleClient &owner, const std::string &port, int descriptor) :
+  path(port), client(owner), fd(descriptor), nextSequence(0), pendingBytes(0),
+  discardedFrames(0) {
+}
+
+TleStation::~TleStation() {
+  close();
+}
+
+std::future<TleReply> TleStation::submit(const std::string &command) {
+  Request* request;
+  std::future<TleReply> future;
+
+  request = new Request;
+  request->reply.command = command;
+  request->reply.ok = false;
+  request->reply.receiveTime = request->reply.dispatchTime = request->reply.appliedTime = 0;
+  request->reply.roundTrip = 0;
+  future = request->promise.get_future();
+
+  {
+    std::lock_guard<std::recursive_mutex> guard(client.lock);
+    request->reply.sequence = nextSequence++;
+    if(fd < 0) {
+      complete(request, false);
+      return future;
+    }
+    queued.push_back(request);
+  }
+  client.wake();
+
+  return future;
+}
+
+void TleStation::onTelemetry(std::function<void(const TleTelemetry&)> callback) {
+  std::lock_guard<std::recursive_mutex> guard(client.lock);
+  telemetryCallback = callback;
+}
+
+void TleStation::onMessage(std::function<void(const std::string&)> callback) {
+  std::lock_guard<std::recursive_mutex> guard(client.lock);
+  messageCallback = callback;
+}
+
+unsigned long TleStation::badFrames(void) {
+  std::lock_guard<std::recursive_mutex> guard(client.lock);
+  return discardedFrames;
+}
+
+void TleStation::transmit(void) {
+  Request* request;
+  std::string data;
+
+  // The firmware receive buffer can't hold more than a few commands
+  // while the main loop is busy, e.g. during the acceleration
+  while(!queued.empty()) {
+    request = queued.front();
+    data = CMD_TAG + std::to_string(request->reply.sequence & COMMAND_TAG_MAX) + " " +
+           request->reply.command + "\n";
+    if( !pending.empty() && ((pendingBytes + data.size()) > TLE_RX_WINDOW) )
+      break;
+    if(write(fd, data.data(), data.size()) != (ssize_t)data.size()) {
+      close();
+      return;
+    }
+    queued.pop_front();
+    request->size = data.size();
+    request->sentTime = clockMicros();
+    pending.push_back(request);
+    pendingBytes += data.size();
+  }
+}
+
+void TleStation::receive(const uint8_t* data, size_t size) {
+  size_t j;
+
+  for(j = 0; j < size; j++) {
+    if(!frame.empty()) {
+      frame.push_back(data[j]);
+      // The sync bytes and the length are checked as soon as received
+      if( ((frame.size() == 2) && (data[j] != TLE_TELEMETRY_SYNC2)) ||
+          ((frame.size() == 3) && (data[j] != TLE_TELEMETRY_SIZE)) ) {
+        discardedFrames++;
+        frame.clear();
+      }
+      else if(frame.size() == TLE_TELEMETRY_SIZE) {
+        receiveFrame();
+        frame.clear();
+      }
+    }
+    // The text is ASCII, the first sync byte always starts a frame
+    else if(data[j] == TLE_TELEMETRY_SYNC1) {
+      frame.push_back(data[j]);
+    }
+    else if(data[j] == '\n') {
+      receiveLine();
+      line.clear();
+    }
+    else {
+      line += (char)data[j];
+    }
+  }
+}
+
+void TleStation::receiveLine(void) {
+  std::string text;
+  size_t j;
+
+  text = trim(line);
+  if(text.empty())
+    return;
+
+  if(text.compare(0, strlen(CMD_TAG), CMD_TAG) == 0) {
+    receiveTag(text);
+    return;
+  }
+
+  // The firmware executes the commands in order, the lines before a tag
+  // belong to the tagged command
+  if(pending.empty()) {
+    if(messageCallback)
+      messageCallback(text);
+    return;
+  }
+
+  for(j = 0; j < sizeof(replies) / sizeof(replies[0]); j++) {
+    if(line.compare(0, strlen(replies[j]), replies[j]) == 0)
+      break;
+  }
+  if(j < sizeof(replies) / sizeof(replies[0])) {
+    // The last reply keyword, e.g. done after the reset
+    replyStatus = trim(replies[j]);
+    // The batch reply has the status of every command instead of the line
+    if(replyStatus == trim(CMD_BATCH))
+      replyLines.push_back(trim(line.substr(strlen(CMD_BATCH))));
+    return;
+  }
+
+  replyLines.push_back(text);
+}
+
+void TleStation::receiveTag(const std::string &text) {
+  unsigned long tag, times[3];
+  std::string result;
+  size_t j, k;
+  char* end;
+  const char* p;
+
+  // #tag done|failed received dispatched applied
+  p = text.c_str() + strlen(CMD_TAG);
+  tag = strtoul(p, &end, 10);
+  p = end;
+  if(strncmp(p, CMD_TAG_DONE, strlen(CMD_TAG_DONE)) == 0)
+    result = CMD_TAG_DONE;
+  else if(strncmp(p, CMD_TAG_FAILED, strlen(CMD_TAG_FAILED)) == 0)
+    result = CMD_TAG_FAILED;
+  p += result.size();
+  for(j = 0; (j < 3) && !result.empty(); j++) {
+    times[j] = strtoul(p, &end, 10);
+    if(end == p)
+      result.clear();
+    p = end;
+  }
+
+  for(k = 0; k < pending.size(); k++) {
+    if((pending[k]->reply.sequence & COMMAND_TAG_MAX) == tag)
+      break;
+  }
+  if(result.empty() || (k == pending.size())) {
+    if(messageCallback)
+      messageCallback(text);
+    return;
+  }
+
+  // The commands sent before have been lost, e.g. a receive buffer overflow
+  completeBefore(k);
+  pendingBytes -= pending.front()->size;
+  pending.front()->reply.status = replyStatus;
+  pending.front()->reply.lines.swap(replyLines);
+  replyStatus.clear();
+  replyLines.clear();
+  pending.front()->reply.receiveTime = times[0];
+  pending.front()->reply.dispatchTime = times[1];
+  pending.front()->reply.appliedTime = times[2];
+  pending.front()->reply.roundTrip = clockMicros() - pending.front()->sentTime;
+  complete(pending.front(), result == CMD_TAG_DONE);
+  pending.pop_front();
+}
+
+void TleStation::receiveFrame(void) {
+  TleTelemetry telemetry;
+  uint8_t checksum;
+  size_t j, k;
+
+  checksum = 0;
+  for(j = 0; j < (TLE_TELEMETRY_SIZE - 1); j++) {
+    checksum ^= frame[j];
+  }
+  if(checksum != frame[TLE_TELEMETRY_SIZE - 1]) {
+    discardedFrames++;
+    return;
+  }
+
+  // Little endian fields, as documented in telemetry.h
+  j = 3;
+  telemetry.sequence = frame[j++];
+  telemetry.time = 0;
+  for(k = 0; k < 4; k++) {
+    telemetry.time |= (uint32_t)frame[j++] << (k * 8);
+  }
+  for(k = 0; k < MAX_MOTORS; k++) {
+    telemetry.motors[k] = frame[j++];
+  }
+  for(k = 0; k < AVAIL_PWM_CHANNELS; k++) {
+    telemetry.channelDC[k] = frame[j++];
+  }
+  for(k = 0; k < AVAIL_PWM_CHANNELS; k++) {
+    telemetry.appliedDC[k] = frame[j++];
+  }
+  telemetry.derate = frame[j++];
+  telemetry.budget = frame[j++];
+  telemetry.diagnostic = frame[j++];
+  telemetry.loopTime = frame[j] | (frame[j + 1] << 8);
+  j += 2;
+  telemetry.maxLoopTime = frame[j] | (frame[j + 1] << 8);
+  j += 2;
+  telemetry.droppedFrames = frame[j] | (frame[j + 1] << 8);
+
+  if(telemetryCallback)
+    telemetryCallback(telemetry);
+}
+
+void TleStation::complete(Request* request, bool ok) {
+  request->reply.ok = ok;
+  request->promise.set_value(request->reply);
+  delete request;
+}
+
+void TleStation::completeBefore(size_t index) {
+  while(index-- > 0) {
+    pendingBytes -= pending.front()->size;
+    complete(pending.front(), false);
+    pending.pop_front();
+  }
+}
+
+void TleStation::expire(void) {
+  uint64_t now;
+  size_t k;
+
+  now = clockMicros();
+  // The oldest command without reply in time and the commands before it
+  for(k = pending.size(); k > 0; k--) {
+    if((now - pending[k - 1]->sentTime) >= (uint64_t)TLE_REPLY_TIMEOUT * 1000)
+      break;
+  }
+  completeBefore(k);
+}
+
+std::future<TleReply> TleStation::reject(const std::string &command) {
+  std::promise<TleReply> promise;
+  TleReply reply;
+
+  reply.sequence = 0;
+  reply.command = command;
+  reply.ok = false;
+  reply.receiveTime = reply.dispatchTime = reply.appliedTime = 0;
+  reply.roundTrip = 0;
+  promise.set_value(reply);
+  return promise.get_future();
+}
+
+void TleStation::close(void) {
+  if(fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  while(!pending.empty()) {
+    complete(pending.front(), false);
+    pending.pop_front();
+  }
+  while(!queued.empty()) {
+    complete(queued.front(), false);
+    queued.pop_front();
+  }
+  pendingBytes = 0;
+}
+
+// ===============================================================
+// Typed commands
+// ===============================================================
+
+std::future<TleReply> TleStation::batch(const std::vector<std::string> &commands) {
+  std::string command;
+  size_t j;
+
+  for(j = 0; j < commands.size(); j++) {
+    if(j > 0)
+      command += BATCH_SEPARATOR;
+    command += commands[j];
+  }
+  return submit(command);
+}
+
+std::future<TleReply> TleStation::selectMotor(int motor) {
+  return submit(std::string("m") + std::to_string(motor));
+}
+
+std::future<TleReply> TleStation::enableMotor(int motor) {
+  return submit(std::string("m") + std::to_string(motor) + "+");
+}
+
+std::future<TleReply> TleStation::selectAll(void) {
+  return submit(MOTOR_ALL);
+}
+
+std::future<TleReply> TleStation::selectNone(void) {
+  return submit(MOTOR_NONE);
+}
+
+std::future<TleReply> TleStation::start(void) {
+  return submit(MOTOR_START);
+}
+
+std::future<TleReply> TleStation::stop(void) {
+  return submit(MOTOR_STOP);
+}
+
+std::future<TleReply> TleStation::reset(void) {
+  return submit(MOTOR_RESET);
+}
+
+std::future<TleReply> TleStation::direction(bool clockwise) {
+  return submit(clockwise ? DIRECTION_CW : DIRECTION_CCW);
+}
+
+std::future<TleReply> TleStation::pwmChannel(int channel) {
+  static const char* const names[AVAIL_PWM_CHANNELS + 1] = { PWM_0, PWM_80, PWM_100, PWM_200 };
+
+  return submit(names[(channel >= 0) && (channel <= AVAIL_PWM_CHANNELS) ? channel : 0]);
+}
+
+std::future<TleReply> TleStation::freeWheeling(bool active) {
+  return submit(active ? FW_ACTIVE : FW_PASSIVE);
+}
+
+std::future<TleReply> TleStation::stopMode(uint8_t mode, uint16_t brakeTime) {
+  if(mode == STOP_COAST)
+    return submit(STOP_MODE_COAST);
+  if(mode == STOP_BRAKE)
+    return submit(STOP_MODE_BRAKE);
+  // brake0 would float the poles without braking
+  if(brakeTime == 0)
+    return reject(std::string(STOP_MODE_BRAKE) + std::to_string(brakeTime));
+  return submit(std::string(STOP_MODE_BRAKE) + std::to_string(brakeTime));
+}
+
+std::future<TleReply> TleStation::motorDC(uint8_t dc) {
+  return submit(std::string(MOTOR_DC) + std::to_string(dc));
+}
+
+std::future<TleReply> TleStation::layoutStandard(void) {
+  return submit(HB_STANDARD);
+}
+
+std::future<TleReply> TleStation::layoutHighCurrent(void) {
+  return submit(HB_HIGHCURRENT);
+}
+
+std::future<TleReply> TleStation::layoutRemove(void) {
+  return submit(HB_REMOVE);
+}
+
+std::future<TleReply> TleStation::layout(const std::string &halfBridges) {
+  return submit(std::string(HB_LAYOUT) + halfBridges);
+}
+
+std::future<TleReply> TleStation::dcChannel(int channel) {
+  static const char* const names[AVAIL_PWM_CHANNELS + 1] = { PWMALL_DC, PWM80_DC, PWM100_DC, PWM200_DC };
+
+  return submit(names[(channel >= 0) && (channel <= AVAIL_PWM_CHANNELS) ? channel : 0]);
+}
+
+std::future<TleReply> TleStation::dcManual(void) {
+  return submit(MANUAL_DC);
+}
+
+std::future<TleReply> TleStation::dcAuto(void) {
+  return submit(AUTO_DC);
+}
+
+std::future<TleReply> TleStation::dcMin(void) {
+  return submit(MIN_DC);
+}
+
+std::future<TleReply> TleStation::dcMax(void) {
+  return submit(MAX_DC);
+}
+
+std::future<TleReply> TleStation::ramp(bool enable) {
+  return submit(enable ? PWM_RAMP : PWM_NORAMP);
+}
+
+std::future<TleReply> TleStation::frequency(unsigned int hz) {
+  return submit(std::string(PWM_FREQUENCY) + std::to_string(hz));
+}
+
+std::future<TleReply> TleStation::faultReaction(const std::string &fault, const std::string &action,
+                                                unsigned int retryDelay) {
+  std::string command;
+
+  command = std::string(FAULT_SET) + fault + "=" + action;
+  if(action == FAULT_ACTION_RETRY)
+    command += std::to_string(retryDelay);
+  return submit(command);
+}
+
+std::future<TleReply> TleStation::faultFilter(const std::string &fault, unsigned int samples,
+                                              unsigned int rampWindow, unsigned int rateLimit) {
+  return submit(std::string(FAULT_FILTER) + fault + "=" + std::to_string(samples) +
+                VALUES_SEPARATOR + std::to_string(rampWindow) +
+                VALUES_SEPARATOR + std::to_string(rateLimit));
+}
+
+std::future<TleReply> TleStation::faultDefault(void) {
+  return submit(FAULT_DEFAULT);
+}
+
+std::future<TleReply> TleStation::telemetry(bool enable) {
+  return submit(enable ? TELEMETRY_ON : TELEMETRY_OFF);
+}
+
+std::future<TleReply> TleStation::telemetryRate(unsigned int ms) {
+  return submit(std::string(TELEMETRY_RATE) + std::to_string(ms));
+}
+
+std::future<TleReply> TleStation::traceDump(void) {
+  return submit(TRACE_DUMP);
+}
+
+std::future<TleReply> TleStation::traceClear(void) {
+  return submit(TRACE_CLEAR);
+}
+
+std::future<TleReply> TleStation::traceStop(void) {
+  return submit(TRACE_STOP);
+}
+
+std::future<TleReply> TleStation::tachometer(int pin) {
+  if(pin < 0)
+    return submit(SPEED_NOTACH);
+  return submit(std::string(SPEED_TACH) + std::to_string(pin));
+}
+
+std::future<TleReply> TleStation::speed(unsigned int target) {
+  return submit(std::string(SPEED_TARGET) + std::to_string(target));
+}
+
+std::future<TleReply> TleStation::gains(unsigned int kp, unsigned int ki) {
+  std::shared_future<TleReply> kpReply, kiReply;
+
+  kpReply = submit(std::string(SPEED_KP_GAIN) + std::to_string(kp)).share();
+  kiReply = submit(std::string(SPEED_KI_GAIN) + std::to_string(ki)).share();
+
+  // The ki reply, with the lines of both and failed if any has failed
+  return std::async(std::launch::async, [kpReply, kiReply]() {
+    TleReply reply;
+
+    reply = kiReply.get();
+    reply.command = kpReply.get().command + BATCH_SEPARATOR + reply.command;
+    reply.ok = kpReply.get().ok && reply.ok;
+    if(!kpReply.get().ok)
+      reply.status = kpReply.get().status;
+    reply.lines.insert(reply.lines.begin(), kpReply.get().lines.begin(), kpReply.get().lines.end());
+    return reply;
+  });
+}
+
+std::future<TleReply> TleStation::sequenceAppend(const std::vector<uint8_t> &program) {
+  static const char digits[] = "0123456789ABCDEF";
+  std::string command;
+  size_t j;
+
+  command = SEQUENCE_APPEND;
+  for(j = 0; j < program.size(); j++) {
+    command += digits[program[j] >> 4];
+    command += digits[program[j] & 0x0f];
+  }
+  return submit(command);
+}
+
+std::future<TleReply> TleStation::sequenceClear(void) {
+  return submit(SEQUENCE_CLEAR);
+}
+
+std::future<TleReply> TleStation::sequenceRun(void) {
+  return submit(SEQUENCE_RUN);
+}
+
+std::future<TleReply> TleStation::sequenceStop(void) {
+  return submit(SEQUENCE_STOP);
+}
+
+std::future<TleReply> TleStation::runTime(unsigned int ms) {
+  return submit(std::string(MOVE_TIME) + std::to_string(ms));
+}
+
+std::future<TleReply> TleStation::runBudget(unsigned int ms) {
+  return submit(std::string(MOVE_BUDGET) + std::to_string(ms));
+}
+
+std::future<TleReply> TleStation::dither(unsigned int setpoint) {
+  return submit(std::string(DITHER_SET) + std::to_string(setpoint));
+}
+
+std::future<TleReply> TleStation::ditherOff(void) {
+  return submit(DITHER_OFF);
+}
+
+std::future<TleReply> TleStation::ditherPeriod(unsigned int ticks) {
+  return submit(std::string(DITHER_PERIOD) + std::to_string(ticks));
+}
+
+std::future<TleReply> TleStation::waveform(const std::string &shape, unsigned int amplitude,
+                                           unsigned int offset, unsigned int period, unsigned int phase) {
+  return submit(std::string(WAVE_SET) + shape + "=" + std::to_string(amplitude) +
+                VALUES_SEPARATOR + std::to_string(offset) + VALUES_SEPARATOR +
+                std::to_string(period) + VALUES_SEPARATOR + std::to_string(phase));
+}
+
+std::future<TleReply> TleStation::waveOff(void) {
+  return submit(WAVE_OFF);
+}
+
+std::future<TleReply> TleStation::soakCycle(unsigned int run, unsigned int rest,
+                                            unsigned long cycles, unsigned int report) {
+  return submit(std::string(SOAK_SET) + std::to_string(run) + VALUES_SEPARATOR +
+                std::to_string(rest) + VALUES_SEPARATOR + std::to_string(cycles) +
+                VALUES_SEPARATOR + std::to_string(report));
+}
+
+std::future<TleReply> TleStation::soakStart(void) {
+  return submit(SOAK_START);
+}
+
+std::future<TleReply> TleStation::soakStop(void) {
+  return submit(SOAK_STOP);
+}
+
+std::future<TleReply> TleStation::powerBudget(unsigned int budget) {
+  return submit(std::string(POWER_BUDGET) + std::to_string(budget));
+}
+
+std::future<TleReply> TleStation::powerWeight(unsigned int weight) {
+  return submit(std::string(POWER_WEIGHT) + std::to_string(weight));
+}
+
+std::future<TleReply> TleStation::idleTime(unsigned int s) {
+  return submit(std::string(IDLE_TIME) + std::to_string(s));
+}
+
+std::future<TleReply> TleStation::tickReset(void) {
+  return submit(TICK_RESET);
+}
+
+std::future<TleReply> TleStation::save(void) {
+  return submit(CONFIG_SAVE);
+}
+
+std::future<TleReply> TleStation::load(void) {
+  return submit(CONFIG_LOAD);
+}
+
+std::future<TleReply> TleStation::autoStart(bool enable) {
+  return submit(enable ? CONFIG_AUTOSTART : CONFIG_NOAUTOSTART);
+}
+
+std::future<TleReply> TleStation::profileSave(int number, const std::string &name) {
+  return submit(std::string(PROFILE_SAVE) + std::to_string(number) + "-" + name);
+}
+
+std::future<TleReply> TleStation::profileSelect(const std::string &profile) {
+  return submit(std::string(PROFILE_SELECT) + profile);
+}
+
+std::future<TleReply> TleStation::showConf(void) {
+  return submit(SHOW_CONF);
+}
+
+std::future<TleReply> TleStation::dcInfo(void) {
+  return submit(INFO_DC);
+}
+
+std::future<TleReply> TleStation::motorDCInfo(void) {
+  return submit(MOTOR_DC_INFO);
+}
+
+std::future<TleReply> TleStation::faultInfo(void) {
+  return submit(FAULT_INFO);
+}
+
+std::future<TleReply> TleStation::telemetryInfo(void) {
+  return submit(TELEMETRY_INFO);
+}
+
+std::future<TleReply> TleStation::speedInfo(void) {
+  return submit(SPEED_INFO);
+}
+
+std::future<TleReply> TleStation::sequenceInfo(void) {
+  return submit(SEQUENCE_INFO);
+}
+
+std::future<TleReply> TleStation::moveInfo(void) {
+  return submit(MOVE_INFO);
+}
+
+std::future<TleReply> TleStation::idleInfo(void) {
+  return submit(IDLE_INFO);
+}
+
+std::future<TleReply> TleStation::ditherInfo(void) {
+  return submit(DITHER_INFO);
+}
+
+std::future<TleReply> TleStation::waveInfo(void) {
+  return submit(WAVE_INFO);
+}
+
+std::future<TleReply> TleStation::soakInfo(void) {
+  return submit(SOAK_INFO);
+}
+
+std::future<TleReply> TleStation::powerInfo(void) {
+  return submit(POWER_INFO);
+}
+
+std::future<TleReply> TleStation::tickInfo(void) {
+  return submit(TICK_INFO);
+}
+
+std::future<TleReply> TleStation::profileList(void) {
+  return submit(PROFILE_LIST);
+}
+
+// ===============================================================
+// Client
+// ===============================================================
+
+TleClient::TleClient() : running(true) {
+  if(pipe(wakePipe) == 0) {
+    fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+  }
+  thread = std::thread(&TleClient::run, this);
+}
+
+TleClient::~TleClient() {
+  size_t j;
+
+  {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    running = false;
+  }
+  wake();
+  thread.join();
+
+  for(j = 0; j < stations.size(); j++) {
+    delete stations[j];
+  }
+  ::close(wakePipe[0]);
+  ::close(wakePipe[1]);
+}
+
+TleStation* TleClient::open(const std::string &path) {
+  struct termios settings;
+  TleStation* station;
+  int fd;
+
+  fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if(fd < 0)
+    return NULL;
+
+  // Raw 8N1, the terminal settings are not needed by a pseudo terminal
+  if(tcgetattr(fd, &settings) == 0) {
+    cfmakeraw(&settings);
+    cfsetispeed(&settings, B38400);
+    cfsetospeed(&settings, B38400);
+    settings.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &settings);
+  }
+
+  station = new TleStation(*this, path, fd);
+  {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    stations.push_back(station);
+  }
+  wake();
+
+  return station;
+}
+
+void TleClient::wake(void) {
+  char c = 0;
+
+  if(write(wakePipe[1], &c, 1) < 0) {
+    // The pipe is full, the thread is already waking up
+  }
+}
+
+void TleClient::run(void) {
+  std::vector<struct pollfd> fds;
+  std::vector<TleStation*> polled;
+  uint8_t buffer[256];
+  struct pollfd wakeFd;
+  ssize_t size;
+  size_t j;
+
+  wakeFd.fd = wakePipe[0];
+  wakeFd.events = POLLIN;
+
+  while(true) {
+    {
+      std::lock_guard<std::recursive_mutex> guard(lock);
+      if(!running)
+        break;
+      fds.assign(1, wakeFd);
+      polled.clear();
+      for(j = 0; j < stations.size(); j++) {
+        if(stations[j]->fd < 0)
+          continue;
+        stations[j]->transmit();
+        stations[j]->expire();
+        if(stations[j]->fd < 0)
+          continue;
+        fds.push_back({ stations[j]->fd, POLLIN, 0 });
+        polled.push_back(stations[j]);
+      }
+    }
+
+    // The timeout checks the commands without reply
+    poll(fds.data(), fds.size(), TLE_POLL_TIME);
+
+    if(fds[0].revents & POLLIN) {
+      while(read(wakePipe[0], buffer, sizeof(buffer)) > 0)
+        ;
+    }
+
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    for(j = 0; j < polled.size(); j++) {
+      if(fds[j + 1].revents & POLLIN) {
+        size = read(polled[j]->fd, buffer, sizeof(buffer));
+        if(size > 0)
+          polled[j]->receive(buffer, size);
+      }
+      if(fds[j + 1].revents & (POLLERR | POLLHUP | POLLNVAL))
+        polled[j]->close();
+    }
+  }
+}
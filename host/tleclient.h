@@ -0,0 +1,352 @@
+/**
+ *  \file tleclient.h
+ *  \brief Host library to control many TLE94112LE stations on the serial ports
+ *
+ *  The library is built on Linux (POSIX serial ports and C++11 threads),
+ *  not by the Arduino IDE:
+ *
+ *      g++ -std=c++11 -pthread -c host/tleclient.cpp
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _TLECLIENT
+#define _TLECLIENT
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The command keywords and the limits are shared with the firmware
+#include "../commands.h"
+#include "../motor.h"
+
+#define TLE_BAUD_RATE 38400       ///< Serial speed of the firmware
+#define TLE_RX_WINDOW 48          ///< Max command bytes sent and not yet acknowledged
+#define TLE_REPLY_TIMEOUT 5000    ///< Time (ms) after which a command without reply is lost
+#define TLE_POLL_TIME 50          ///< Max time (ms) between the checks of the reply timeout
+#define TLE_TELEMETRY_SIZE 30     ///< Telemetry frame size, as TELEMETRY_FRAME_SIZE in telemetry.h
+#define TLE_TELEMETRY_SYNC1 0xAA  ///< First frame synchronisation byte
+#define TLE_TELEMETRY_SYNC2 0x55  ///< Second frame synchronisation byte
+#define TLE_TRACE_LINE_SIZE 15    ///< Trace dump line size, see TraceRecorder::dump() in trace.h
+
+/**
+ * Reply of the firmware to a command
+ */
+struct TleReply {
+  uint32_t sequence;                ///< Sequence number assigned by the station
+  std::string command;              ///< Command line sent
+  std::string status;               ///< Last reply keyword (e.g. CMD_SET), empty if the command has no reply
+  bool ok;                          ///< false if the command has failed, has been lost or the port is closed
+  std::vector<std::string> lines;   ///< Other lines printed by the command, e.g. the info tables
+  uint32_t receiveTime;             ///< Firmware time (us) when the command line has been received
+  uint32_t dispatchTime;            ///< Firmware time (us) when the execution has started
+  uint32_t appliedTime;             ///< Firmware time (us) when the execution has been completed
+  uint32_t roundTrip;               ///< Host time (us) from the transmission to the reply
+};
+
+/**
+ * Decoded telemetry frame, see telemetry.h for the fields
+ */
+struct TleTelemetry {
+  uint8_t sequence;                       ///< Frame sequence number
+  uint32_t time;                          ///< Firmware time stamp (ms)
+  uint8_t motors[MAX_MOTORS];             ///< Motors status bytes
+  uint8_t channelDC[AVAIL_PWM_CHANNELS];  ///< Requested duty cycle of every PWM channel
+  uint8_t appliedDC[AVAIL_PWM_CHANNELS];  ///< Duty cycle written, after the derate and budget factors
+  uint8_t derate;                         ///< Derate factor (%)
+  uint8_t budget;                         ///< Power budget factor (%)
+  uint8_t diagnostic;                     ///< TLE94112 diagnostic status
+  uint16_t loopTime;                      ///< Last loop time (us)
+  uint16_t maxLoopTime;                   ///< Max loop time (us)
+  uint16_t droppedFrames;                 ///< Dropped frames
+};
+
+/**
+ * Decoded flight recorder event, see trace.h for the types and the data
+ */
+struct TleTraceEvent {
+  uint32_t time;        ///< Firmware time stamp (ms)
+  char type;            ///< Event type, e.g. 'H' for a configHB write
+  uint8_t data[3];      ///< Event data
+};
+
+/**
+ * \brief Decode a line of the trace dump
+ *
+ * \param line The line, e.g. 0001A2F4H030201
+ * \param event The decoded event
+ * \return false if the line is not a trace event
+ */
+bool tleDecodeTrace(const std::string &line, TleTraceEvent &event);
+
+/**
+ * \brief Timeline of a trace dump, e.g. the lines of the traceDump() reply.
+ * Every event is a line with the time since the first event and the
+ * decoded data; the lines that are not events are skipped
+ *
+ * \param dump The dump lines, oldest first
+ * \return The timeline lines
+ */
+std::vector<std::string> tleTraceTimeline(const std::vector<std::string> &dump);
+
+class TleClient;
+
+/**
+ * \brief A TLE94112LE station connected to a serial port
+ *
+ * The commands are sent without waiting for the previous replies, up to
+ * TLE_RX_WINDOW bytes to not overflow the firmware receive buffer, and
+ * every command gets a future completed with its reply. Every command
+ * line is tagged with the sequence number, and the firmware ends the
+ * execution with the tag, the result and its time stamps; the pending
+ * commands sent before a tag have been lost and fail, as a command
+ * without the tag after TLE_REPLY_TIMEOUT. The firmware executes the
+ * commands in order, so the lines received before the tag belong to
+ * the oldest pending command. The telemetry frames and the lines
+ * received when no command is pending are notified to the callbacks,
+ * which are called by the client thread.
+ *
+ * The stations are created and owned by a TleClient.
+ */
+class TleStation {
+  public:
+
+    //! Serial port path
+    const std::string path;
+
+    /**
+     * \brief Send a command line. The lines printed by the firmware
+     * while executing the command are added to the reply
+     *
+     * \param command The command, without line terminator
+     * \return The reply, available when the command has been executed
+     */
+    std::future<TleReply> submit(const std::string &command);
+
+    /**
+     * \brief Set the callback of the decoded telemetry frames
+     */
+    void onTelemetry(std::function<void(const TleTelemetry&)> callback);
+
+    /**
+     * \brief Set the callback of the lines not related to a command, e.g.
+     * the diagnostic messages
+     */
+    void onMessage(std::function<void(const std::string&)> callback);
+
+    //! Number of telemetry frames discarded for a wrong size or checksum
+    unsigned long badFrames(void);
+
+    /**
+     * \brief Send a batch of commands on one line, executed as a single
+     * configuration change. Only the motors and PWM settings are accepted,
+     * and a motor action as the last command. The last reply line has one
+     * character every command (BATCH_DONE, BATCH_FAILED or BATCH_SKIPPED)
+     *
+     * \param commands The commands, up to BATCH_MAX_COMMANDS
+     */
+    std::future<TleReply> batch(const std::vector<std::string> &commands);
+
+    // Motor selection and enable. motor is 1 to MAX_MOTORS
+    std::future<TleReply> selectMotor(int motor);
+    std::future<TleReply> enableMotor(int motor);
+    std::future<TleReply> selectAll(void);
+    std::future<TleReply> selectNone(void);
+
+    // Action commands
+    std::future<TleReply> start(void);
+    std::future<TleReply> stop(void);
+    std::future<TleReply> reset(void);
+
+    // Settings of the selected motor(s)
+    std::future<TleReply> direction(bool clockwise);
+    std::future<TleReply> pwmChannel(int channel);    ///< 0 = no PWM, 1 to AVAIL_PWM_CHANNELS
+    std::future<TleReply> freeWheeling(bool active);
+    std::future<TleReply> stopMode(uint8_t mode, uint16_t brakeTime = 0);  ///< brakeTime 1 to 65535 ms for STOP_BRAKE_FLOAT
+    std::future<TleReply> motorDC(uint8_t dc);
+    std::future<TleReply> layoutStandard(void);
+    std::future<TleReply> layoutHighCurrent(void);
+    std::future<TleReply> layoutRemove(void);
+    std::future<TleReply> layout(const std::string &halfBridges);  ///< e.g. "1/2" or "1+2/3+4"
+
+    // PWM channels settings, applied to the channel selected by dcChannel()
+    std::future<TleReply> dcChannel(int channel);     ///< 0 = all the channels
+    std::future<TleReply> dcManual(void);
+    std::future<TleReply> dcAuto(void);
+    std::future<TleReply> dcMin(void);
+    std::future<TleReply> dcMax(void);
+    std::future<TleReply> ramp(bool enable);
+    std::future<TleReply> frequency(unsigned int hz);
+
+    // Fault reactions and filters, e.g. faultReaction(FAULT_NAME_UV, FAULT_ACTION_STOPALL)
+    std::future<TleReply> faultReaction(const std::string &fault, const std::string &action,
+                                        unsigned int retryDelay = 0);
+    std::future<TleReply> faultFilter(const std::string &fault, unsigned int samples,
+                                      unsigned int rampWindow, unsigned int rateLimit);
+    std::future<TleReply> faultDefault(void);
+
+    // Telemetry and flight recorder
+    std::future<TleReply> telemetry(bool enable);
+    std::future<TleReply> telemetryRate(unsigned int ms);
+    std::future<TleReply> traceDump(void);
+    std::future<TleReply> traceClear(void);
+    std::future<TleReply> traceStop(void);
+
+    // Closed loop speed control of the selected motor
+    std::future<TleReply> tachometer(int pin);        ///< negative to disconnect
+    std::future<TleReply> speed(unsigned int target);
+    std::future<TleReply> gains(unsigned int kp, unsigned int ki);  ///< Failed if any of the two gains is not set
+
+    // Motion sequence
+    std::future<TleReply> sequenceAppend(const std::vector<uint8_t> &program);
+    std::future<TleReply> sequenceClear(void);
+    std::future<TleReply> sequenceRun(void);
+    std::future<TleReply> sequenceStop(void);
+
+    // Dithering of the channel selected by dcChannel(), setpoint = duty cycle * 256
+    std::future<TleReply> dither(unsigned int setpoint);
+    std::future<TleReply> ditherOff(void);
+    std::future<TleReply> ditherPeriod(unsigned int ticks);
+
+    // Waveform of the channel selected by dcChannel(), e.g. waveform(WAVE_NAME_SINE, 100, 128, 2000, 0)
+    std::future<TleReply> waveform(const std::string &shape, unsigned int amplitude,
+                                   unsigned int offset, unsigned int period, unsigned int phase);
+    std::future<TleReply> waveOff(void);
+
+    // Soak test of the enabled motors, times in ms, report in s
+    std::future<TleReply> soakCycle(unsigned int run, unsigned int rest,
+                                    unsigned long cycles, unsigned int report);
+    std::future<TleReply> soakStart(void);
+    std::future<TleReply> soakStop(void);
+
+    // Power budget, the weight applies to the selected motor
+    std::future<TleReply> powerBudget(unsigned int budget);
+    std::future<TleReply> powerWeight(unsigned int weight);
+
+    // Timed moves, idle and control tick
+    std::future<TleReply> runTime(unsigned int ms);
+    std::future<TleReply> runBudget(unsigned int ms);
+    std::future<TleReply> idleTime(unsigned int s);
+    std::future<TleReply> tickReset(void);
+
+    // Configuration persistence and profiles, load prints the restored settings
+    std::future<TleReply> save(void);
+    std::future<TleReply> load(void);
+    std::future<TleReply> autoStart(bool enable);
+    std::future<TleReply> profileSave(int number, const std::string &name);
+    std::future<TleReply> profileSelect(const std::string &profile);
+
+    // Informative commands, the reply lines contain the printed tables
+    std::future<TleReply> showConf(void);
+    std::future<TleReply> dcInfo(void);
+    std::future<TleReply> motorDCInfo(void);
+    std::future<TleReply> faultInfo(void);
+    std::future<TleReply> telemetryInfo(void);
+    std::future<TleReply> speedInfo(void);
+    std::future<TleReply> sequenceInfo(void);
+    std::future<TleReply> moveInfo(void);
+    std::future<TleReply> idleInfo(void);
+    std::future<TleReply> ditherInfo(void);
+    std::future<TleReply> waveInfo(void);
+    std::future<TleReply> soakInfo(void);
+    std::future<TleReply> powerInfo(void);
+    std::future<TleReply> tickInfo(void);
+    std::future<TleReply> profileList(void);
+
+  private:
+
+    friend class TleClient;
+
+    //! A command waiting for its reply
+    struct Request {
+      TleReply reply;
+      //! Bytes sent, including the tag
+      size_t size;
+      //! Host time (us) of the transmission
+      uint64_t sentTime;
+      std::promise<TleReply> promise;
+    };
+
+    TleClient &client;
+    int fd;
+    uint32_t nextSequence;
+    //! Commands not yet sent
+    std::deque<Request*> queued;
+    //! Commands sent, waiting for their reply
+    std::deque<Request*> pending;
+    //! Bytes of the pending commands
+    unsigned int pendingBytes;
+    //! Line being received
+    std::string line;
+    //! Last reply keyword and lines received since the last tag
+    std::string replyStatus;
+    std::vector<std::string> replyLines;
+    //! Telemetry frame being received, empty if none
+    std::vector<uint8_t> frame;
+    unsigned long discardedFrames;
+    std::function<void(const TleTelemetry&)> telemetryCallback;
+    std::function<void(const std::string&)> messageCallback;
+
+    TleStation(TleClient &owner, const std::string &port, int descriptor);
+    ~TleStation();
+
+    void transmit(void);
+    void receive(const uint8_t* data, size_t size);
+    void receiveLine(void);
+    void receiveTag(const std::string &text);
+    void receiveFrame(void);
+    void complete(Request* request, bool ok);
+    void completeBefore(size_t index);
+    void expire(void);
+    void close(void);
+    //! Reply of a command not sent, failed
+    std::future<TleReply> reject(const std::string &command);
+};
+
+/**
+ * \brief Event loop of the stations
+ *
+ * A single thread waits for the data of all the opened serial ports,
+ * sends the queued commands and completes the replies.
+ */
+class TleClient {
+  public:
+
+    TleClient();
+    ~TleClient();
+
+    /**
+     * \brief Open a serial port at TLE_BAUD_RATE
+     *
+     * \param path The serial device, e.g. /dev/ttyACM0
+     * \return The station, owned by the client; NULL if the port can't be opened
+     */
+    TleStation* open(const std::string &path);
+
+  private:
+
+    friend class TleStation;
+
+    //! Recursive, so that the callbacks can submit commands
+    std::recursive_mutex lock;
+    std::thread thread;
+    std::vector<TleStation*> stations;
+    //! Pipe to wake up the thread when a command is queued
+    int wakePipe[2];
+    bool running;
+
+    void run(void);
+    void wake(void);
+};
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ *  \file idle.cpp
+ *  \brief This file defines functions and predefined instances from idle.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include <avr/sleep.h>
+#include "idle.h"
+#include "controltick.h"
+
+void IdleGovernor::begin(void) {
+  quietTime = IDLE_QUIET_TIME;
+  sleeps = 0;
+  wakeLatency = maxWakeLatency = 0;
+  wakeTime = 0;
+  activityTime = millis();
+}
+
+void IdleGovernor::activity(void) {
+  activityTime = millis();
+  if(wakeTime != 0) {
+    wakeLatency = micros() - wakeTime;
+    if(wakeLatency > maxWakeLatency)
+      maxWakeLatency = wakeLatency;
+    wakeTime = 0;
+  }
+}
+
+boolean IdleGovernor::expired(boolean busy) {
+  if(busy || (quietTime == 0)) {
+    activityTime = millis();
+    return false;
+  }
+
+  return (millis() - activityTime) >= ((unsigned long)quietTime * 1000);
+}
+
+void IdleGovernor::sleep(MotorControl &motor) {
+  // The pending output is sent before sleeping
+  Serial.flush();
+  motor.end();
+  controlTick.suspend();
+
+  // The millis() timer wakes up the MCU every ms, the check is repeated
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  while(Serial.available() == 0) {
+    sleep_mode();
+  }
+
+  wakeTime = micros();
+  // A zero time is reserved to the measured latency
+  if(wakeTime == 0)
+    wakeTime = 1;
+  controlTick.resume();
+  motor.wake();
+  sleeps++;
+  activityTime = millis();
+}
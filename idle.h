@@ -0,0 +1,81 @@
+/**
+ *  \file idle.h
+ *  \brief Low power mode while the motors are stopped
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _IDLE
+#define _IDLE
+
+#include "motorcontrol.h"
+
+#define IDLE_QUIET_TIME 60      ///< Default time (s) without activity before sleeping
+#define IDLE_MAX_QUIET_TIME 3600  ///< Max time (s) without activity before sleeping
+
+/**
+ * \brief Idle governor
+ *
+ * When the motors don't need the TLE94112 for the quiet time and there
+ * are no serial commands, the device is disabled with MotorControl::end()
+ * and the MCU sleeps in idle mode until a character is received by the
+ * serial. The serial and the millis() timer keep running during the
+ * sleep, so the received character is not lost; the control tick is
+ * suspended. On wake up the TLE94112 is enabled again with the current
+ * settings. The time from the wake up to the first command is measured.
+ */
+class IdleGovernor {
+  public:
+
+    //! Time (s) without activity before sleeping, 0 to never sleep
+    uint16_t quietTime;
+    //! Number of sleeps
+    unsigned long sleeps;
+    //! Time (us) from the last wake up to the first command
+    unsigned long wakeLatency;
+    //! Max time (us) from a wake up to the first command
+    unsigned long maxWakeLatency;
+
+    /**
+     * \brief Initialise with the default quiet time
+     */
+    void begin(void);
+
+    /**
+     * \brief Notify an activity that restarts the quiet time, e.g. a
+     * command. The first activity after a wake up completes the latency
+     * measure
+     */
+    void activity(void);
+
+    /**
+     * \brief Check if the quiet time is expired. Should be called once
+     * every main loop
+     *
+     * \param busy Something that needs the main loop is running, the quiet
+     * time is restarted
+     * \return true if the controller should sleep
+     */
+    boolean expired(boolean busy);
+
+    /**
+     * \brief Disable the TLE94112 and sleep until a serial character is
+     * received, then enable the TLE94112 again
+     *
+     * \param motor The motor control class
+     */
+    void sleep(MotorControl &motor);
+
+  private:
+
+    //! Time (ms) of the last activity
+    unsigned long activityTime;
+    //! Time (us) of the last wake up, 0 when the latency has been measured
+    unsigned long wakeTime;
+};
+
+#endif
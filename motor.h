@@ -16,12 +16,13 @@
 //! Application title shown on startup and after reset
 #define APP_TITLE "Infineon TLE94112LE Test Ver.1.0.21 RC"
 
-#undef _HIGHCURRENT
 #undef _MOTORDEBUG
 
-//! Avoid too many openload error messages when starting acceleration
-//! by default it is ignored
-#define _IGNORE_OPENLOAD
+#define LEDPIN 12             ///< Status LED
+#define ANALOG_DCPIN A0       ///< Analog duty cycle input pin
+#define LCD_DATA_PIN 2        ///< Data pin of the shift register LCD
+#define LCD_CLOCK_PIN 3       ///< Clock pin of the shift register LCD
+#define LCD_LATCH_PIN 4       ///< Latch pin of the shift register LCD
 
 #define INVERT_DIRECTION_DELAY 300  ///< Delay in ms when the motor should invert direction
 #define ACCELERATION_DELAY 5        ///< Delay between acceleration steps
@@ -32,6 +33,11 @@
 #define MOTOR_FW_ACTIVE true       ///< Active freewheeling
 #define MOTOR_FW_PASSIVE false     ///< Passive freewheeling
 
+#define STOP_COAST 0          ///< Stop leaving the poles floating, the motor coasts down
+#define STOP_BRAKE 1          ///< Stop with both poles low, the motor brakes
+#define STOP_BRAKE_FLOAT 2    ///< Brake, then leave the poles floating after the brake time
+#define BRAKE_TIME 500        ///< Default brake time (ms) before floating
+
 #define MOTOR_MANUAL_DC true      ///< Manual motor duty cycle target control
 #define MOTOR_AUTO_DC false       ///< Motor duty cycle based on the internal settings
 
@@ -46,31 +52,121 @@
 
 #define DUTYCYCLE_MIN 0     ///< Minimum duty cycle for motor start. Depends on motor characteristics
 #define DUTYCYCLE_MAX 255   ///< Maximum duty cycle
-#define RAMP_STEP_DELAY 2   ///< Delay (ms) between steps during an acceleration/deceleration cycle
+#define RAMP_STEP_DELAY 2   ///< Control ticks (ms) between steps during an acceleration/deceleration cycle
 
 #define AVAIL_PWM_CHANNELS 3  ///< Number of available PWM channels (excluding the NOPWM mode)
-#define PWM80_CHID 1          ///< ID for PWM channel 80 Hz
-#define PWM100_CHID 2         ///< ID for PWM channel 100 Hz
-#define PWM200_CHID 3         ///< ID for PWM channel 200 Hz
+#define PWM1_CHID 1           ///< ID for PWM channel 1 (80 Hz by default)
+#define PWM2_CHID 2           ///< ID for PWM channel 2 (100 Hz by default)
+#define PWM3_CHID 3           ///< ID for PWM channel 3 (200 Hz by default)
+#define PWM_FREQUENCIES 4     ///< Number of PWM frequencies of the TLE94112
+
+#define TLE_HALFBRIDGES 12   ///< Number of half bridges of the TLE94112
+#define MAX_POLE_HB 2         ///< Max number of half bridges in parallel on a motor pole
+#define HB_NONE 0             ///< Half bridge not assigned
+
+//! Max number of motors, when every motor pole uses a single half bridge
+#define MAX_MOTORS (TLE_HALFBRIDGES / 2)
 
 /**
- * When _HIGHCURRENT is set every motor needs 2+2 half bridges to double the needed power
+ * Predefined half bridges layouts. The layout can be changed at runtime
+ * assigning one or two half bridges to every pole of every motor.
+ * When two half bridges are connected in parallel to the same pole
+ * the motor can drive the double of the current.
  */
-#undef _HIGHCURRENT
-
-#ifdef _HIGHCURRENT
-  //! In high current mode every pole of the motors is connected to two half bridges
-  #define MAX_MOTORS 3
-  //! Calculate the first half bridge number depending
-  //! on the motor number
-  #define calcHB1(x) ((x - 1) * 4 + 1)
-#else
-  //! In normal mode every motor uses two half bridges
-  #define MAX_MOTORS 6
-  //! Calculate the first half bridge number depending
-  //! on the motor number
-  #define calcHB1(x) ((x - 1) * 2 + 1)
-#endif
+#define LAYOUT_STANDARD 0     ///< 6 motors, one half bridge every pole
+#define LAYOUT_HIGHCURRENT 1  ///< 3 motors, two half bridges every pole
+
+// Half bridge setting encoded in a byte
+#define HB_SETTING_STATE 0x03     ///< Half bridge state mask
+#define HB_SETTING_PWM 0x07       ///< PWM channel mask, after shifting
+#define HB_SETTING_PWM_SHIFT 2    ///< PWM channel position
+#define HB_SETTING_FW 0x20        ///< Active free wheeling
+
+//! Layout applied on startup. Should match the motors wiring
+#define DEFAULT_LAYOUT LAYOUT_STANDARD
+
+#define NO_MOTOR -1   ///< No motor involved (e.g. diagnostic of all the motors)
+
+/**
+ * Fault classes, one for every TLE94112 global diagnostic flag.
+ * Every class has its own reaction policy applied as soon as the
+ * fault is detected, before any notification
+ */
+#define FAULT_SPI 0
+#define FAULT_LOAD 1
+#define FAULT_UNDERVOLTAGE 2
+#define FAULT_OVERVOLTAGE 3
+#define FAULT_POWERRESET 4
+#define FAULT_TEMPSHUTDOWN 5
+#define FAULT_TEMPWARNING 6
+#define FAULT_CLASSES 7
+
+// Fault reactions
+#define FAULT_IGNORE 0      ///< Clear the fault without notification
+#define FAULT_LOG 1         ///< Notify the fault on the serial
+#define FAULT_DERATE 2      ///< Reduce step by step the duty cycle of all the PWM channels
+#define FAULT_STOPMOTOR 3   ///< Stop the faulty motor
+#define FAULT_STOPALL 4     ///< Stop all the motors
+#define FAULT_RETRY 5       ///< Stop all the motors and restart them after a delay
+#define FAULT_ACTIONS 6
+
+#define FAULT_RETRY_DELAY 1000  ///< Default delay (ms) before restarting after a fault
+#define FAULT_RETRY_MAX 3       ///< Restart attempts while the fault persists, then the motors stay stopped
+
+/**
+ * Diagnostic filters: a fault class is asserted (counted, reaction and
+ * notification) only when detected by a number of consecutive diagnostic
+ * samples and not within the ramp window, the time (ms) since the last
+ * duty cycle change of a PWM channel. The notifications of an asserted
+ * fault are limited to one every rate limit (ms), the reaction is always
+ * applied
+ */
+#define FAULT_SAMPLES 1           ///< Default consecutive samples to assert a fault
+#define FAULT_MAX_SAMPLES 100     ///< Max consecutive samples to assert a fault
+#define FAULT_RAMP_WINDOW 0       ///< Default ramp window (ms), 0 = not suppressed
+#define FAULT_RATE_LIMIT 0        ///< Default min time (ms) between notifications, 0 = no limit
+//! The open load is detected during the accelerations because of the low
+//! duty cycle: the flood of notifications is filtered by default
+#define LOAD_FAULT_SAMPLES 3
+#define LOAD_RAMP_WINDOW 50
+#define LOAD_RATE_LIMIT 1000
+
+/**
+ * Derating: while a fault with derate reaction (by default the temperature
+ * warning) persists, the duty cycle of all the PWM channels is reduced
+ * step by step. It is restored when the fault is not detected anymore
+ * for DERATE_RESTORE_DELAY
+ */
+#define DERATE_NONE 100             ///< Duty cycle percentage without derating
+#define DERATE_MIN 50               ///< Min duty cycle percentage when derating
+#define DERATE_STEP 10              ///< Duty cycle percentage changed every derate step
+#define DERATE_INTERVAL 1000        ///< Min time (ms) between two derate steps
+#define DERATE_RESTORE_DELAY 10000  ///< Time (ms) without derate faults before restoring
+
+/**
+ * Power budget: the supply demand is the sum of the duty cycle (%) of the
+ * running motors multiplied by their weight, e.g. the motor current in
+ * 100 mA. When the demand exceeds the budget the duty cycle of all the PWM
+ * channels is scaled by the same factor, so the supply doesn't sag down to
+ * the under voltage. The motors without PWM run at the max duty cycle and
+ * are not scaled
+ */
+#define DEFAULT_POWER_WEIGHT 10   ///< Default weight of a motor
+#define MAX_POWER_WEIGHT 100      ///< Max weight of a motor, 0 = not counted
+#define NO_POWER_BUDGET 0         ///< No power budget
+#define MAX_POWER_BUDGET 60000    ///< Max power budget
+#define BUDGET_NONE 100           ///< Duty cycle percentage without budget limit
+
+#define CONFIG_ADDRESS 0    ///< EEPROM address of the saved configuration
+#define CONFIG_MAGIC 0x94   ///< Saved configuration marker
+//! Saved configuration format version. Should be changed when the
+//! saved structures change
+#define CONFIG_VERSION 7
+
+#define PROFILES 4                ///< Number of configuration profiles
+#define PROFILE_NAME_SIZE 8       ///< Max profile name length, including the terminator
+#define PROFILE_ALIGN 32          ///< The profiles start after the configuration, rounded up to this size
+#define NO_PROFILE -1             ///< No profile active
 
 // ======================================================================
 //        Generic Strings
@@ -86,9 +182,13 @@
 #define TLE_POWERONRESET "Power Reset" 
 #define TLE_TEMPSHUTDOWN "Temp shutdown"
 #define TLE_TEMPWARNING "Warning too hot"
+#define TLE_HBOVERCURRENT "Over current HB"
+#define TLE_HBOPENLOAD "Open load HB"
 
 #define TLE_MOTOR_STARTING "Starting"
 #define TLE_MOTOR_STOPPING "Stopping"
+#define TLE_RETRY_FAILED "Restart failed"
+#define TLE_RETRY_GIVEUP "Fault persists, motors not restarted"
 #define TLE_MOTOR_HALT "Halted"
 #define TLE_MOTOR_RUN "Running"
 
@@ -96,6 +196,7 @@
 #define RUNNING2 "^"
 #define RUNNING3 ")"
 #define RUNNING4 "v"
+#define RUNNING_STEP 100    ///< Time (ms) between two frames of the running animation
 
 // ======================================================================
 //        LCD String
@@ -113,8 +214,8 @@
 #define INFO_MAIN_HEADER2     "*************************************"
 #define INFO_MOTORS_TITLE     "      Motors configuration"
 #define INFO_PWM_TITLE        "       PWM Channels settings"
-#define INfO_TAB_HEADER1      "|Motor|Enabled|Active FW|Dir|PWM|"
-#define INfO_TAB_HEADER2      "|-----+-------+---------+---+---|"
+#define INfO_TAB_HEADER1      "|Motor|Enabled|Active FW|Dir|PWM|Stop |Half bridges|"
+#define INfO_TAB_HEADER2      "|-----+-------+---------+---+---+-----+------------|"
 #define INfO_TAB_HEADER3      "|PWM Chan|DC Min|DC Max|DC Man|Accel|"
 #define INfO_TAB_HEADER4      "|--------+------+------+------+-----|"
 
@@ -144,9 +245,94 @@
 #define INFO_FIELD9_80 " 80|"
 #define INFO_FIELD9_100 "100|"
 #define INFO_FIELD9_200 "200|"
-
+#define INFO_FIELD9_2K " 2k|"
+
+#define INFO_FIELD12_COAST "Coast|"
+#define INFO_FIELD12_BRAKE "Brake|"
+#define INFO_FIELD12_FLOAT "B+Flt|"
+
+#define INFO_FIELD11_NO " None"
+#define INFO_FIELD11_WIDTH 12
+
+#define INFO_FAULT_TITLE "Fault reactions:"
+#define INFO_FAULT_STOPS "Fault stops "
+#define INFO_FAULT_RETRIES ", restarts "
+#define INFO_FAULT_GIVEUPS ", failed restarts "
+#define INFO_FAULT_TIME "Reaction time "
+#define INFO_FAULT_MAXTIME " us, max "
+#define INFO_FAULT_DERATE "Derate factor "
+#define INFO_FAULT_FILTER " filter "
+#define INFO_FAULT_FILTERED " filtered "
+#define INFO_FAULT_MUTED " muted "
+
+#define INFO_DITHER_TITLE "Dither period "
+#define INFO_DITHER_WRITES " ticks, writes "
+#define INFO_DITHER_RATE ", rate "
+#define INFO_DITHER_OFF " off"
+
+#define INFO_WAVE_TITLE "Waveforms, writes "
+#define INFO_WAVE_OFF "off"
+
+#define INFO_SOAK_TITLE "soak "
+#define INFO_SOAK_RUNNING "running"
+#define INFO_SOAK_STOPPED "stopped"
+#define INFO_SOAK_CYCLES " cycles "
+#define INFO_SOAK_ABORTED " aborted "
+#define INFO_SOAK_CPM " cpm "
+#define INFO_SOAK_TIMES " ms "
+#define INFO_SOAK_FAULTS " faults "
+#define INFO_SOAK_SETTINGS "Soak cycle "
+
+#define INFO_POWER_TITLE "Power budget "
+#define INFO_POWER_DEMAND ", demand "
+#define INFO_POWER_FACTOR ", factor "
+#define INFO_POWER_LIMITS ", limited "
+#define INFO_POWER_WEIGHTS "Motors weight"
+
+#define INFO_TELEMETRY_SENT "Telemetry frames sent "
+#define INFO_TELEMETRY_DROPPED ", dropped "
+#define INFO_TELEMETRY_LOOP ", max loop time "
+
+#define INFO_TRACE_TITLE "Trace"
+#define INFO_TRACE_FROZEN " (frozen)"
+
+#define INFO_PROFILE_TITLE "Profiles"
+#define INFO_PROFILE_EMPTY "(empty)"
+#define INFO_PROFILE_ACTIVE " active"
+#define INFO_PROFILE_WRITES "Registers written "
+#define INFO_SEQUENCE_SIZE "Sequence bytes "
+#define INFO_SEQUENCE_RUNNING ", running at "
+#define INFO_SEQUENCE_STOPPED ", stopped at "
+#define INFO_SEQUENCE_CYCLES "Cycles "
+#define INFO_SEQUENCE_OVERRUNS ", overruns "
+#define INFO_SEQUENCE_LATENESS ", max lateness "
+#define INFO_SPEED_TITLE "Speed control, Kp "
+#define INFO_SPEED_KI ", Ki "
+#define INFO_SPEED_LATE ", late ticks "
+#define INFO_SPEED_PIN " tachometer pin "
+#define INFO_SPEED_TARGET ", target "
+#define INFO_SPEED_SPEED ", speed "
+#define INFO_SPEED_DC ", duty cycle "
+#define INFO_ALLOC_TITLE "Motor duty cycle allocation"
+#define INFO_ALLOC_TARGET " target "
+#define INFO_ALLOC_CHANNEL ", PWM channel "
+#define INFO_ALLOC_DC ", duty cycle "
+#define INFO_ALLOC_ERROR ", error "
+#define INFO_MOVE_RUNNING "Move running, motors "
+#define INFO_MOVE_IDLE "No move running"
+#define INFO_MOVE_DURATION "Last move "
+#define INFO_MOVE_BUDGET " us, budget "
+#define INFO_TICK_TITLE "Control tick, executed "
+#define INFO_TICK_OVERRUNS ", overruns "
+#define INFO_TICK_JITTER ", max jitter "
+#define INFO_TICK_LATENCY " us, max latency "
+#define INFO_IDLE_TITLE "Idle after "
+#define INFO_IDLE_SLEEPS " s, sleeps "
+#define INFO_IDLE_LATENCY ", wake up latency "
+#define INFO_IDLE_MAX_LATENCY " us, max "
 #define INFO_FIELD10_80 "|  80 Hz |"
 #define INFO_FIELD10_100 "| 100 Hz |"
 #define INFO_FIELD10_200 "| 200 Hz |"
+#define INFO_FIELD10_2K "|  2 kHz |"
 
 #endif
@@ -9,7 +9,37 @@
  *  Licensed under GNU LGPL 3.0
  */
 
+#include <EEPROM.h>
 #include "motorcontrol.h"
+#include "trace.h"
+#include "controltick.h"
+
+//! TLE94112 PWM generator of every PWM channel ID (base 0)
+static const Tle94112::PWMChannel channelGenerator[AVAIL_PWM_CHANNELS] = {
+  Tle94112::TLE_PWM1, Tle94112::TLE_PWM2, Tle94112::TLE_PWM3 };
+//! Default frequency of every PWM channel ID (base 0)
+static const Tle94112::PWMFreq defaultFrequency[AVAIL_PWM_CHANNELS] = {
+  Tle94112::TLE_FREQ80HZ, Tle94112::TLE_FREQ100HZ, Tle94112::TLE_FREQ200HZ };
+//! Value in Hz of every TLE94112 PWM frequency, starting from TLE_FREQ80HZ
+static const uint16_t frequencyHz[PWM_FREQUENCIES] = { 80, 100, 200, 2000 };
+
+//! TLE94112 diagnostic flag of every fault class
+static const uint8_t faultFlag[FAULT_CLASSES] = {
+  Tle94112::TLE_SPI_ERROR, Tle94112::TLE_LOAD_ERROR, Tle94112::TLE_UNDER_VOLTAGE,
+  Tle94112::TLE_OVER_VOLTAGE, Tle94112::TLE_POWER_ON_RESET, Tle94112::TLE_TEMP_SHUTDOWN,
+  Tle94112::TLE_TEMP_WARNING };
+
+// Diagnostic message of every fault class
+static const char faultMessageSPI[] PROGMEM = TLE_SPIERROR;
+static const char faultMessageLoad[] PROGMEM = TLE_LOADERROR;
+static const char faultMessageUV[] PROGMEM = TLE_UNDERVOLTAGE;
+static const char faultMessageOV[] PROGMEM = TLE_OVERVOLTAGE;
+static const char faultMessagePOR[] PROGMEM = TLE_POWERONRESET;
+static const char faultMessageTSD[] PROGMEM = TLE_TEMPSHUTDOWN;
+static const char faultMessageTW[] PROGMEM = TLE_TEMPWARNING;
+static const char* const faultMessage[FAULT_CLASSES] PROGMEM = {
+  faultMessageSPI, faultMessageLoad, faultMessageUV, faultMessageOV,
+  faultMessagePOR, faultMessageTSD, faultMessageTW };
 
 // ===============================================================
 // Initialization and reset methods
@@ -18,14 +48,41 @@
 void MotorControl::begin(void) {
   // enable tle94112
   tle94112.begin();
+  diagnosticHeader = NULL;
+  diagnosticStatus = tle94112.TLE_STATUS_OK;
+  dcChangeTime = millis();
+  resetFaultPolicy();
+  // The layout depends on the wiring so it is not changed by reset()
+  setBridgeLayout(DEFAULT_LAYOUT);
+  // The thermal derating depends on the device status, not on the settings
+  derateFactor = DERATE_NONE;
+  derateStepTime = derateFaultTime = millis();
+  // Nothing is running yet: no budget limit
+  powerBudget = NO_POWER_BUDGET;
+  budgetFactor = BUDGET_NONE;
+  budgetLimits = 0;
+  memset(channelDC, 0, sizeof(channelDC));
+  autoStart = false;
   
   reset();
+  configLoaded = loadConfig();
+  registerWrites = 0;
 }
 
 void MotorControl::end(void) {
   tle94112.end();
 }
 
+void MotorControl::wake(void) {
+  int j;
+
+  tle94112.begin();
+  diagnosticStatus = tle94112.TLE_STATUS_OK;
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    configChannelPWM(j, channelDC[j]);
+  }
+}
+
 void MotorControl::reset() {
   int j;
 
@@ -35,6 +92,10 @@ void MotorControl::reset() {
     internalStatus[j].isRunning = false;    // Not running (should be enabled)
     internalStatus[j].freeWheeling = true;  // Free wheeling active
     internalStatus[j].motorDirection = MOTOR_DIRECTION_CW;
+    internalStatus[j].targetDC = DUTYCYCLE_MAX;
+    internalStatus[j].stopMode = STOP_COAST;
+    internalStatus[j].brakeTime = BRAKE_TIME;
+    internalStatus[j].powerWeight = DEFAULT_POWER_WEIGHT;
   } // loop on the motors array
 
   for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
@@ -42,35 +103,129 @@ void MotorControl::reset() {
     dutyCyclePWM[j].maxDC = DUTYCYCLE_MAX;  // Max duty cycle
     dutyCyclePWM[j].manDC = false;          // Duty cycle in auto mode
     dutyCyclePWM[j].useRamp = false;        // No acceleration
+    dutyCyclePWM[j].frequency = defaultFrequency[j];
   } // loop on the PWM channels array
 
   resetHB();
   resetPWM();
   currentPWM = 0; // No PWM channels selected
   currentMotor = 0; // No motors selected
+  activeProfile = NO_PROFILE;
 }
 
 void MotorControl::resetHB(void) {
-  // Set all the half bridges floating without pwm
-  tle94112.configHB(tle94112.TLE_HB1, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB3, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB5, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB9, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-  tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
+  int j;
+
+  // Set all the half bridges floating without pwm, including the
+  // ones not assigned to any motor
+  brakedMotors = 0;
+  for(j = 1; j <= TLE_HALFBRIDGES; j++) {
+    trace.record(TRACE_HB, j, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
+    tle94112.configHB((Tle94112::HalfBridge)j, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
+  }
 }
 
 void MotorControl::resetPWM(void) {
+  int j;
+
   // Initialize the PWM channels to the corresponding frequency and duty cycle 0
-  tle94112.configPWM(tle94112.TLE_PWM1, tle94112.TLE_FREQ80HZ, (uint8_t)0);
-  tle94112.configPWM(tle94112.TLE_PWM2, tle94112.TLE_FREQ100HZ, (uint8_t)0);
-  tle94112.configPWM(tle94112.TLE_PWM3, tle94112.TLE_FREQ200HZ, (uint8_t)0);
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    configChannelPWM(j, 0);
+  }
+}
+
+void MotorControl::configChannelPWM(int channel, uint8_t dc) {
+  // The requested value is saved so it can be restored when the derate
+  // factor changes
+  // Start of the diagnostic filters ramp window
+  if(dc != channelDC[channel])
+    dcChangeTime = millis();
+  channelDC[channel] = dc;
+  channelFrequency[channel] = dutyCyclePWM[channel].frequency;
+  updateBudgetFactor(channel);
+  writeChannelPWM(channel);
+}
+
+uint8_t MotorControl::scaledDC(int channel) {
+  return (uint8_t)(((unsigned long)channelDC[channel] * derateFactor * budgetFactor) / 
+                   ((unsigned long)DERATE_NONE * BUDGET_NONE));
+}
+
+void MotorControl::writeChannelPWM(int channel) {
+  appliedDC[channel] = scaledDC(channel);
+  trace.record(TRACE_PWM, channelGenerator[channel], channelFrequency[channel], appliedDC[channel]);
+  tle94112.configPWM(channelGenerator[channel], (Tle94112::PWMFreq)channelFrequency[channel], appliedDC[channel]);
+}
+
+// ===============================================================
+// Power budget
+// ===============================================================
+
+void MotorControl::setPowerWeight(uint8_t weight) {
+  if(currentMotor != 0) {
+    internalStatus[currentMotor - 1].powerWeight = weight;
+  }
+  else {
+    int j;
+    for (j = 0; j < MAX_MOTORS; j++) {
+      internalStatus[j].powerWeight = weight;
+    }
+  }
+}
+
+void MotorControl::setPowerBudget(uint16_t budget) {
+  powerBudget = budget;
+  updateBudgetFactor(-1);
+}
+
+void MotorControl::powerService(void) {
+  updateBudgetFactor(-1);
+}
+
+uint8_t MotorControl::powerFactor(void) {
+  int j;
+  uint8_t channel;
+  unsigned long fixed, scaled, limit;
+
+  // Demand as duty cycle (0 to DUTYCYCLE_MAX) * weight
+  fixed = scaled = 0;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(!internalStatus[j].isRunning)
+      continue;
+    channel = internalStatus[j].channelPWM;
+    if(channel == tle94112.TLE_NOPWM)
+      fixed += (unsigned long)DUTYCYCLE_MAX * internalStatus[j].powerWeight;
+    else
+      scaled += ((unsigned long)channelDC[channel - 1] * derateFactor / DERATE_NONE) * 
+                internalStatus[j].powerWeight;
+  }
+  powerDemand = ((fixed + scaled) * 100) / DUTYCYCLE_MAX;
+
+  limit = ((unsigned long)powerBudget * DUTYCYCLE_MAX) / 100;
+  if( (powerBudget == NO_POWER_BUDGET) || ((fixed + scaled) <= limit) )
+    return BUDGET_NONE;
+  // The motors without PWM can't be limited
+  if(limit <= fixed)
+    return 0;
+  return (uint8_t)(((limit - fixed) * BUDGET_NONE) / scaled);
+}
+
+void MotorControl::updateBudgetFactor(int channel) {
+  int j;
+  uint8_t factor;
+
+  factor = powerFactor();
+  if(factor == budgetFactor)
+    return;
+
+  if(budgetFactor == BUDGET_NONE)
+    budgetLimits++;
+  budgetFactor = factor;
+  // Only the channels with a different duty cycle are written
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if( (j != channel) && (appliedDC[j] != scaledDC(j)) )
+      writeChannelPWM(j);
+  }
 }
 
 // ===============================================================
@@ -101,6 +256,17 @@ void MotorControl::setMotorDirection(int dir) {
   }
 }
 
+void MotorControl::setMotorStopMode(uint8_t mode, uint16_t time) {
+  int j;
+
+  for (j = 0; j < MAX_MOTORS; j++) {
+    if( (currentMotor == 0) || (currentMotor == (j + 1)) ) {
+      internalStatus[j].stopMode = mode;
+      internalStatus[j].brakeTime = time;
+    }
+  }
+}
+
 void MotorControl::setMotorFreeWheeling(boolean fw) {
   if(currentMotor != 0) {
     internalStatus[currentMotor - 1].freeWheeling = fw;
@@ -155,6 +321,35 @@ void MotorControl::setPWMMaxDC(uint8_t dc) {
   }
 }
 
+int MotorControl::findPWMFrequency(unsigned int hz) {
+  int j;
+
+  for(j = 0; j < PWM_FREQUENCIES; j++) {
+    if(frequencyHz[j] == hz)
+      return tle94112.TLE_FREQ80HZ + j;
+  }
+
+  return -1;
+}
+
+boolean MotorControl::setPWMFrequency(unsigned int hz) {
+  int j, freq;
+
+  freq = findPWMFrequency(hz);
+  if(freq < 0)
+    return false;
+
+  // The duty cycle is written again with the new frequency
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if( (currentPWM == 0) || (currentPWM == (j + 1)) ) {
+      dutyCyclePWM[j].frequency = freq;
+      configChannelPWM(j, channelDC[j]);
+    }
+  }
+
+  return true;
+}
+
 void MotorControl::setPWMRamp(boolean acc) {
   if(currentPWM != 0) {
     dutyCyclePWM[currentPWM - 1].useRamp = acc;
@@ -167,13 +362,139 @@ void MotorControl::setPWMRamp(boolean acc) {
   }
 }
 
+// ===============================================================
+// Motors duty cycle allocation on the PWM channels
+// ===============================================================
+
+void MotorControl::setMotorDC(uint8_t dc) {
+  if(currentMotor != 0) {
+    internalStatus[currentMotor - 1].targetDC = dc;
+  }
+  else {
+    int j;
+    for (j = 0; j < MAX_MOTORS; j++) {
+      internalStatus[j].targetDC = dc;
+    }
+  }
+
+  allocatePWM();
+}
+
+void MotorControl::allocatePWM(void) {
+  uint8_t motors[MAX_MOTORS];
+  uint8_t oldSettings[TLE_HALFBRIDGES];
+  uint8_t newSettings[TLE_HALFBRIDGES];
+  uint8_t groupDC[AVAIL_PWM_CHANNELS], bestDC[AVAIL_PWM_CHANNELS];
+  int groupEnd[AVAIL_PWM_CHANNELS], bestEnd[AVAIL_PWM_CHANNELS];
+  boolean usedChannel[AVAIL_PWM_CHANNELS];
+  unsigned long error, bestError;
+  int count, start, channel, j, k, a, b;
+
+  // The enabled motors sorted by requested duty cycle
+  count = 0;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(internalStatus[j].isEnabled && hasLayout(j)) {
+      for(k = count; (k > 0) && (internalStatus[motors[k - 1]].targetDC > internalStatus[j].targetDC); k--) {
+        motors[k] = motors[k - 1];
+      }
+      motors[k] = j;
+      count++;
+    }
+  }
+  if(count == 0)
+    return;
+
+  // With the motors sorted the best groups are contiguous: try all the
+  // splits in AVAIL_PWM_CHANNELS groups [0, a) [a, b) [b, count)
+  bestError = 0xffffffff;
+  for(a = 0; a <= count; a++) {
+    for(b = a; b <= count; b++) {
+      groupEnd[0] = a;
+      groupEnd[1] = b;
+      groupEnd[2] = count;
+      error = groupError(motors, 0, a, groupDC[0]) + groupError(motors, a, b, groupDC[1]) +
+              groupError(motors, b, count, groupDC[2]);
+      if(error < bestError) {
+        bestError = error;
+        memcpy(bestEnd, groupEnd, sizeof(groupEnd));
+        memcpy(bestDC, groupDC, sizeof(groupDC));
+      }
+    }
+  }
+
+  bridgeSettings(internalStatus, oldSettings);
+
+  // Every group uses the free channel with the closest duty cycle, so
+  // a small change of a request doesn't move the other motors
+  memset(usedChannel, 0, sizeof(usedChannel));
+  start = 0;
+  for(k = 0; k < AVAIL_PWM_CHANNELS; k++) {
+    if(bestEnd[k] == start)
+      continue;
+    channel = -1;
+    for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+      if( !usedChannel[j] && ((channel < 0) || 
+          (abs((int)dutyCyclePWM[j].maxDC - bestDC[k]) < abs((int)dutyCyclePWM[channel].maxDC - bestDC[k]))) )
+        channel = j;
+    }
+    usedChannel[channel] = true;
+    dutyCyclePWM[channel].maxDC = bestDC[k];
+    for(j = start; j < bestEnd[k]; j++) {
+      internalStatus[motors[j]].channelPWM = channelGenerator[channel];
+    }
+    start = bestEnd[k];
+  }
+
+  // Only the changes are written to the TLE94112
+  bridgeSettings(internalStatus, newSettings);
+  registerWrites = writeBridgeSettings(oldSettings, newSettings);
+  registerWrites += writeChannelSettings(motorsRunning());
+}
+
+unsigned long MotorControl::groupError(const uint8_t* motors, int start, int end, uint8_t &dc) {
+  unsigned long sum, error;
+  long difference;
+  int j;
+
+  if(start == end) {
+    dc = 0;
+    return 0;
+  }
+
+  sum = 0;
+  for(j = start; j < end; j++) {
+    sum += internalStatus[motors[j]].targetDC;
+  }
+  dc = (uint8_t)((sum + (end - start) / 2) / (end - start));
+
+  error = 0;
+  for(j = start; j < end; j++) {
+    difference = (long)internalStatus[motors[j]].targetDC - dc;
+    error += difference * difference;
+  }
+
+  return error;
+}
+
+int MotorControl::motorDCError(int motor) {
+  if(internalStatus[motor].channelPWM == tle94112.TLE_NOPWM)
+    return 0;
+  return (int)internalStatus[motor].targetDC - dutyCyclePWM[internalStatus[motor].channelPWM - 1].maxDC;
+}
+
 // ===============================================================
 // Motor control action
 // ===============================================================
 
 void MotorControl::startMotors(void) {
+  unsigned int stops;
+
+  stops = faultStopCount;
   motorConfigHB();
-  motorPWMStart();
+  // Don't start the PWM if a fault has stopped the motors while
+  // configuring the half bridges
+  if(stops == faultStopCount)
+    motorPWMStart();
 }
 
 void MotorControl::stopMotors(void) {
@@ -241,76 +562,69 @@ void MotorControl::motorPWMStop(void) {
 
 void MotorControl::motorPWMAccelerate(int channel) {
   int j;
+  unsigned long step;
 
   for(j = dutyCyclePWM[channel].minDC; j < dutyCyclePWM[channel].maxDC; j++) {
-    switch(channel + 1){
-      case PWM80_CHID:
-        tle94112.configPWM(tle94112.TLE_PWM1, tle94112.TLE_FREQ80HZ, (uint8_t)j);
-      break;
-      case PWM100_CHID:
-        tle94112.configPWM(tle94112.TLE_PWM2, tle94112.TLE_FREQ100HZ, (uint8_t)j);
-      break;
-      case PWM200_CHID:
-        tle94112.configPWM(tle94112.TLE_PWM3, tle94112.TLE_FREQ200HZ, (uint8_t)j);
-      break;
-    }
+    // The SPI transfers are part of the step time
+    step = controlTick.ticks();
+    configChannelPWM(channel, (uint8_t)j);
     //Check for error
     if(tleCheckDiagnostic()) {
       tleDiagnostic();
     }
-    delay(RAMP_STEP_DELAY);
+    // The fault reaction could have stopped all the motors
+    if(!motorsRunning())
+      break;
+    controlTick.waitTicks(step, RAMP_STEP_DELAY);
   }
 }
 
 void MotorControl::motorPWMRun(int channel) {
-  switch(channel + 1){
-    case PWM80_CHID:
-      tle94112.configPWM(tle94112.TLE_PWM1, tle94112.TLE_FREQ80HZ, dutyCyclePWM[channel].maxDC);
-    break;
-    case PWM100_CHID:
-      tle94112.configPWM(tle94112.TLE_PWM2, tle94112.TLE_FREQ100HZ, dutyCyclePWM[channel].maxDC);
-    break;
-    case PWM200_CHID:
-      tle94112.configPWM(tle94112.TLE_PWM3, tle94112.TLE_FREQ200HZ, dutyCyclePWM[channel].maxDC);
-    break;
-  }
+  configChannelPWM(channel, dutyCyclePWM[channel].maxDC);
 }
 
 void MotorControl::motorPWMHalt(int channel) {
-  switch(channel + 1){
-    case PWM80_CHID:
-      tle94112.configPWM(tle94112.TLE_PWM1, tle94112.TLE_FREQ80HZ, (uint8_t)0);
-    break;
-    case PWM100_CHID:
-      tle94112.configPWM(tle94112.TLE_PWM2, tle94112.TLE_FREQ100HZ, (uint8_t)0);
-    break;
-    case PWM200_CHID:
-      tle94112.configPWM(tle94112.TLE_PWM3, tle94112.TLE_FREQ200HZ, (uint8_t)0);
-    break;
-  }
+  configChannelPWM(channel, 0);
+}
+
+void MotorControl::motorPWMSet(int channel, uint8_t dc) {
+  configChannelPWM(channel, dc);
+}
+
+void MotorControl::motorPWMDither(int channel, uint8_t dc) {
+  // Not a ramp: the diagnostic filters ramp window is not restarted
+  channelDC[channel] = dc;
+  updateBudgetFactor(channel);
+  writeChannelPWM(channel);
+}
+
+void MotorControl::motorReverse(int motor) {
+  if(internalStatus[motor].motorDirection == MOTOR_DIRECTION_CW)
+    internalStatus[motor].motorDirection = MOTOR_DIRECTION_CCW;
+  else
+    internalStatus[motor].motorDirection = MOTOR_DIRECTION_CW;
+
+  if(internalStatus[motor].isRunning)
+    motorConfigHB(motor);
 }
 
 void MotorControl::motorPWMDecelerate(int channel) {
   int j;
+  unsigned long step;
   
   for(j = dutyCyclePWM[channel].maxDC; j > dutyCyclePWM[channel].minDC; j--) {
+    // The SPI transfers are part of the step time
+    step = controlTick.ticks();
     // Update the speed
-    switch(channel + 1){
-      case PWM80_CHID:
-        tle94112.configPWM(tle94112.TLE_PWM1, tle94112.TLE_FREQ80HZ, (uint8_t)j);
-      break;
-      case PWM100_CHID:
-        tle94112.configPWM(tle94112.TLE_PWM2, tle94112.TLE_FREQ100HZ, (uint8_t)j);
-      break;
-      case PWM200_CHID:
-        tle94112.configPWM(tle94112.TLE_PWM3, tle94112.TLE_FREQ200HZ, (uint8_t)j);
-      break;
-    }
+    configChannelPWM(channel, (uint8_t)j);
     //Check for error
     if(tleCheckDiagnostic()) {
       tleDiagnostic();
     }
-    delay(RAMP_STEP_DELAY);
+    // The fault reaction could have stopped all the motors
+    if(!motorsRunning())
+      break;
+    controlTick.waitTicks(step, RAMP_STEP_DELAY);
   }
 }
 
@@ -320,20 +634,25 @@ void MotorControl::motorPWMDecelerate(int channel) {
 
 void MotorControl::motorConfigHB(void) {
   int j;
+  unsigned int stops;
+
+    stops = faultStopCount;
     for(j = 0; j < MAX_MOTORS; j++) {
       motorConfigHB(j);
+      if(stops != faultStopCount)
+        break;
     }
 }
 
 void MotorControl::motorConfigHB(int motor) {
-  if(internalStatus[motor].isEnabled) {
+  if(internalStatus[motor].isEnabled && hasLayout(motor)) {
     if(internalStatus[motor].motorDirection == MOTOR_DIRECTION_CW)
       motorConfigHBCW(motor);
     else
       motorConfigHBCCW(motor);
 
-    if(tleCheckDiagnostic())
-      tleDiagnostic(motor, TLE_MOTOR_STARTING);
+    if(tleCheckDiagnostic(motor))
+      tleDiagnostic(motor, F(TLE_MOTOR_STARTING));
   }
 }
 
@@ -342,675 +661,875 @@ void MotorControl::motorStopHB(void) {
     for(j = 0; j < MAX_MOTORS; j++) {
       if(internalStatus[j].isRunning) {
         motorStopHB(j);
-        if(tleCheckDiagnostic())
-          tleDiagnostic(j, TLE_MOTOR_STOPPING);
+        if(tleCheckDiagnostic(j))
+          tleDiagnostic(j, F(TLE_MOTOR_STOPPING));
       }
     }
 }
 
 void MotorControl::motorStopHB(int motor) {
-  int hb1;
+  if(internalStatus[motor].stopMode == STOP_COAST) {
+    motorReleaseHB(motor);
+    return;
+  }
 
-  // Calculate the first half bridge depending on the motor ID
-  // Note that HB are numbered base 1 while motor is index array base 0
-  // and HB usage is different if high current mode is selected in the
-  // preprocessor directive
-  hb1 = calcHB1(motor + 1);
+  // Set motor stopped
+  internalStatus[motor].isRunning = false;
+
+  // Both the poles of the motor are connected to ground, shorting the motor
+  configPole(bridgeLayout[motor].poleA, tle94112.TLE_LOW, tle94112.TLE_NOPWM, internalStatus[motor].freeWheeling);
+  configPole(bridgeLayout[motor].poleB, tle94112.TLE_LOW, tle94112.TLE_NOPWM, internalStatus[motor].freeWheeling);
+  brakedMotors |= 1 << motor;
+  brakeStartTime[motor] = millis();
+}
 
+void MotorControl::motorReleaseHB(int motor) {
   // Set motor stopped
   internalStatus[motor].isRunning = false;
-  
-  // Select the half bridges to configure the motor.
-  // Depending on the mode (normal = 1 + 1 HB per motor, high current = 2+2)
-  // not all the half bridges can be the first (=hb1)
-  switch(hb1) {
-    // -------------------------------------------------
-    // Motor 1 (in both modes)
-    // -------------------------------------------------
-    case 1: 
-      tle94112.configHB(tle94112.TLE_HB1, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      #ifdef _HIGHCURRENT
-      tle94112.configHB(tle94112.TLE_HB3,  tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      #endif
-    break;
-    // -------------------------------------------------
-    // Motor 2 (no high current mode)
-    // -------------------------------------------------
-    case 3: 
-      tle94112.configHB(tle94112.TLE_HB3, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-    break;
-    // -------------------------------------------------
-    // Motor 3 (Motor 2 in high current mode)
-    // -------------------------------------------------
-    case 5: 
-      tle94112.configHB(tle94112.TLE_HB5, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      #ifdef _HIGHCURRENT
-      tle94112.configHB(tle94112.TLE_HB7,  tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      #endif
-    break;
-    // -------------------------------------------------
-    // Motor 4 (no high current mode)
-    // -------------------------------------------------
-    case 7:  
-      tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-    break;
-    // -------------------------------------------------
-    // Motor 5 ((Motor 3 in high current mode)
-    // -------------------------------------------------
-    case 9: 
-      tle94112.configHB(tle94112.TLE_HB9, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      #ifdef _HIGHCURRENT
-      tle94112.configHB(tle94112.TLE_HB11,  tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      #endif
-    break;
-    // -------------------------------------------------
-    // Motor 6 (no high current mode)
-    // -------------------------------------------------
-    case 11:
-      tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-      tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM);
-    break;
+  brakedMotors &= ~(1 << motor);
+
+  // Both the poles of the motor are left floating
+  configPole(bridgeLayout[motor].poleA, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM, MOTOR_FW_PASSIVE);
+  configPole(bridgeLayout[motor].poleB, tle94112.TLE_FLOATING, tle94112.TLE_NOPWM, MOTOR_FW_PASSIVE);
+}
+
+void MotorControl::brakeService(void) {
+  int j;
+
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(!(brakedMotors & (1 << j)) || (internalStatus[j].stopMode == STOP_BRAKE))
+      continue;
+    // The stop mode could have been changed to coast while braking
+    if( (internalStatus[j].stopMode == STOP_COAST) ||
+        ((millis() - brakeStartTime[j]) >= internalStatus[j].brakeTime) )
+      motorReleaseHB(j);
   }
 }
 
 void MotorControl::motorConfigHBCW(int motor) {
-  int hb1;
-
-  // Calculate the first half bridge depending on the motor ID
-  // Note that HB are numbered base 1 while motor is index array base 0
-  // and HB usage is different if high current mode is selected in the
-  // preprocessor directive
-  hb1 = calcHB1(motor + 1);
+  // Set motor running
+  internalStatus[motor].isRunning = true;
+  brakedMotors &= ~(1 << motor);
+  
+  // Clockwise: the first pole is driven high through the PWM channel
+  // while the second pole is connected to ground
+  configPole(bridgeLayout[motor].poleB, tle94112.TLE_LOW, tle94112.TLE_NOPWM, internalStatus[motor].freeWheeling);
+  configPole(bridgeLayout[motor].poleA, tle94112.TLE_HIGH, 
+             (Tle94112::PWMChannel)internalStatus[motor].channelPWM, internalStatus[motor].freeWheeling);
+}
 
+void MotorControl::motorConfigHBCCW(int motor) {
   // Set motor running
   internalStatus[motor].isRunning = true;
+  brakedMotors &= ~(1 << motor);
   
-  // Select the half bridges to configure the motor.
-  // Depending on the mode (normal = 1 + 1 HB per motor, high current = 2+2)
-  // not all the half bridges can be the first (=hb1)
-  switch(hb1) {
-    // -------------------------------------------------
-    // Motor 1 (in both modes)
-    // -------------------------------------------------
-    case 1: 
-      #ifdef _HIGHCURRENT
-      tle94112.configHB(tle94112.TLE_HB3,  tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #else
-      tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #endif
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          tle94112.configHB(tle94112.TLE_HB1, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM1:
-          tle94112.configHB(tle94112.TLE_HB1, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM2:
-          tle94112.configHB(tle94112.TLE_HB1, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM3:
-          tle94112.configHB(tle94112.TLE_HB1, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-      }
-    break;
-    // -------------------------------------------------
-    // Motor 2 (no high current mode)
-    // -------------------------------------------------
-    case 3: 
-      tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          tle94112.configHB(tle94112.TLE_HB3, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM1:
-          tle94112.configHB(tle94112.TLE_HB3, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM2:
-          tle94112.configHB(tle94112.TLE_HB3, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM3:
-          tle94112.configHB(tle94112.TLE_HB3, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-      }
-    break;
-    // -------------------------------------------------
-    // Motor 3 (Motor 2 in high current mode)
-    // -------------------------------------------------
-    case 5: 
-      #ifdef _HIGHCURRENT
-      tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #else
-      tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #endif
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          tle94112.configHB(tle94112.TLE_HB5, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM1:
-          tle94112.configHB(tle94112.TLE_HB5, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM2:
-          tle94112.configHB(tle94112.TLE_HB5, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM3:
-          tle94112.configHB(tle94112.TLE_HB5, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-      }
-    break;
-    // -------------------------------------------------
-    // Motor 4 (no high current mode)
-    // -------------------------------------------------
-    case 7:  
-      tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM1:
-          tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM2:
-          tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM3:
-          tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-      }
-    break;
-    // -------------------------------------------------
-    // Motor 5 ((Motor 3 in high current mode)
-    // -------------------------------------------------
-    case 9: 
-      #ifdef _HIGHCURRENT
-      tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #else
-      tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #endif
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          tle94112.configHB(tle94112.TLE_HB9, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling );
-          #endif
-        break;
-        case tle94112.TLE_PWM1:
-          tle94112.configHB(tle94112.TLE_HB9, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling );
-          #endif
-        break;
-        case tle94112.TLE_PWM2:
-          tle94112.configHB(tle94112.TLE_HB9, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling );
-          #endif
-        break;
-        case tle94112.TLE_PWM3:
-          tle94112.configHB(tle94112.TLE_HB9, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling );
-          #endif
-        break;
-      }
-    break;
-    // -------------------------------------------------
-    // Motor 6 (no high current mode)
-    // -------------------------------------------------
-    case 11:
-      tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM1:
-          tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM2:
-          tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM3:
-          tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-      }
-    break;
+  // Counterclockwise: the poles are swapped
+  configPole(bridgeLayout[motor].poleA, tle94112.TLE_LOW, tle94112.TLE_NOPWM, internalStatus[motor].freeWheeling);
+  configPole(bridgeLayout[motor].poleB, tle94112.TLE_HIGH, 
+             (Tle94112::PWMChannel)internalStatus[motor].channelPWM, internalStatus[motor].freeWheeling);
+}
+
+void MotorControl::configPole(const uint8_t* pole, Tle94112::HBState state, 
+                              Tle94112::PWMChannel pwmCh, boolean fw) {
+  int j;
+
+  for(j = 0; j < MAX_POLE_HB; j++) {
+    if(pole[j] != HB_NONE) {
+      trace.record(TRACE_HB, pole[j], state, pwmCh | ((uint8_t)fw << 4));
+      tle94112.configHB((Tle94112::HalfBridge)pole[j], state, pwmCh, (uint8_t)fw);
+    }
   }
 }
 
-void MotorControl::motorConfigHBCCW(int motor) {
-  int hb1;
+// ===============================================================
+// Half bridges layout
+// ===============================================================
 
-  // Calculate the first half bridge depending on the motor ID
-  // Note that HB are numbered base 1 while motor is index array base 0
-  // and HB usage is different if high current mode is selected in the
-  // preprocessor directive
-  hb1 = calcHB1(motor + 1);
+void MotorControl::setBridgeLayout(int mode) {
+  int j;
 
-  // Set motor stopped
-  internalStatus[motor].isRunning = true;
-  
-  // Select the half bridges to configure the motor.
-  // Depending on the mode (normal = 1 + 1 HB per motor, high current = 2+2)
-  // not all the half bridges can be the first (=hb1)
-  switch(hb1) {
-    // -------------------------------------------------
-    // Motor 1 (in both modes)
-    // -------------------------------------------------
-    case 1:
-      tle94112.configHB(tle94112.TLE_HB1, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #ifdef _HIGHCURRENT
-      tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #endif
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB3,  tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          #else
-          tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM1:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB3,  tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          #else
-          tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM2:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB3,  tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          #else
-          tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM3:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB3,  tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          #else
-          tle94112.configHB(tle94112.TLE_HB2, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    clearMotorLayout(j);
+    if(mode == LAYOUT_HIGHCURRENT) {
+      // Every pole is connected to two half bridges, only 3 motors
+      if(j < (TLE_HALFBRIDGES / 4)) {
+        bridgeLayout[j].poleA[0] = j * 4 + 1;
+        bridgeLayout[j].poleA[1] = j * 4 + 2;
+        bridgeLayout[j].poleB[0] = j * 4 + 3;
+        bridgeLayout[j].poleB[1] = j * 4 + 4;
       }
-    break;
-    // -------------------------------------------------
-    // Motor 2 (no high current mode)
-    // -------------------------------------------------
-    case 3: 
-      tle94112.configHB(tle94112.TLE_HB3, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM1:
-          tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM2:
-          tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM3:
-          tle94112.configHB(tle94112.TLE_HB4, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
+    }
+    else {
+      // One half bridge every pole
+      bridgeLayout[j].poleA[0] = j * 2 + 1;
+      bridgeLayout[j].poleB[0] = j * 2 + 2;
+    }
+  }
+}
+
+boolean MotorControl::setMotorLayout(int motor, const uint8_t* poleA, const uint8_t* poleB) {
+  int j, k;
+  uint8_t hb;
+  uint16_t usedHB;
+
+  // At least one half bridge every pole is needed
+  if( (poleA[0] == HB_NONE) || (poleB[0] == HB_NONE) )
+    return false;
+
+  // Collect the half bridges used by the other motors
+  usedHB = 0;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(j != motor) {
+      for(k = 0; k < MAX_POLE_HB; k++) {
+        usedHB |= bridgeMask(bridgeLayout[j].poleA[k]);
+        usedHB |= bridgeMask(bridgeLayout[j].poleB[k]);
       }
+    }
+  }
+
+  // Every half bridge should exist and be assigned only once
+  for(k = 0; k < MAX_POLE_HB * 2; k++) {
+    hb = (k < MAX_POLE_HB) ? poleA[k] : poleB[k - MAX_POLE_HB];
+    if(hb == HB_NONE)
+      continue;
+    if( (hb > TLE_HALFBRIDGES) || (usedHB & bridgeMask(hb)) )
+      return false;
+    usedHB |= bridgeMask(hb);
+  }
+
+  for(k = 0; k < MAX_POLE_HB; k++) {
+    bridgeLayout[motor].poleA[k] = poleA[k];
+    bridgeLayout[motor].poleB[k] = poleB[k];
+  }
+
+  return true;
+}
+
+void MotorControl::clearMotorLayout(int motor) {
+  int k;
+
+  for(k = 0; k < MAX_POLE_HB; k++) {
+    bridgeLayout[motor].poleA[k] = HB_NONE;
+    bridgeLayout[motor].poleB[k] = HB_NONE;
+  }
+}
+
+boolean MotorControl::hasLayout(int motor) {
+  return (bridgeLayout[motor].poleA[0] != HB_NONE) && (bridgeLayout[motor].poleB[0] != HB_NONE);
+}
+
+uint16_t MotorControl::bridgeMask(uint8_t hb) {
+  if(hb == HB_NONE)
+    return 0;
+  else
+    return 1 << (hb - 1);
+}
+
+// ===============================================================
+// Diagnostic methods
+// ===============================================================
+
+boolean MotorControl::tleCheckDiagnostic(void) {
+  return tleCheckDiagnostic(NO_MOTOR);
+}
+
+boolean MotorControl::tleCheckDiagnostic(int motor) {
+  int j;
+  uint8_t asserted;
+  unsigned long snapshotTime;
+
+  snapshotTime = micros();
+  diagnosticStatus = tle94112.getSysDiagnosis();
+  notifiedFaults = 0;
+  if(diagnosticStatus == tle94112.TLE_STATUS_OK) {
+    memset(faultSamples, 0, sizeof(faultSamples));
+    return false;
+  }
+
+  // React to the faults before spending any time on the notifications
+  asserted = 0;
+  for(j = 0; j < FAULT_CLASSES; j++) {
+    if(!(diagnosticStatus & faultFlag[j])) {
+      faultSamples[j] = 0;
+      continue;
+    }
+    if(faultSamples[j] < faultPolicy[j].samples)
+      faultSamples[j]++;
+    if( (faultSamples[j] < faultPolicy[j].samples) ||
+        ((millis() - dcChangeTime) < faultPolicy[j].rampWindow) ) {
+      faultFiltered[j]++;
+      continue;
+    }
+    asserted |= 1 << j;
+    faultCount[j]++;
+    tleFaultReaction(j, motor);
+  }
+  faultReactionTime = micros() - snapshotTime;
+  if(faultReactionTime > maxFaultReactionTime)
+    maxFaultReactionTime = faultReactionTime;
+
+  trace.record(TRACE_DIAG, diagnosticStatus, 0, 0);
+  for(j = 0; j < FAULT_CLASSES; j++) {
+    if(!(asserted & (1 << j)) || (faultPolicy[j].action == FAULT_IGNORE))
+      continue;
+    trace.record(TRACE_FAULT, j, faultPolicy[j].action, 0);
+    if( (faultPolicy[j].rateLimit > 0) && (faultCount[j] > 1) &&
+        ((millis() - faultLogTime[j]) < faultPolicy[j].rateLimit) ) {
+      faultMuted[j]++;
+      continue;
+    }
+    faultLogTime[j] = millis();
+    notifiedFaults |= 1 << j;
+  }
+
+  // Filtered and ignored faults are cleared without notification
+  if(notifiedFaults == 0) {
+    tle94112.clearErrors();
+    return false;
+  }
+
+  // Keep the history before the fault
+  trace.faultFreeze();
+  return true;
+}
+
+void MotorControl::tleFaultReaction(int fault, int motor) {
+  int j;
+  boolean stopped;
+
+  switch(faultPolicy[fault].action) {
+    case FAULT_DERATE:
+      faultDerate();
     break;
-    // -------------------------------------------------
-    // Motor 3 (Motor 2 in high current mode)
-    // -------------------------------------------------
-    case 5: 
-      tle94112.configHB(tle94112.TLE_HB5, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #ifdef _HIGHCURRENT
-      tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #endif
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          #else
-          tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM1:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          #else
-          tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM2:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          #else
-          tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
-        case tle94112.TLE_PWM3:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          #else
-          tle94112.configHB(tle94112.TLE_HB6, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          #endif
-        break;
+    case FAULT_STOPMOTOR:
+      // Stop the motors with faulty half bridges, else the motor
+      // that was being configured. If no motor can be found stop all
+      stopped = false;
+      for(j = 0; j < MAX_MOTORS; j++) {
+        if(internalStatus[j].isRunning && bridgeFault(j)) {
+          motorReleaseHB(j);
+          stopped = true;
+        }
       }
-    break;
-    // -------------------------------------------------
-    // Motor 4 (no high current mode)
-    // -------------------------------------------------
-    case 7:  
-      tle94112.configHB(tle94112.TLE_HB7, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM1:
-          tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM2:
-          tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM3:
-          tle94112.configHB(tle94112.TLE_HB8, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
+      if(!stopped) {
+        if(motor != NO_MOTOR)
+          motorReleaseHB(motor);
+        else
+          faultStopAll();
       }
     break;
-    // -------------------------------------------------
-    // // Motor 5 ((Motor 3 in high current mode)
-    // -------------------------------------------------
-    case 9: 
-      tle94112.configHB(tle94112.TLE_HB9, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #ifdef _HIGHCURRENT
-      tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      #endif
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling );
-          #else
-          tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling );
-          #endif
-        break;
-        case tle94112.TLE_PWM1:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling );
-          #else
-          tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling );
-          #endif
-        break;
-        case tle94112.TLE_PWM2:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling );
-          #else
-          tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling );
-          #endif
-        break;
-        case tle94112.TLE_PWM3:
-          #ifdef _HIGHCURRENT
-          tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-          tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling );
-          #else
-          tle94112.configHB(tle94112.TLE_HB10, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling );
-          #endif
-        break;
-      }
+    case FAULT_STOPALL:
+      faultStopAll();
     break;
-    // -------------------------------------------------
-    // Motor 6 (no high current mode)
-    // -------------------------------------------------
-    case 11: 
-      tle94112.configHB(tle94112.TLE_HB11, tle94112.TLE_LOW, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-      switch(internalStatus[motor].channelPWM){
-        case tle94112.TLE_NOPWM:
-          tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_HIGH, tle94112.TLE_NOPWM, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM1:
-          tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_HIGH, tle94112.TLE_PWM1, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM2:
-          tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_HIGH, tle94112.TLE_PWM2, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
-        case tle94112.TLE_PWM3:
-          tle94112.configHB(tle94112.TLE_HB12, tle94112.TLE_HIGH, tle94112.TLE_PWM3, (uint8_t)internalStatus[motor].freeWheeling);
-        break;
+    case FAULT_RETRY:
+      if(motorsRunning()) {
+        faultStopAll();
+        faultRetryPending = true;
+        faultRetryDelay = faultPolicy[fault].retryDelay;
+        faultRetryAttempts = 0;
+        faultRetryTime = millis() + faultRetryDelay;
       }
     break;
   }
 }
 
-// ===============================================================
-// Diagnostic methods
-// ===============================================================
+void MotorControl::faultStopAll(void) {
+  int j;
 
-boolean MotorControl:: tleCheckDiagnostic(void) {
-  if(tle94112.getSysDiagnosis() == tle94112.TLE_STATUS_OK)
-    return false;
-  else
-    return true;
+  // No deceleration: the PWM channels and the half bridges are
+  // immediately set to the safe state
+  faultStopCount++;
+  resetPWM();
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(internalStatus[j].isRunning)
+      motorReleaseHB(j);
+  }
+}
+
+void MotorControl::faultDerate(void) {
+  derateFaultTime = millis();
+  // Step down at most once every DERATE_INTERVAL while the fault persists
+  if( (derateFactor > DERATE_MIN) && 
+      ((derateFactor == DERATE_NONE) || ((millis() - derateStepTime) >= DERATE_INTERVAL)) ) {
+    if(derateFactor - DERATE_STEP > DERATE_MIN)
+      setDerateFactor(derateFactor - DERATE_STEP);
+    else
+      setDerateFactor(DERATE_MIN);
+  }
+}
+
+void MotorControl::derateService(void) {
+  // Restore step by step when no derate faults occurred for DERATE_RESTORE_DELAY
+  if( (derateFactor < DERATE_NONE) && 
+      ((millis() - derateFaultTime) >= DERATE_RESTORE_DELAY) &&
+      ((millis() - derateStepTime) >= DERATE_INTERVAL) ) {
+    if(derateFactor + DERATE_STEP < DERATE_NONE)
+      setDerateFactor(derateFactor + DERATE_STEP);
+    else
+      setDerateFactor(DERATE_NONE);
+  }
 }
 
-void MotorControl::tleDiagnostic(int motor, String message) {
+void MotorControl::setDerateFactor(uint8_t factor) {
+  int j;
+
+  derateFactor = factor;
+  derateStepTime = millis();
+  // Apply the new factor to the current duty cycle of the channels
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    configChannelPWM(j, channelDC[j]);
+  }
+}
+
+void MotorControl::faultService(void) {
+  derateService();
+
+  if(faultRetryPending && ((long)(millis() - faultRetryTime) >= 0)) {
+    faultRetryPending = false;
+    // Restart only if the fault has gone. A persisting fault is notified
+    // and cleared as the first trip, then the restart is attempted again
+    if(tleCheckDiagnostic())
+      tleDiagnostic(NO_MOTOR, F(TLE_RETRY_FAILED));
+    if(diagnosticStatus == tle94112.TLE_STATUS_OK) {
+      faultRetryCount++;
+      startMotors();
+    }
+    else if(++faultRetryAttempts < FAULT_RETRY_MAX) {
+      faultRetryPending = true;
+      faultRetryTime = millis() + faultRetryDelay;
+    }
+    else {
+      faultRetryFailures++;
+      Serial << F(TLE_RETRY_GIVEUP) << endl;
+    }
+  }
+}
+
+boolean MotorControl::motorsRunning(void) {
+  int j;
+
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(internalStatus[j].isRunning)
+      return true;
+  }
+
+  return false;
+}
+
+boolean MotorControl::motorsIdle(void) {
+  return !motorsRunning() && (brakedMotors == 0) && !faultRetryPending;
+}
+
+boolean MotorControl::bridgeFault(int motor) {
+  int k;
+  uint8_t hb;
+
+  for(k = 0; k < MAX_POLE_HB * 2; k++) {
+    if(k < MAX_POLE_HB)
+      hb = bridgeLayout[motor].poleA[k];
+    else
+      hb = bridgeLayout[motor].poleB[k - MAX_POLE_HB];
+    if(hb == HB_NONE)
+      continue;
+    if(tle94112.getHBOverCurrent((Tle94112::HalfBridge)hb) != 0)
+      return true;
+    if(tle94112.getHBOpenLoad((Tle94112::HalfBridge)hb) != 0)
+      return true;
+  }
+
+  return false;
+}
+
+void MotorControl::setFaultPolicy(int fault, uint8_t action, uint16_t retryDelay) {
+  faultPolicy[fault].action = action;
+  faultPolicy[fault].retryDelay = retryDelay;
+}
+
+void MotorControl::setFaultFilter(int fault, uint8_t samples, uint16_t rampWindow, uint16_t rateLimit) {
+  faultPolicy[fault].samples = samples;
+  faultPolicy[fault].rampWindow = rampWindow;
+  faultPolicy[fault].rateLimit = rateLimit;
+}
+
+void MotorControl::resetFaultPolicy(void) {
+  int j;
+
+  for(j = 0; j < FAULT_CLASSES; j++) {
+    setFaultPolicy(j, FAULT_LOG, FAULT_RETRY_DELAY);
+    setFaultFilter(j, FAULT_SAMPLES, FAULT_RAMP_WINDOW, FAULT_RATE_LIMIT);
+    faultCount[j] = faultFiltered[j] = faultMuted[j] = 0;
+    faultSamples[j] = 0;
+  }
+  setFaultFilter(FAULT_LOAD, LOAD_FAULT_SAMPLES, LOAD_RAMP_WINDOW, LOAD_RATE_LIMIT);
+  notifiedFaults = 0;
+  // The TLE94112 has already disabled the outputs: align the motors status
+  faultPolicy[FAULT_UNDERVOLTAGE].action = FAULT_STOPALL;
+  faultPolicy[FAULT_OVERVOLTAGE].action = FAULT_STOPALL;
+  faultPolicy[FAULT_TEMPSHUTDOWN].action = FAULT_STOPALL;
+  // Reduce the speed before the temperature shutdown
+  faultPolicy[FAULT_TEMPWARNING].action = FAULT_DERATE;
+
+  faultRetryPending = false;
+  faultRetryCount = faultRetryFailures = 0;
+  faultStopCount = 0;
+  faultReactionTime = maxFaultReactionTime = 0;
+}
+
+void MotorControl::tleDiagnostic(int motor, const __FlashStringHelper* message) {
   diagnosticHeader = message;
   tleDiagnostic(motor);
-  diagnosticHeader = "";
+  diagnosticHeader = NULL;
+}
+
+void MotorControl::printDiagnosticHeader(int motor) {
+  if(diagnosticHeader != NULL)
+    Serial << diagnosticHeader;
+  if(motor != NO_MOTOR)
+    Serial << F(" Motor ") << motor << F(" - ");
 }
 
 void MotorControl::tleDiagnostic(int motor) {
-  int diagnosis = tle94112.getSysDiagnosis();
+  int j;
 
-  if(diagnosis == tle94112.TLE_STATUS_OK) {
-    Serial << diagnosticHeader << " Motor " << motor << " - " << TLE_NOERROR << endl;
+  if(diagnosticStatus == tle94112.TLE_STATUS_OK) {
+    printDiagnosticHeader(motor);
+    Serial << F(TLE_NOERROR) << endl;
   } // No errors
   else {
-    #ifndef _IGNORE_OPENLOAD
-    if(tle94112.getSysDiagnosis(tle94112.TLE_LOAD_ERROR) != 0) {
-      Serial << diagnosticHeader << " Motor " << motor << " - " << TLE_ERROR_MSG << endl;
-      Serial << TLE_LOADERROR << endl;
-    } // Open load error
-    #endif
-    if(tle94112.getSysDiagnosis(tle94112.TLE_SPI_ERROR) != 0) {
-      Serial << diagnosticHeader << " Motor " << motor << " - " << TLE_ERROR_MSG << endl;
-      Serial << TLE_SPIERROR << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_UNDER_VOLTAGE) != 0) {
-      Serial << diagnosticHeader << " Motor " << motor << " - " << TLE_ERROR_MSG << endl;
-      Serial << TLE_UNDERVOLTAGE << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_OVER_VOLTAGE) != 0) {
-      Serial << diagnosticHeader << " Motor " << motor << " - " << TLE_ERROR_MSG << endl;
-      Serial <<TLE_OVERVOLTAGE << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_POWER_ON_RESET) != 0) {
-      Serial << diagnosticHeader << " Motor " << motor << " - " << TLE_ERROR_MSG << endl;
-      Serial << TLE_POWERONRESET << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_TEMP_SHUTDOWN) != 0) {
-      Serial << diagnosticHeader << " Motor " << motor << " - " << TLE_ERROR_MSG << endl;
-      Serial << TLE_TEMPSHUTDOWN << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_TEMP_WARNING) != 0) {
-      Serial << diagnosticHeader << " Motor " << motor << " - " << TLE_ERROR_MSG << endl;
-      Serial << TLE_TEMPWARNING;
+    for(j = 0; j < FAULT_CLASSES; j++) {
+      if(notifiedFaults & (1 << j)) {
+        printDiagnosticHeader(motor);
+        Serial << F(TLE_ERROR_MSG) << endl;
+        Serial << (const __FlashStringHelper*)pgm_read_ptr(&faultMessage[j]) << endl;
+      }
     }
+    // Check the half bridges assigned to the motor
+    if(motor != NO_MOTOR)
+      tleBridgeDiagnostic(motor);
     // Clear all possible error conditions        
     tle94112.clearErrors();
-    diagnosticHeader = "";
   } // Error condition
 }
 
+void MotorControl::tleBridgeDiagnostic(int motor) {
+  int k;
+  uint8_t hb;
+
+  for(k = 0; k < MAX_POLE_HB * 2; k++) {
+    if(k < MAX_POLE_HB)
+      hb = bridgeLayout[motor].poleA[k];
+    else
+      hb = bridgeLayout[motor].poleB[k - MAX_POLE_HB];
+    if(hb == HB_NONE)
+      continue;
+    if(tle94112.getHBOverCurrent((Tle94112::HalfBridge)hb) != 0) {
+      Serial << F(TLE_HBOVERCURRENT) << hb << endl;
+    }
+    if( (notifiedFaults & (1 << FAULT_LOAD)) && 
+        (tle94112.getHBOpenLoad((Tle94112::HalfBridge)hb) != 0) ) {
+      Serial << F(TLE_HBOPENLOAD) << hb << endl;
+    }
+  }
+}
+
 void MotorControl::tleDiagnostic() {
-  int diagnosis = tle94112.getSysDiagnosis();
+  tleDiagnostic(NO_MOTOR);
+}
 
-  if(diagnosis == tle94112.TLE_STATUS_OK) {
-    Serial << diagnosticHeader << TLE_NOERROR << endl;
-  } // No errors
-  else {
-    diagnosticHeader += TLE_ERROR_MSG;
-    #ifndef _IGNORE_OPENLOAD
-    if(tle94112.getSysDiagnosis(tle94112.TLE_LOAD_ERROR) != 0) {
-      Serial << diagnosticHeader << endl;
-      Serial << TLE_LOADERROR << endl;
-    } // Open load error
-    #endif
-    if(tle94112.getSysDiagnosis(tle94112.TLE_SPI_ERROR) != 0) {
-      Serial << diagnosticHeader << endl;
-      Serial << TLE_SPIERROR << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_UNDER_VOLTAGE) != 0) {
-      Serial << diagnosticHeader << endl;
-      Serial << TLE_UNDERVOLTAGE << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_OVER_VOLTAGE) != 0) {
-      Serial << diagnosticHeader << endl;
-      Serial <<TLE_OVERVOLTAGE << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_POWER_ON_RESET) != 0) {
-      Serial << diagnosticHeader << endl;
-      Serial << TLE_POWERONRESET << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_TEMP_SHUTDOWN) != 0) {
-      Serial << diagnosticHeader << endl;
-      Serial << TLE_TEMPSHUTDOWN << endl;
-    }
-    if(tle94112.getSysDiagnosis(tle94112.TLE_TEMP_WARNING) != 0) {
-      Serial << diagnosticHeader << endl;
-      Serial << TLE_TEMPWARNING;
+// ===============================================================
+// Configuration persistence
+// ===============================================================
+
+void MotorControl::saveConfig(void) {
+  configRecord record;
+
+  record.magic = CONFIG_MAGIC;
+  record.version = CONFIG_VERSION;
+  record.size = sizeof(configRecord);
+  record.autoStart = autoStart;
+  record.powerBudget = powerBudget;
+  memcpy(record.motors, internalStatus, sizeof(record.motors));
+  memcpy(record.channels, dutyCyclePWM, sizeof(record.channels));
+  memcpy(record.layout, bridgeLayout, sizeof(record.layout));
+  memcpy(record.faults, faultPolicy, sizeof(record.faults));
+  record.crc = recordCRC(&record, sizeof(configRecord) - sizeof(record.crc));
+  writeRecord(CONFIG_ADDRESS, &record, sizeof(configRecord));
+}
+
+boolean MotorControl::loadConfig(void) {
+  configRecord record;
+  unsigned int j;
+
+  readRecord(CONFIG_ADDRESS, &record, sizeof(configRecord));
+  if( (record.magic != CONFIG_MAGIC) || (record.version != CONFIG_VERSION) ||
+      (record.size != sizeof(configRecord)) || 
+      (record.crc != recordCRC(&record, sizeof(configRecord) - sizeof(record.crc))) )
+    return false;
+
+  autoStart = record.autoStart;
+  powerBudget = record.powerBudget;
+  memcpy(internalStatus, record.motors, sizeof(record.motors));
+  memcpy(dutyCyclePWM, record.channels, sizeof(record.channels));
+  memcpy(bridgeLayout, record.layout, sizeof(record.layout));
+  memcpy(faultPolicy, record.faults, sizeof(record.faults));
+  // The motors are saved while running, but now are stopped
+  for(j = 0; j < MAX_MOTORS; j++) {
+    internalStatus[j].isRunning = false;
+  }
+
+  resetHB();
+  resetPWM();
+  return true;
+}
+
+void MotorControl::saveProfile(int profile, const char* name) {
+  profileRecord record;
+
+  if((profile < 0) || (profile >= PROFILES))
+    return;
+
+  record.version = CONFIG_VERSION;
+  memset(record.name, 0, PROFILE_NAME_SIZE);
+  strncpy(record.name, name, PROFILE_NAME_SIZE - 1);
+  copySettings(record);
+  record.crc = recordCRC(&record, sizeof(profileRecord) - sizeof(record.crc));
+  writeRecord(PROFILE_ADDRESS + profile * sizeof(profileRecord), &record, sizeof(profileRecord));
+}
+
+boolean MotorControl::readProfile(int profile, profileRecord &record) {
+  // Out of the profiles area the EEPROM contains the configuration
+  if((profile < 0) || (profile >= PROFILES))
+    return false;
+
+  readRecord(PROFILE_ADDRESS + profile * sizeof(profileRecord), &record, sizeof(profileRecord));
+  return (record.version == CONFIG_VERSION) &&
+         (record.crc == recordCRC(&record, sizeof(profileRecord) - sizeof(record.crc)));
+}
+
+int MotorControl::findProfile(const char* name) {
+  profileRecord record;
+  int j;
+
+  for(j = 0; j < PROFILES; j++) {
+    if(readProfile(j, record) && (strncmp(record.name, name, PROFILE_NAME_SIZE) == 0))
+      return j;
+  }
+
+  return NO_PROFILE;
+}
+
+boolean MotorControl::selectProfile(int profile) {
+  profileRecord record;
+
+  if(!readProfile(profile, record))
+    return false;
+
+  applySettings(record);
+  activeProfile = profile;
+
+  return true;
+}
+
+void MotorControl::copySettings(profileRecord &record) {
+  memcpy(record.motors, internalStatus, sizeof(record.motors));
+  memcpy(record.channels, dutyCyclePWM, sizeof(record.channels));
+}
+
+void MotorControl::applySettings(const profileRecord &record) {
+  uint8_t oldSettings[TLE_HALFBRIDGES];
+  uint8_t newSettings[TLE_HALFBRIDGES];
+  boolean running;
+  int j;
+
+  // The half bridges are currently set as the motors running state
+  bridgeSettings(internalStatus, oldSettings);
+  running = motorsRunning();
+
+  memcpy(internalStatus, record.motors, sizeof(record.motors));
+  memcpy(dutyCyclePWM, record.channels, sizeof(record.channels));
+  // If the motors are running all the enabled motors of the profile run
+  hasManualDC = false;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    internalStatus[j].isRunning = running && internalStatus[j].isEnabled && hasLayout(j);
+    if(internalStatus[j].isRunning)
+      brakedMotors &= ~(1 << j);
+  }
+  bridgeSettings(internalStatus, newSettings);
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if(running && dutyCyclePWM[j].manDC)
+      hasManualDC = true;
+  }
+
+  // Only the differences are written, all together before checking the
+  // diagnostic
+  registerWrites = writeBridgeSettings(oldSettings, newSettings);
+  registerWrites += writeChannelSettings(running);
+
+  if(running && tleCheckDiagnostic())
+    tleDiagnostic();
+}
+
+uint8_t MotorControl::writeBridgeSettings(const uint8_t* oldSettings, const uint8_t* newSettings) {
+  uint8_t pwmCh, writes;
+  boolean fw;
+  int j, pass;
+
+  // The half bridges going high are written after the others so a pole is
+  // never driven high while the other pole is still high
+  writes = 0;
+  for(pass = 0; pass < 2; pass++) {
+    for(j = 0; j < TLE_HALFBRIDGES; j++) {
+      if( (newSettings[j] == oldSettings[j]) ||
+          (((newSettings[j] & HB_SETTING_STATE) == tle94112.TLE_HIGH) != (pass == 1)) )
+        continue;
+      pwmCh = (newSettings[j] >> HB_SETTING_PWM_SHIFT) & HB_SETTING_PWM;
+      fw = (newSettings[j] & HB_SETTING_FW) ? MOTOR_FW_ACTIVE : MOTOR_FW_PASSIVE;
+      trace.record(TRACE_HB, j + 1, newSettings[j] & HB_SETTING_STATE, pwmCh | ((uint8_t)fw << 4));
+      tle94112.configHB((Tle94112::HalfBridge)(j + 1), (Tle94112::HBState)(newSettings[j] & HB_SETTING_STATE),
+                        (Tle94112::PWMChannel)pwmCh, (uint8_t)fw);
+      writes++;
     }
-    // Clear all possible error conditions        
-    tle94112.clearErrors();
-    diagnosticHeader = " ";
-  } // Error condition
+  }
+
+  return writes;
+}
+
+uint8_t MotorControl::writeChannelSettings(boolean running) {
+  uint8_t targetDC, writes;
+  int j;
+
+  writes = 0;
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    targetDC = running ? dutyCyclePWM[j].maxDC : 0;
+    if( (targetDC != channelDC[j]) || (dutyCyclePWM[j].frequency != channelFrequency[j]) ) {
+      configChannelPWM(j, targetDC);
+      writes++;
+    }
+  }
+
+  return writes;
+}
+
+void MotorControl::bridgeSettings(const motorStatus* motors, uint8_t* settings) {
+  int j;
+  uint8_t fw;
+
+  // The floating half bridges are not driven, so PWM and free wheeling
+  // don't matter
+  for(j = 0; j < TLE_HALFBRIDGES; j++) {
+    settings[j] = tle94112.TLE_FLOATING;
+  }
+
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(motors[j].isRunning) {
+      fw = motors[j].freeWheeling ? HB_SETTING_FW : 0;
+      if(motors[j].motorDirection == MOTOR_DIRECTION_CW) {
+        poleSettings(bridgeLayout[j].poleB, tle94112.TLE_LOW | fw, settings);
+        poleSettings(bridgeLayout[j].poleA, 
+                     tle94112.TLE_HIGH | fw | (motors[j].channelPWM << HB_SETTING_PWM_SHIFT), settings);
+      }
+      else {
+        poleSettings(bridgeLayout[j].poleA, tle94112.TLE_LOW | fw, settings);
+        poleSettings(bridgeLayout[j].poleB, 
+                     tle94112.TLE_HIGH | fw | (motors[j].channelPWM << HB_SETTING_PWM_SHIFT), settings);
+      }
+    }
+    else if(brakedMotors & (1 << j)) {
+      // Braked motor, both poles low
+      fw = motors[j].freeWheeling ? HB_SETTING_FW : 0;
+      poleSettings(bridgeLayout[j].poleA, tle94112.TLE_LOW | fw, settings);
+      poleSettings(bridgeLayout[j].poleB, tle94112.TLE_LOW | fw, settings);
+    }
+  }
+}
+
+void MotorControl::poleSettings(const uint8_t* pole, uint8_t setting, uint8_t* settings) {
+  int j;
+
+  for(j = 0; j < MAX_POLE_HB; j++) {
+    if(pole[j] != HB_NONE)
+      settings[pole[j] - 1] = setting;
+  }
+}
+
+void MotorControl::writeRecord(int address, const void* record, unsigned int length) {
+  unsigned int j;
+
+  // Only the changed bytes are written, to save the EEPROM cycles
+  for(j = 0; j < length; j++) {
+    EEPROM.update(address + j, ((const uint8_t*)record)[j]);
+  }
+}
+
+void MotorControl::readRecord(int address, void* record, unsigned int length) {
+  unsigned int j;
+
+  for(j = 0; j < length; j++) {
+    ((uint8_t*)record)[j] = EEPROM.read(address + j);
+  }
+}
+
+uint16_t MotorControl::recordCRC(const void* record, unsigned int length) {
+  const uint8_t* data;
+  uint16_t crc;
+  unsigned int j;
+  int k;
+
+  data = (const uint8_t*)record;
+  crc = 0xffff;
+  for(j = 0; j < length; j++) {
+    crc ^= (uint16_t)data[j] << 8;
+    for(k = 0; k < 8; k++) {
+      if(crc & 0x8000)
+        crc = (crc << 1) ^ 0x1021;
+      else
+        crc <<= 1;
+    }
+  }
+
+  return crc;
 }
 
 // ===============================================================
 // Dump system configuration to serial
 // ===============================================================
 
-void MotorControl::showInfo(void) {
+int MotorControl::printPole(const uint8_t* pole) {
   int j;
+  int len;
+
+  len = 0;
+  for(j = 0; j < MAX_POLE_HB; j++) {
+    if(pole[j] != HB_NONE) {
+      if(j > 0) {
+        Serial << F("+");
+        len++;
+      }
+      Serial << pole[j];
+      len += (pole[j] < 10) ? 1 : 2;
+    }
+  }
+
+  return len;
+}
+
+void MotorControl::showInfo(void) {
+  int j, k;
   // Motor table header
-  Serial << INFO_MAIN_HEADER1 << endl << INFO_MOTORS_TITLE << endl << INFO_MAIN_HEADER1 << endl;
-  Serial << INfO_TAB_HEADER2 << endl << INfO_TAB_HEADER1 << endl << INfO_TAB_HEADER2 << endl;
+  Serial << F(INFO_MAIN_HEADER1) << endl << F(INFO_MOTORS_TITLE) << endl << F(INFO_MAIN_HEADER1) << endl;
+  Serial << F(INfO_TAB_HEADER2) << endl << F(INfO_TAB_HEADER1) << endl << F(INfO_TAB_HEADER2) << endl;
   // Build the motors settings table data
   for (j = 0; j < MAX_MOTORS; j++) {
     // #1 - Motor
-    Serial << INFO_FIELD1A << (j + 1) << INFO_FIELD1B;
+    Serial << F(INFO_FIELD1A) << (j + 1) << F(INFO_FIELD1B);
     // #2 - Enabled
     if(internalStatus[j].isEnabled)
-      Serial << INFO_FIELD2Y;
+      Serial << F(INFO_FIELD2Y);
     else
-      Serial << INFO_FIELD2N;
+      Serial << F(INFO_FIELD2N);
     // #3 - Active freewheeling
     if(internalStatus[j].freeWheeling)
-      Serial << INFO_FIELD4Y;
+      Serial << F(INFO_FIELD4Y);
     else
-      Serial << INFO_FIELD4N;
+      Serial << F(INFO_FIELD4N);
     // #4 - Direction
     if(internalStatus[j].motorDirection == MOTOR_DIRECTION_CW)
-      Serial << INFO_FIELD8A;
+      Serial << F(INFO_FIELD8A);
     else
-      Serial << INFO_FIELD8B;
-    // #5 - PWM
-    switch(internalStatus[j].channelPWM) {
-      case tle94112.TLE_NOPWM:
-        Serial << INFO_FIELD9_NO;
-      break;
-      case tle94112.TLE_PWM1:
-        Serial << INFO_FIELD9_80;
+      Serial << F(INFO_FIELD8B);
+    // #5 - PWM frequency
+    if(internalStatus[j].channelPWM == tle94112.TLE_NOPWM)
+      Serial << F(INFO_FIELD9_NO);
+    else
+      switch(dutyCyclePWM[internalStatus[j].channelPWM - 1].frequency) {
+        case tle94112.TLE_FREQ80HZ:
+          Serial << F(INFO_FIELD9_80);
+        break;
+        case tle94112.TLE_FREQ100HZ:
+          Serial << F(INFO_FIELD9_100);
+        break;
+        case tle94112.TLE_FREQ200HZ:
+          Serial << F(INFO_FIELD9_200);
+        break;
+        case tle94112.TLE_FREQ2KHZ:
+          Serial << F(INFO_FIELD9_2K);
+        break;
+      }
+    // #6 - Stop mode
+    switch(internalStatus[j].stopMode) {
+      case STOP_COAST:
+        Serial << F(INFO_FIELD12_COAST);
       break;
-      case tle94112.TLE_PWM2:
-        Serial << INFO_FIELD9_100;
+      case STOP_BRAKE:
+        Serial << F(INFO_FIELD12_BRAKE);
       break;
-      case tle94112.TLE_PWM3:
-        Serial << INFO_FIELD9_200;
+      case STOP_BRAKE_FLOAT:
+        Serial << F(INFO_FIELD12_FLOAT);
       break;
     }
-    Serial << endl << INfO_TAB_HEADER2 << endl;
+    // #7 - Half bridges
+    if(hasLayout(j)) {
+      Serial << F(" ");
+      k = 1 + printPole(bridgeLayout[j].poleA);
+      Serial << F("/");
+      k += 1 + printPole(bridgeLayout[j].poleB);
+    }
+    else {
+      Serial << F(INFO_FIELD11_NO);
+      k = sizeof(INFO_FIELD11_NO) - 1;
+    }
+    for( ; k < INFO_FIELD11_WIDTH; k++) {
+      Serial << F(" ");
+    }
+    Serial << F("|");
+    Serial << endl << F(INfO_TAB_HEADER2) << endl;
   }
 
   // PWM table header
-  Serial << endl << INFO_MAIN_HEADER2 << endl << INFO_PWM_TITLE << endl << INFO_MAIN_HEADER2 << endl;
-  Serial << INfO_TAB_HEADER4 << endl << INfO_TAB_HEADER3 << endl << INfO_TAB_HEADER4 << endl;
+  Serial << endl << F(INFO_MAIN_HEADER2) << endl << F(INFO_PWM_TITLE) << endl << F(INFO_MAIN_HEADER2) << endl;
+  Serial << F(INfO_TAB_HEADER4) << endl << F(INfO_TAB_HEADER3) << endl << F(INfO_TAB_HEADER4) << endl;
   // Build the pwm settings table data
   for (j = 0; j < AVAIL_PWM_CHANNELS; j++) {
-    // #1 - PWM
-    switch(j) {
-      case 0:
-        Serial << INFO_FIELD10_80;
+    // #1 - PWM frequency
+    switch(dutyCyclePWM[j].frequency) {
+      case tle94112.TLE_FREQ80HZ:
+        Serial << F(INFO_FIELD10_80);
+      break;
+      case tle94112.TLE_FREQ100HZ:
+        Serial << F(INFO_FIELD10_100);
       break;
-      case 1:
-        Serial << INFO_FIELD10_100;
+      case tle94112.TLE_FREQ200HZ:
+        Serial << F(INFO_FIELD10_200);
       break;
-      case 2:
-        Serial << INFO_FIELD10_200;
+      case tle94112.TLE_FREQ2KHZ:
+        Serial << F(INFO_FIELD10_2K);
       break;
     }
     // #2 - DC Min
-    Serial << INFO_FIELD5_6A;
+    Serial << F(INFO_FIELD5_6A);
     if(dutyCyclePWM[j].minDC < 10)
-      Serial << "  ";
+      Serial << F("  ");
     else 
       if(dutyCyclePWM[j].minDC < 100)
-        Serial << " ";
-    Serial << dutyCyclePWM[j].minDC << INFO_FIELD5_6B;
+        Serial << F(" ");
+    Serial << dutyCyclePWM[j].minDC << F(INFO_FIELD5_6B);
     // #3 - DC Max
-    Serial << INFO_FIELD5_6A;
+    Serial << F(INFO_FIELD5_6A);
     if(dutyCyclePWM[j].maxDC < 100)
-      Serial << " ";
-    Serial << dutyCyclePWM[j].maxDC << INFO_FIELD5_6B;
+      Serial << F(" ");
+    Serial << dutyCyclePWM[j].maxDC << F(INFO_FIELD5_6B);
     // #4 - Manual DC
     if(dutyCyclePWM[j].manDC)
-      Serial << INFO_FIELD7Y;
+      Serial << F(INFO_FIELD7Y);
     else
-      Serial << INFO_FIELD7N;
+      Serial << F(INFO_FIELD7N);
     // #5 - Acceleration
     if(dutyCyclePWM[j].useRamp)
-      Serial << INFO_FIELD3Y;
+      Serial << F(INFO_FIELD3Y);
     else
-      Serial << INFO_FIELD3N;
+      Serial << F(INFO_FIELD3N);
     
-    Serial << endl << INfO_TAB_HEADER4 << endl;
+    Serial << endl << F(INfO_TAB_HEADER4) << endl;
   }
 }
 
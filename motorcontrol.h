@@ -25,6 +25,19 @@ struct motorStatus {
   boolean isRunning;      ///< Motor running status (should be enabled)
   boolean freeWheeling;   ///< Free wheeling active or passive
   int motorDirection;     ///< Current motor direction
+  uint8_t targetDC;       ///< Requested duty cycle, used by the PWM channels allocation
+  uint8_t stopMode;       ///< Half bridges setting on stop (STOP_COAST, STOP_BRAKE, ...)
+  uint16_t brakeTime;     ///< Brake time (ms) before floating with STOP_BRAKE_FLOAT
+  uint8_t powerWeight;    ///< Weight of the motor in the power budget
+};
+
+/**
+ * Half bridges connected to the two poles of a motor. Every pole
+ * can use one or two half bridges in parallel (HB_NONE if not used)
+ */
+struct motorLayout {
+  uint8_t poleA[MAX_POLE_HB];   ///< Half bridges of the pole driven high clockwise
+  uint8_t poleB[MAX_POLE_HB];   ///< Half bridges of the pole driven high counterclockwise
 };
 
 /**
@@ -36,23 +49,71 @@ struct pwmStatus {
   uint8_t minDC;          ///< Min duty cycle value
   uint8_t maxDC;          ///< Max duty cycle value
   boolean manDC;          ///< Manual duty cycle flag
+  uint8_t frequency;      ///< PWM frequency (Tle94112::PWMFreq)
+};
+
+/**
+ * Reaction to a fault class
+ */
+struct faultStatus {
+  uint8_t action;         ///< Fault reaction (FAULT_IGNORE, FAULT_LOG, ...)
+  uint16_t retryDelay;    ///< Delay (ms) before restarting with FAULT_RETRY
+  uint8_t samples;        ///< Consecutive samples to assert the fault
+  uint16_t rampWindow;    ///< Time (ms) after a duty cycle change when the fault is suppressed
+  uint16_t rateLimit;     ///< Min time (ms) between two notifications
 };
 
+/**
+ * Configuration saved in the EEPROM, protected by a CRC
+ */
+struct configRecord {
+  uint8_t magic;                            ///< CONFIG_MAGIC
+  uint8_t version;                          ///< CONFIG_VERSION
+  uint16_t size;                            ///< Size of the record
+  boolean autoStart;                        ///< Start the motors on power up
+  motorStatus motors[MAX_MOTORS];           ///< Motors settings
+  pwmStatus channels[AVAIL_PWM_CHANNELS];   ///< PWM channels settings
+  motorLayout layout[MAX_MOTORS];           ///< Half bridges layout
+  faultStatus faults[FAULT_CLASSES];        ///< Fault reactions
+  uint16_t powerBudget;                     ///< Power budget, NO_POWER_BUDGET if not limited
+  uint16_t crc;                             ///< CRC of all the previous fields
+};
+
+/**
+ * Motors and PWM settings profile saved in the EEPROM
+ */
+struct profileRecord {
+  uint8_t version;                          ///< CONFIG_VERSION
+  char name[PROFILE_NAME_SIZE];             ///< Profile name, zero terminated
+  motorStatus motors[MAX_MOTORS];           ///< Motors settings
+  pwmStatus channels[AVAIL_PWM_CHANNELS];   ///< PWM channels settings
+  uint16_t crc;                             ///< CRC of all the previous fields
+};
+
+//! EEPROM address of the first profile, after the configuration
+#define PROFILE_ADDRESS (((CONFIG_ADDRESS + sizeof(configRecord) + PROFILE_ALIGN - 1) / PROFILE_ALIGN) * PROFILE_ALIGN)
+//! EEPROM size of the board
+#define EEPROM_SIZE (E2END + 1)
+
+static_assert(CONFIG_ADDRESS + sizeof(configRecord) <= PROFILE_ADDRESS,
+              "The configuration overlaps the profiles");
+static_assert(PROFILE_ADDRESS + PROFILES * sizeof(profileRecord) <= EEPROM_SIZE,
+              "The profiles don't fit in the EEPROM");
+
 /**
  * \brief  Class to control the TLE94112 Arduino shield
  * 
- * The class control three PWM channels and two ranges of motors.
- * If _HIGH_CURRENT is defined are used two half bridges every motor pole
- * so only 3 max motors are allowed else 6 motors can be managed
+ * The class control three PWM channels and up to six motors.
+ * Every motor pole is connected to one or two half bridges according
+ * to the runtime layout in bridgeLayout[], so a mix of high current
+ * motors (2+2 half bridges) and standard motors (1+1) can be managed
  * 
- * In this class we define an hardcoded assumption presetting the three PWM 
- * frequencies associated by default to the three channels. 
- * A different frequency can be associated
- * to every motor selecting the corresponding PWM channel ID.\n
- * With this choice we loose the option to assgin the same frequency to two
- * different PWM channels and different duty cycles but it a meaningless
- * limitation that can be considered acceptable considering the flexibility
- * of the entire class.
+ * The three PWM channels start at 80, 100 and 200 Hz, but the frequency of
+ * every channel can be changed at runtime (setPWMFrequency()) and saved with
+ * the configuration, so two channels can share the same frequency with
+ * different duty cycles. A motor uses the PWM channel assigned with setPWM(),
+ * or the one assigned by allocatePWM() grouping the requested duty cycles of
+ * the motors on the available channels.
  */
 class MotorControl {
   public:
@@ -65,21 +126,69 @@ class MotorControl {
     motorStatus internalStatus[MAX_MOTORS];
     //! Status of the PWM duty cycle
     pwmStatus dutyCyclePWM[AVAIL_PWM_CHANNELS];
-    //! Compound diagnostic string. Used when motor number is available
-    String diagnosticHeader;
+    //! Half bridges assigned to every motor
+    motorLayout bridgeLayout[MAX_MOTORS];
+    //! Diagnostic message header (flash string or NULL). Used when motor number is available
+    const __FlashStringHelper* diagnosticHeader;
     //! The last duty cycle value read from the analog input (manual duty cycle settings)
     uint8_t lastAnalogDC;
     //! The previous duty cycle value read from the analog input (manual duty cycle settings)
     uint8_t prevAnalogDC;
     //! Global flag is one (or more) of the PWM channels are set to manualDC
     boolean hasManualDC;
+    //! Last diagnostic status read from the TLE94112
+    uint8_t diagnosticStatus;
+    //! Reaction policy of every fault class
+    faultStatus faultPolicy[FAULT_CLASSES];
+    //! Number of times every fault class has been asserted
+    unsigned int faultCount[FAULT_CLASSES];
+    //! Number of detections of every fault class discarded by the samples or ramp filters
+    unsigned int faultFiltered[FAULT_CLASSES];
+    //! Number of notifications of every fault class discarded by the rate limit
+    unsigned int faultMuted[FAULT_CLASSES];
+    //! Number of times the motors have been stopped by a fault reaction
+    unsigned int faultStopCount;
+    //! Number of restarts after a FAULT_RETRY reaction
+    unsigned int faultRetryCount;
+    //! Number of FAULT_RETRY reactions given up after FAULT_RETRY_MAX attempts
+    unsigned int faultRetryFailures;
+    //! Time (us) from the last diagnostic snapshot to the end of the fault reaction
+    unsigned long faultReactionTime;
+    //! Worst case time (us) from the diagnostic snapshot to the end of the fault reaction
+    unsigned long maxFaultReactionTime;
+    //! Percentage of the duty cycle applied to the PWM channels (DERATE_NONE = no derating)
+    uint8_t derateFactor;
+    //! Power budget, NO_POWER_BUDGET if the demand is not limited
+    uint16_t powerBudget;
+    //! Last power demand of the running motors, before the budget limit
+    uint16_t powerDemand;
+    //! Percentage of the duty cycle applied to the PWM channels to stay within
+    //! the power budget (BUDGET_NONE = not limited)
+    uint8_t budgetFactor;
+    //! Number of times the power budget has started limiting the duty cycle
+    unsigned int budgetLimits;
+    //! Last duty cycle requested for every PWM channel, before derating
+    uint8_t channelDC[AVAIL_PWM_CHANNELS];
+    //! Last duty cycle written to every PWM channel, after derating and budget
+    uint8_t appliedDC[AVAIL_PWM_CHANNELS];
+    //! Last frequency written to every PWM channel
+    uint8_t channelFrequency[AVAIL_PWM_CHANNELS];
+    //! Start the motors on power up, saved with the configuration
+    boolean autoStart;
+    //! The saved configuration has been restored by begin()
+    boolean configLoaded;
+    //! Last profile selected, NO_PROFILE after a reset
+    int activeProfile;
+    //! Number of TLE94112 registers written by the last profile switch or
+    //! PWM channels allocation
+    uint8_t registerWrites;
 
     /** 
      * \brief Initialization and motor settings 
      * 
-     * The initialization method support two hardcoded modes, depending on the
-     * kind of geared motor it is used.\n
-     * In _HIGHCURRENT mode every motor uses two half bridges couple together for every 
+     * The half bridges layout is initialised to DEFAULT_LAYOUT, then the
+     * configuration saved in the EEPROM, if any, is restored.
+     * In high current mode every motor uses two half bridges couple together for every 
      * pole if more than 0.9A is needed (< 0.18)\n
      * The standard usage mode is in low current mode with a single half bridge every motor pole
      */
@@ -88,12 +197,83 @@ class MotorControl {
     //! \brief stop the motor control
     void end(void);
 
+    /**
+     * \brief Enable the TLE94112 again after end(), keeping the current
+     * settings. The PWM channels are written again as the registers are
+     * reset by the device sleep; the motors should be stopped
+     */
+    void wake(void);
+
     /**
      * \brief initialize the motor default settings and disable all the motors
      * Launched when the class is initialised.
      */
     void reset(void);
 
+    /**
+     * \brief Save the motors, PWM, layout and fault settings in the EEPROM
+     */
+    void saveConfig(void);
+
+    /**
+     * \brief Restore the settings saved in the EEPROM. The motors should be stopped
+     * 
+     * \return true if a valid configuration has been found and restored
+     */
+    boolean loadConfig(void);
+
+    /**
+     * \brief Save the current motors and PWM settings as a profile
+     * 
+     * \param profile The profile number (base 0), ignored if out of range
+     * \param name The profile name, truncated to PROFILE_NAME_SIZE - 1 characters
+     */
+    void saveProfile(int profile, const char* name);
+
+    /**
+     * \brief Switch to a saved profile
+     * 
+     * If the motors are running, the enabled motors of the profile keep running
+     * and only the half bridges and PWM channels settings that are different are
+     * written to the TLE94112, without stopping the motors.
+     * 
+     * \param profile The profile number (base 0)
+     * \return false if the profile is out of range or has not been saved
+     */
+    boolean selectProfile(int profile);
+
+    /**
+     * \brief Search a saved profile by name
+     * 
+     * \param name The profile name
+     * \return The profile number, NO_PROFILE if not found
+     */
+    int findProfile(const char* name);
+
+    /**
+     * \brief Read a saved profile
+     * 
+     * \param profile The profile number (base 0)
+     * \param record The profile read from the EEPROM
+     * \return true if the profile is in range and valid
+     */
+    boolean readProfile(int profile, profileRecord &record);
+
+    /**
+     * \brief Copy the current motors and PWM settings, e.g. to restore them
+     * with applySettings()
+     * 
+     * \param record The settings, the name and the CRC are not set
+     */
+    void copySettings(profileRecord &record);
+
+    /**
+     * \brief Apply the motors and PWM settings, as selectProfile() does
+     * 
+     * \param record The settings to apply
+     */
+    void applySettings(const profileRecord &record);
+
     /**
      * \brief Reset all the half bridges immediately stopping the motors
      */
@@ -123,6 +303,23 @@ class MotorControl {
       */
     void setMotorDirection(int dir);
 
+    /**
+     * \brief Set the frequency of the selected PWM channel (all the channels
+     * if no channel is selected). The frequency is applied immediately
+     * 
+     * \param hz The frequency in Hz, one of the TLE94112 frequencies
+     * \return false if the frequency is not supported
+     */
+    boolean setPWMFrequency(unsigned int hz);
+
+    /**
+     * \brief Search a supported PWM frequency
+     * 
+     * \param hz The frequency in Hz
+     * \return The TLE94112 frequency (Tle94112::PWMFreq), -1 if not supported
+     */
+    int findPWMFrequency(unsigned int hz);
+
     /**
      * \brief Enable or disable the acceleration/deceleration sequence
      * for the desired PWM channel
@@ -174,6 +371,33 @@ class MotorControl {
      * \param channel the selectedPWM channel
      */
     void motorPWMHalt(int channel);
+
+    /**
+     * \brief Set the PWM channel duty cycle immediately, without changing
+     * the channel settings
+     * 
+     * \param channel the selectedPWM channel
+     * \param dc the duty cycle
+     */
+    void motorPWMSet(int channel, uint8_t dc);
+
+    /**
+     * \brief Set the duty cycle of a dithered PWM channel, or of a channel
+     * following a waveform or the speed control. The small step changes are
+     * not ramps, so the diagnostic filters ramp window is not restarted
+     * 
+     * \param channel the selected PWM channel (base 0)
+     * \param dc the duty cycle
+     */
+    void motorPWMDither(int channel, uint8_t dc);
+
+    /**
+     * \brief Reverse the motor direction. If the motor is running the half
+     * bridges are immediately set for the new direction
+     * 
+     * \param motor the motor (base 0)
+     */
+    void motorReverse(int motor);
     
     /**
      * Enable or disable the freewheeling flag
@@ -182,6 +406,14 @@ class MotorControl {
      */
     void setMotorFreeWheeling(boolean fw);
 
+    /**
+     * Set the stop mode of the selected motor, or all the motors
+     * 
+     * \param mode The stop mode: STOP_COAST, STOP_BRAKE or STOP_BRAKE_FLOAT
+     * \param time The brake time (ms) before floating with STOP_BRAKE_FLOAT
+     */
+    void setMotorStopMode(uint8_t mode, uint16_t time);
+
     /**
      * \brief Set the state flag for duty cycle mode. 
      * 
@@ -216,6 +448,35 @@ class MotorControl {
      */
     void setPWMMaxDC(uint8_t dc);
 
+    /**
+     * \brief Set the requested duty cycle of the selected motor (all the motors
+     * if no motor is selected) and allocate the PWM channels
+     * 
+     * \param dc The requested duty cycle
+     */
+    void setMotorDC(uint8_t dc);
+
+    /**
+     * \brief Allocate the PWM channels to the enabled motors
+     * 
+     * The requested duty cycles of the enabled motors are grouped on the
+     * available PWM channels with the min squared error, and the PWM channels
+     * are assigned keeping the current duty cycle of the channels as close as
+     * possible. If the motors are running, only the changed half bridges and
+     * PWM channels are written to the TLE94112. 
+     * The PWM channels frequency is not considered.
+     */
+    void allocatePWM(void);
+
+    /**
+     * \brief Difference between the requested duty cycle of a motor and the
+     * duty cycle of its PWM channel
+     * 
+     * \param motor The motor (base 0)
+     * \return The duty cycle error, 0 if the motor has no PWM
+     */
+    int motorDCError(int motor);
+
     /**
      * \brief Start all enabled motors
      */
@@ -268,6 +529,41 @@ class MotorControl {
      */
     void motorConfigHBCCW(int motor);
 
+    /**
+     * \brief Apply one of the predefined half bridges layouts to all the motors
+     * 
+     * \param mode LAYOUT_STANDARD or LAYOUT_HIGHCURRENT
+     */
+    void setBridgeLayout(int mode);
+
+    /**
+     * \brief Assign the half bridges to the poles of a motor
+     * 
+     * The layout is rejected if a pole has no half bridges or if one
+     * of the half bridges is already used by another motor.
+     * 
+     * \param motor The motor ID (base 0)
+     * \param poleA MAX_POLE_HB half bridges of the first pole (HB_NONE if unused)
+     * \param poleB MAX_POLE_HB half bridges of the second pole (HB_NONE if unused)
+     * \return true if the layout has been applied
+     */
+    boolean setMotorLayout(int motor, const uint8_t* poleA, const uint8_t* poleB);
+
+    /**
+     * \brief Remove all the half bridges from a motor
+     * 
+     * \param motor The motor ID (base 0)
+     */
+    void clearMotorLayout(int motor);
+
+    /**
+     * \brief Check if the motor has half bridges assigned to both the poles
+     * 
+     * \param motor The motor ID (base 0)
+     * \return true if the motor can be used
+     */
+    boolean hasLayout(int motor);
+
     /*
      * \brief Stop all running motors
      * 
@@ -279,11 +575,48 @@ class MotorControl {
     /*
      * \brief Stop the specified motor
      * 
-     * This method stops immediately the selected motor resetting the half bridges
-     * and deactivating the PWM if active
+     * This method stops immediately the selected motor setting the half bridges
+     * as the motor stop mode: floating, or both low to brake the motor
      */
     void motorStopHB(int motor);
 
+    /*
+     * \brief Leave the half bridges of the specified motor floating
+     * 
+     * This method stops immediately the selected motor regardless of the
+     * stop mode, or releases the brake
+     */
+    void motorReleaseHB(int motor);
+
+    /**
+     * \brief Set the power budget weight of the selected motor (all the
+     * motors if no motor is selected)
+     * 
+     * \param weight The weight, up to MAX_POWER_WEIGHT
+     */
+    void setPowerWeight(uint8_t weight);
+
+    /**
+     * \brief Set the power budget and apply it to the PWM channels
+     * 
+     * \param budget The budget, up to MAX_POWER_BUDGET, NO_POWER_BUDGET
+     * to not limit the duty cycle
+     */
+    void setPowerBudget(uint16_t budget);
+
+    /**
+     * \brief Update the budget factor when the running motors or their
+     * weights have changed. Should be called by the main loop; the duty
+     * cycle changes are applied immediately
+     */
+    void powerService(void);
+
+    /**
+     * \brief Release the brake of the motors stopped with STOP_BRAKE_FLOAT
+     * when the brake time is expired. Should be called by the main loop
+     */
+    void brakeService(void);
+
     /** 
      * \brief Show Current motors configuration in a table and the PWM settings on
      * another to the serial terminal
@@ -293,34 +626,307 @@ class MotorControl {
     /**
      * Check if an error occured.
      * 
-     * \note This method should be used for test the error condition only as it does not
+     * The diagnostic status is saved in diagnosticStatus and the reaction
+     * policy of every fault asserted by the diagnostic filters is applied
+     * immediately, before any notification. The reaction time is measured.
      * 
-     * \return true if tehre is an error
+     * \return true if there is an error that should be notified with tleDiagnostic()
      */
     boolean tleCheckDiagnostic(void);
 
     /**
-     * Check the error condition and detect the kind of error (if any) then reset it
+     * Check if an error occured while a motor was configured
      * 
-     * \return The error string
-     * \todo Check the harfbridge generating the specific error 
+     * \param motor The motor ID (base 0) being configured, or NO_MOTOR
+     * \return true if there is an error that should be notified with tleDiagnostic()
+     */
+    boolean tleCheckDiagnostic(int motor);
+
+    /**
+     * Show the errors detected by the last tleCheckDiagnostic() then reset them
      */
     void tleDiagnostic(void);
 
     /**
-     * Check the error condition and detect the kind of error (if any) then reset it
+     * Show the errors detected by the last tleCheckDiagnostic() then reset them
      * 
-     * \ param motor The motor ID (base 0) that has generated the error
+     * \param motor The motor ID (base 0) that has generated the error
      */
     void tleDiagnostic(int motor);
 
     /**
-     * Check the error conditions and detect the kind of error (if any) then reset it
+     * Show the errors detected by the last tleCheckDiagnostic() then reset them
+     * 
+     * \param motor The motor ID (base 0) that has generated the error
+     * \param message A generic flash string message for better explanation
+     */
+    void tleDiagnostic(int motor, const __FlashStringHelper* message);
+
+    /**
+     * \brief Set the reaction to a fault class
+     * 
+     * \param fault The fault class (FAULT_SPI, FAULT_LOAD, ...)
+     * \param action The reaction (FAULT_IGNORE, FAULT_LOG, ...)
+     * \param retryDelay Delay (ms) before restarting, used by FAULT_RETRY
+     */
+    void setFaultPolicy(int fault, uint8_t action, uint16_t retryDelay);
+
+    /**
+     * \brief Set the diagnostic filter of a fault class
+     *
+     * \param fault The fault class (FAULT_SPI, FAULT_LOAD, ...)
+     * \param samples Consecutive samples to assert the fault, 1 to FAULT_MAX_SAMPLES
+     * \param rampWindow Time (ms) after a duty cycle change when the fault
+     * is suppressed, 0 = never
+     * \param rateLimit Min time (ms) between two notifications, 0 = no limit
+     */
+    void setFaultFilter(int fault, uint8_t samples, uint16_t rampWindow, uint16_t rateLimit);
+
+    /**
+     * \brief Set the default fault reactions and filters and reset the fault counters
+     */
+    void resetFaultPolicy(void);
+
+    /**
+     * \brief Restart the motors when the FAULT_RETRY delay is expired
+     * and restore the duty cycle when the derating faults are gone. If the
+     * fault persists it is notified and the restart is attempted again
+     * after the delay, up to FAULT_RETRY_MAX times.
+     * Should be called by the main loop
+     */
+    void faultService(void);
+
+    /**
+     * \brief Check if at least one motor is running
+     * 
+     * \return true if one or more motors are running
+     */
+    boolean motorsRunning(void);
+
+    /**
+     * \brief Check if the motors don't need the TLE94112 enabled
+     * 
+     * \return true if no motor is running, braking or waiting to be
+     * restarted by a fault reaction
+     */
+    boolean motorsIdle(void);
+
+  private:
+
+    /**
+     * CRC-16 (CCITT) of a saved record
+     * 
+     * \param record The record
+     * \param length The number of bytes, excluding the crc field
+     * \return The CRC value
+     */
+    uint16_t recordCRC(const void* record, unsigned int length);
+
+    /**
+     * Write a record to the EEPROM. Only the changed bytes are written
+     * 
+     * \param address The EEPROM address
+     * \param record The record
+     * \param length The size of the record
+     */
+    void writeRecord(int address, const void* record, unsigned int length);
+
+    /**
+     * Read a record from the EEPROM
+     * 
+     * \param address The EEPROM address
+     * \param record The record
+     * \param length The size of the record
+     */
+    void readRecord(int address, void* record, unsigned int length);
+
+    /**
+     * Calculate the half bridges settings resulting from the motors settings,
+     * encoded as state, PWM channel and free wheeling in a byte
+     * 
+     * \param motors The motors settings
+     * \param settings The settings of the TLE_HALFBRIDGES half bridges (base 0)
+     */
+    void bridgeSettings(const motorStatus* motors, uint8_t* settings);
+
+    /**
+     * Set the half bridges settings of a motor pole
+     */
+    void poleSettings(const uint8_t* pole, uint8_t setting, uint8_t* settings);
+
+    /**
+     * Squared error of a group of motors using the same PWM channel
+     * 
+     * \param motors The motors sorted by requested duty cycle
+     * \param start The first motor of the group
+     * \param end The motor after the last of the group
+     * \param dc The duty cycle of the group, the average of the requested values
+     * \return The sum of the squared errors
+     */
+    unsigned long groupError(const uint8_t* motors, int start, int end, uint8_t &dc);
+
+    /**
+     * Write the half bridges settings that are changed
+     * 
+     * \param oldSettings The current half bridges settings
+     * \param newSettings The new half bridges settings
+     * \return The number of half bridges written
+     */
+    uint8_t writeBridgeSettings(const uint8_t* oldSettings, const uint8_t* newSettings);
+
+    /**
+     * Write the PWM channels duty cycle and frequency that are changed
+     * 
+     * \param running true to set the max duty cycle, false to set 0
+     * \return The number of PWM channels written
+     */
+    uint8_t writeChannelSettings(boolean running);
+
+    //! Motors stopped with the brake (bit 0 = first motor)
+    uint8_t brakedMotors;
+    //! Time (ms) when every braked motor has been stopped
+    unsigned long brakeStartTime[MAX_MOTORS];
+    //! A FAULT_RETRY restart is waiting for the delay to expire
+    boolean faultRetryPending;
+    //! Time (ms) when the motors should be restarted after FAULT_RETRY
+    unsigned long faultRetryTime;
+    //! Delay (ms) of the pending FAULT_RETRY reaction
+    uint16_t faultRetryDelay;
+    //! Failed restart attempts of the pending FAULT_RETRY reaction
+    uint8_t faultRetryAttempts;
+    //! Time (ms) of the last derate factor change
+    unsigned long derateStepTime;
+    //! Time (ms) of the last fault with derate reaction
+    unsigned long derateFaultTime;
+    //! Consecutive diagnostic samples with every fault class
+    uint8_t faultSamples[FAULT_CLASSES];
+    //! Time (ms) of the last notification of every fault class
+    unsigned long faultLogTime[FAULT_CLASSES];
+    //! Fault classes to be notified by tleDiagnostic() (bit 0 = first class)
+    uint8_t notifiedFaults;
+    //! Time (ms) of the last duty cycle change of a PWM channel
+    unsigned long dcChangeTime;
+
+    /**
+     * Set the duty cycle of a PWM channel
+     * 
+     * \param channel the selected PWM channel (base 0)
+     * \param dc the duty cycle value
+     */
+    void configChannelPWM(int channel, uint8_t dc);
+
+    /**
+     * Requested duty cycle of a PWM channel scaled by the derate and budget
+     * factors
+     * 
+     * \param channel the selected PWM channel (base 0)
+     */
+    uint8_t scaledDC(int channel);
+
+    /**
+     * Write the requested duty cycle of a PWM channel, scaled by the derate
+     * and budget factors
+     * 
+     * \param channel the selected PWM channel (base 0)
+     */
+    void writeChannelPWM(int channel);
+
+    /**
+     * Compute the power demand of the running motors and the budget factor
+     * 
+     * \return The budget factor (BUDGET_NONE = not limited)
+     */
+    uint8_t powerFactor(void);
+
+    /**
+     * Apply a new budget factor to the PWM channels
+     * 
+     * \param channel The PWM channel (base 0) being written by the caller,
+     * or -1 if none
+     */
+    void updateBudgetFactor(int channel);
+
+    /**
+     * Configure all the half bridges of a motor pole
+     * 
+     * \param pole The pole half bridges array from bridgeLayout[]
+     * \param state The half bridges state
+     * \param pwmCh The PWM channel
+     * \param fw Freewheeling flag
+     */
+    void configPole(const uint8_t* pole, Tle94112::HBState state, 
+                    Tle94112::PWMChannel pwmCh, boolean fw);
+
+    /**
+     * Bit mask of a half bridge, used to check the layout conflicts
+     * 
+     * \param hb The half bridge number (base 1) or HB_NONE
+     * \return The bit corresponding to the half bridge, 0 if HB_NONE
+     */
+    uint16_t bridgeMask(uint8_t hb);
+
+    /**
+     * Print the half bridges of a motor pole
+     * 
+     * \param pole The pole half bridges array from bridgeLayout[]
+     * \return The number of printed characters
+     */
+    int printPole(const uint8_t* pole);
+
+    /**
+     * Print the diagnostic header, if any, followed by the motor ID
+     * 
+     * \param motor The motor ID (base 0) that has generated the error, or NO_MOTOR
+     */
+    void printDiagnosticHeader(int motor);
+
+    /**
+     * Apply the reaction policy of a fault class
+     * 
+     * \param fault The detected fault class
+     * \param motor The motor ID (base 0) being configured, or NO_MOTOR
+     */
+    void tleFaultReaction(int fault, int motor);
+
+    /**
+     * Immediately stop all the running motors, without deceleration
+     */
+    void faultStopAll(void);
+
+    /**
+     * Reduce the derate factor by DERATE_STEP, not more than once every
+     * DERATE_INTERVAL and not below DERATE_MIN
+     */
+    void faultDerate(void);
+
+    /**
+     * Increase the derate factor by DERATE_STEP when no derate faults
+     * occurred for DERATE_RESTORE_DELAY
+     */
+    void derateService(void);
+
+    /**
+     * Set the derate factor and update the duty cycle of the PWM channels
+     * 
+     * \param factor The percentage of the requested duty cycle to apply
+     */
+    void setDerateFactor(uint8_t factor);
+
+    /**
+     * Check if the half bridges of a motor have an over current or open load error
+     * 
+     * \param motor The motor ID (base 0)
+     * \return true if one of the motor half bridges is in error
+     */
+    boolean bridgeFault(int motor);
+
+    /**
+     * Show the over current and open load errors of the half bridges
+     * assigned to a motor
      * 
      * \param motor The motor ID (base 0) that has generated the error
-     * \param message A generic string message for better explanation
      */
-    void tleDiagnostic(int motor, String message);
+    void tleBridgeDiagnostic(int motor);
 
 };
 
@@ -0,0 +1,239 @@
+/**
+ *  \file sequence.cpp
+ *  \brief This file defines functions and predefined instances from sequence.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "sequence.h"
+
+//! Size of every instruction, including the arguments
+static const uint8_t opcodeSize[SEQ_OPCODES] PROGMEM = { 1, 1, 1, 3, 5, 3, 2, 3, 3 };
+
+void MotionSequence::begin(void) {
+  programSize = 0;
+  isRunning = false;
+  pc = 0;
+  cycles = overruns = maxLateness = 0;
+}
+
+boolean MotionSequence::append(const char* hex) {
+  uint8_t size;
+  uint8_t value;
+  int j;
+  char c;
+
+  size = programSize;
+  while(*hex != '\0') {
+    if(size >= SEQ_PROGRAM_SIZE)
+      return false;
+    value = 0;
+    for(j = 0; j < 2; j++) {
+      c = toupper(*hex++);
+      if(isdigit(c))
+        value = (value << 4) | (c - '0');
+      else if( (c >= 'A') && (c <= 'F') )
+        value = (value << 4) | (c - 'A' + 10);
+      else
+        return false;
+    }
+    program[size++] = value;
+  }
+
+  // The program is changed only if all the bytes are valid
+  programSize = size;
+  return true;
+}
+
+boolean MotionSequence::start(MotorControl &motor, SpeedControl &speed) {
+  uint8_t address, opcode;
+  // One bit every program address, set on the instructions start
+  uint8_t boundary[SEQ_PROGRAM_SIZE / 8];
+
+  // Check the instructions and their arguments
+  memset(boundary, 0, sizeof(boundary));
+  address = 0;
+  while(address < programSize) {
+    opcode = program[address];
+    if( (opcode >= SEQ_OPCODES) || ((address + instructionSize(opcode)) > programSize) )
+      return false;
+    if( ((opcode == SEQ_DC) || (opcode == SEQ_RAMP)) && (program[address + 1] >= AVAIL_PWM_CHANNELS) )
+      return false;
+    if( (opcode == SEQ_REVERSE) && (program[address + 1] >= MAX_MOTORS) )
+      return false;
+    if( (opcode == SEQ_WAITPIN) && (!validPin(program[address + 1], speed) || (program[address + 2] > HIGH)) )
+      return false;
+    boundary[address / 8] |= 1 << (address % 8);
+    address += instructionSize(opcode);
+  }
+
+  // The loops should jump to an instruction
+  address = 0;
+  while(address < programSize) {
+    opcode = program[address];
+    if( (opcode == SEQ_LOOP) && ((program[address + 1] >= programSize) ||
+        !(boundary[program[address + 1] / 8] & (1 << (program[address + 1] % 8)))) )
+      return false;
+    address += instructionSize(opcode);
+  }
+
+  pc = 0;
+  loopCount = 0;
+  stepStarted = false;
+  cycles = overruns = maxLateness = 0;
+  faultStops = motor.faultStopCount;
+  stepTime = millis();
+  isRunning = true;
+  return true;
+}
+
+void MotionSequence::stop(void) {
+  isRunning = false;
+}
+
+boolean MotionSequence::update(MotorControl &motor) {
+  int j;
+  unsigned long now;
+  boolean changed;
+
+  if(!isRunning)
+    return false;
+
+  // A fault reaction has stopped the motors
+  if(faultStops != motor.faultStopCount) {
+    isRunning = false;
+    return false;
+  }
+
+  // The instructions without a duration are executed together, up
+  // to SEQ_MAX_STEPS to not lock the main loop in an endless loop
+  changed = false;
+  now = millis();
+  for(j = 0; (j < SEQ_MAX_STEPS) && isRunning; j++) {
+    if( (pc < programSize) && ((program[pc] == SEQ_START) || (program[pc] == SEQ_STOP)) )
+      changed = true;
+    if(!step(motor, now))
+      break;
+  }
+
+  return changed;
+}
+
+boolean MotionSequence::step(MotorControl &motor, unsigned long now) {
+  uint8_t opcode, channel, dc;
+  uint16_t time;
+  unsigned long elapsed;
+
+  if(pc >= programSize) {
+    cycles++;
+    isRunning = false;
+    return false;
+  }
+
+  // The arguments are read only if the instruction has them
+  opcode = program[pc];
+  channel = (instructionSize(opcode) > 1) ? program[pc + 1] : 0;
+  dc = (instructionSize(opcode) > 2) ? program[pc + 2] : 0;
+  switch(opcode) {
+    case SEQ_END:
+      cycles++;
+      isRunning = false;
+      return false;
+    case SEQ_START:
+      motor.startMotors();
+      break;
+    case SEQ_STOP:
+      motor.stopMotors();
+      break;
+    case SEQ_DC:
+      motor.dutyCyclePWM[channel].maxDC = dc;
+      if(motor.motorsRunning() && (dc != motor.channelDC[channel]))
+        motor.motorPWMSet(channel, dc);
+      break;
+    case SEQ_RAMP:
+      time = readTime(3);
+      if(!stepStarted) {
+        stepStarted = true;
+        rampStart = motor.channelDC[channel];
+      }
+      elapsed = now - stepTime;
+      if(elapsed < time) {
+        // Duty cycle proportional to the elapsed time. The intermediate
+        // steps don't restart the ramp window of the diagnostic filters,
+        // it is restarted only when the final duty cycle is set
+        dc = rampStart + (((long)dc - rampStart) * (long)elapsed) / time;
+        if(motor.motorsRunning() && (dc != motor.channelDC[channel]))
+          motor.motorPWMDither(channel, dc);
+        return false;
+      }
+      motor.dutyCyclePWM[channel].maxDC = dc;
+      if(motor.motorsRunning())
+        motor.motorPWMSet(channel, dc);
+      timedStepDone(time, now);
+      break;
+    case SEQ_WAIT:
+      time = readTime(1);
+      if((now - stepTime) < time)
+        return false;
+      timedStepDone(time, now);
+      break;
+    case SEQ_REVERSE:
+      motor.motorReverse(channel);
+      break;
+    case SEQ_WAITPIN:
+      if(digitalRead(channel) != dc)
+        return false;
+      // The following timed instructions start when the condition is true
+      stepTime = now;
+      break;
+    case SEQ_LOOP:
+      if( (dc == 0) || (++loopCount < dc) ) {
+        cycles++;
+        pc = channel;
+        stepStarted = false;
+        return true;
+      }
+      loopCount = 0;
+      break;
+  }
+
+  pc += instructionSize(opcode);
+  stepStarted = false;
+  return true;
+}
+
+void MotionSequence::timedStepDone(uint16_t time, unsigned long now) {
+  unsigned long lateness;
+
+  stepTime += time;
+  lateness = now - stepTime;
+  if(lateness > maxLateness)
+    maxLateness = lateness;
+  if(lateness > SEQ_MAX_LATENESS)
+    overruns++;
+}
+
+boolean MotionSequence::validPin(uint8_t pin, SpeedControl &speed) {
+  if(pin >= NUM_DIGITAL_PINS)
+    return false;
+  if( (pin == SS) || (pin == MOSI) || (pin == MISO) || (pin == SCK) )
+    return false;
+  if( (pin == LCD_DATA_PIN) || (pin == LCD_CLOCK_PIN) || (pin == LCD_LATCH_PIN) )
+    return false;
+  if( (pin == LEDPIN) || (pin == ANALOG_DCPIN) )
+    return false;
+
+  return !speed.usesPin(pin);
+}
+
+uint8_t MotionSequence::instructionSize(uint8_t opcode) {
+  return pgm_read_byte(&opcodeSize[opcode]);
+}
+
+uint16_t MotionSequence::readTime(uint8_t offset) {
+  return program[pc + offset] | ((uint16_t)program[pc + offset + 1] << 8);
+}
@@ -0,0 +1,171 @@
+/**
+ *  \file sequence.h
+ *  \brief Motion sequences executed on the controller with ms timing
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SEQUENCE
+#define _SEQUENCE
+
+#include "motorcontrol.h"
+#include "speedcontrol.h"
+
+#define SEQ_PROGRAM_SIZE 64   ///< Max size of the sequence program (bytes)
+#define SEQ_MAX_STEPS 16      ///< Max instructions executed every loop
+#define SEQ_MAX_LATENESS 1    ///< Lateness (ms) of a timed instruction counted as overrun
+
+/**
+ * Instructions. The opcode is followed by the arguments, the times
+ * are 16 bits little endian values in ms. Channels and motors are base 0
+ *
+ * | Opcode | Arguments        | Action                                         |
+ * |--------|------------------|------------------------------------------------|
+ * | 0x00   |                  | End of the sequence                            |
+ * | 0x01   |                  | Start the enabled motors                       |
+ * | 0x02   |                  | Stop the motors                                |
+ * | 0x03   | ch, dc           | Set the duty cycle of the PWM channel          |
+ * | 0x04   | ch, dc, time     | Ramp the duty cycle of the channel to dc       |
+ * | 0x05   | time             | Wait, keeping the current settings             |
+ * | 0x06   | motor            | Reverse the motor direction                    |
+ * | 0x07   | pin, level       | Wait until the digital pin has the level       |
+ * | 0x08   | address, count   | Jump to address count times (0 = forever)      |
+ *
+ * Loops can't be nested: the loop counter is shared by all the 0x08 instructions.
+ * The 0x07 pin can't be one of the pins used by the SPI bus, the LCD, the LED,
+ * the analog duty cycle input or a tachometer; the level is 0 or 1.
+ */
+#define SEQ_END 0x00
+#define SEQ_START 0x01
+#define SEQ_STOP 0x02
+#define SEQ_DC 0x03
+#define SEQ_RAMP 0x04
+#define SEQ_WAIT 0x05
+#define SEQ_REVERSE 0x06
+#define SEQ_WAITPIN 0x07
+#define SEQ_LOOP 0x08
+#define SEQ_OPCODES 9         ///< Number of opcodes
+
+/**
+ * \brief Interpreter of the motion sequences
+ *
+ * The sequence is executed by update() without waiting: the timed
+ * instructions are scheduled from the time they should have started,
+ * so the delays of the main loop don't accumulate along the sequence.
+ * When a timed instruction ends later than SEQ_MAX_LATENESS it is
+ * counted as overrun. The sequence is aborted when a fault reaction
+ * stops the motors.
+ */
+class MotionSequence {
+  public:
+
+    //! The program
+    uint8_t program[SEQ_PROGRAM_SIZE];
+    //! Size of the program (bytes)
+    uint8_t programSize;
+    //! Sequence running
+    boolean isRunning;
+    //! Address of the instruction being executed
+    uint8_t pc;
+    //! Number of completed cycles (loops and runs to the end)
+    unsigned long cycles;
+    //! Number of timed instructions ended late
+    unsigned long overruns;
+    //! Max lateness (ms) of the timed instructions
+    unsigned long maxLateness;
+
+    /**
+     * \brief Initialise the interpreter with an empty program
+     */
+    void begin(void);
+
+    /**
+     * \brief Add bytes to the end of the program
+     *
+     * \param hex The bytes as hex digit pairs
+     * \return false if the string is not valid or the program is full
+     */
+    boolean append(const char* hex);
+
+    /**
+     * \brief Check the program and start it from the beginning
+     *
+     * \param motor The motor control class executing the sequence
+     * \param speed The speed control, owning the tachometer pins
+     * \return false if the program is not valid
+     */
+    boolean start(MotorControl &motor, SpeedControl &speed);
+
+    /**
+     * \brief Stop the sequence. The motors are not stopped
+     */
+    void stop(void);
+
+    /**
+     * \brief Execute the sequence. Should be called once every main loop
+     *
+     * \param motor The motor control class executing the sequence
+     * \return true if the motors have been started or stopped
+     */
+    boolean update(MotorControl &motor);
+
+  private:
+
+    //! Time (ms) when the current instruction should have started
+    unsigned long stepTime;
+    //! Iterations done by the current loop
+    uint16_t loopCount;
+    //! Duty cycle at the beginning of the ramp
+    uint8_t rampStart;
+    //! The current instruction is in progress
+    boolean stepStarted;
+    //! Fault stops counter when the sequence has been started
+    unsigned int faultStops;
+
+    /**
+     * Execute the current instruction
+     *
+     * \param motor The motor control class executing the sequence
+     * \param now The current time (ms)
+     * \return false if the instruction is not completed
+     */
+    boolean step(MotorControl &motor, unsigned long now);
+
+    /**
+     * Complete a timed instruction, measuring the lateness
+     *
+     * \param time The duration of the instruction (ms)
+     * \param now The current time (ms)
+     */
+    void timedStepDone(uint16_t time, unsigned long now);
+
+    /**
+     * Check if a pin can be waited for by the sequence
+     *
+     * \param pin The digital pin
+     * \param speed The speed control, owning the tachometer pins
+     * \return false if the pin doesn't exist or is used by the controller
+     */
+    boolean validPin(uint8_t pin, SpeedControl &speed);
+
+    /**
+     * Size of an instruction, including the arguments
+     *
+     * \param opcode The instruction
+     * \return The size in bytes
+     */
+    uint8_t instructionSize(uint8_t opcode);
+
+    /**
+     * Time argument of the current instruction
+     *
+     * \param offset Position of the time in the instruction
+     */
+    uint16_t readTime(uint8_t offset);
+};
+
+#endif
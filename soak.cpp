@@ -0,0 +1,138 @@
+/**
+ *  \file soak.cpp
+ *  \brief This file defines functions and predefined instances from soak.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "soak.h"
+
+void SoakTest::begin(void) {
+  phase = SOAK_IDLE;
+  runTime = SOAK_RUN_TIME;
+  restTime = SOAK_REST_TIME;
+  maxCycles = 0;
+  reportTime = 0;
+  cycles = aborted = 0;
+  minCycle = maxCycle = totalTime = 0;
+  startTime = endTime = millis();
+}
+
+boolean SoakTest::start(MotorControl &motor) {
+  int j;
+  boolean enabled;
+
+  if(phase != SOAK_IDLE)
+    return false;
+
+  enabled = false;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(motor.internalStatus[j].isEnabled && motor.hasLayout(j))
+      enabled = true;
+  }
+  if(!enabled)
+    return false;
+
+  cycles = aborted = 0;
+  minCycle = maxCycle = totalTime = 0;
+  for(j = 0; j < FAULT_CLASSES; j++) {
+    faultBase[j] = motor.faultCount[j];
+  }
+  startTime = reportLast = millis();
+  startCycle(motor);
+
+  return true;
+}
+
+void SoakTest::stop(void) {
+  if(phase == SOAK_IDLE)
+    return;
+
+  phase = SOAK_IDLE;
+  endTime = millis();
+}
+
+boolean SoakTest::update(MotorControl &motor) {
+  unsigned long time;
+
+  if(phase == SOAK_IDLE)
+    return false;
+
+  // A fault reaction has stopped the motors: rest before the next cycle
+  if( (phase == SOAK_RUN) && (faultStops != motor.faultStopCount) ) {
+    cycleAborted = true;
+    phase = SOAK_REST;
+    phaseTime = millis();
+    return true;
+  }
+
+  if(phase == SOAK_RUN) {
+    if((millis() - phaseTime) < runTime)
+      return false;
+    motor.stopMotors();
+    phase = SOAK_REST;
+    phaseTime = millis();
+    return true;
+  }
+
+  if((millis() - phaseTime) < restTime)
+    return false;
+
+  if(cycleAborted) {
+    aborted++;
+  }
+  else {
+    time = millis() - cycleTime;
+    if( (cycles == 0) || (time < minCycle) )
+      minCycle = time;
+    if(time > maxCycle)
+      maxCycle = time;
+    totalTime += time;
+    cycles++;
+  }
+
+  if( (maxCycles > 0) && ((cycles + aborted) >= maxCycles) ) {
+    phase = SOAK_IDLE;
+    endTime = millis();
+    return false;
+  }
+
+  startCycle(motor);
+  return true;
+}
+
+boolean SoakTest::reportDue(void) {
+  if( (phase == SOAK_IDLE) || (reportTime == 0) ||
+      ((millis() - reportLast) < (unsigned long)reportTime * 1000) )
+    return false;
+
+  reportLast = millis();
+  return true;
+}
+
+unsigned long SoakTest::cyclesPerMinute(void) {
+  unsigned long time;
+
+  time = ((phase == SOAK_IDLE) ? endTime : millis()) - startTime;
+  if(time == 0)
+    return 0;
+  return (unsigned long)(((unsigned long long)cycles * 60000) / time);
+}
+
+unsigned int SoakTest::faults(MotorControl &motor, int fault) {
+  return motor.faultCount[fault] - faultBase[fault];
+}
+
+void SoakTest::startCycle(MotorControl &motor) {
+  // The fault stops during the start are part of the cycle
+  faultStops = motor.faultStopCount;
+  cycleAborted = false;
+  cycleTime = millis();
+  motor.startMotors();
+  phase = SOAK_RUN;
+  phaseTime = millis();
+}
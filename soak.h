@@ -0,0 +1,138 @@
+/**
+ *  \file soak.h
+ *  \brief Endurance test repeating start, run, stop and rest cycles
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SOAK
+#define _SOAK
+
+#include "motorcontrol.h"
+
+// Soak test phases
+#define SOAK_IDLE 0         ///< No test in progress
+#define SOAK_RUN 1          ///< Motors running
+#define SOAK_REST 2         ///< Motors stopped, waiting for the next cycle
+
+#define SOAK_RUN_TIME 2000      ///< Default run time (ms), after the acceleration
+#define SOAK_REST_TIME 1000     ///< Default rest time (ms), after the deceleration
+#define SOAK_MAX_TIME 60000     ///< Max run and rest time (ms)
+#define SOAK_MAX_CYCLES 1000000 ///< Max number of cycles, 0 = until stopped
+#define SOAK_MAX_REPORT 3600    ///< Max time (s) between two summaries, 0 = no summaries
+
+/**
+ * \brief Soak test of the enabled motors
+ *
+ * Every cycle starts the enabled motors with startMotors(), so the PWM
+ * channels with the acceleration enabled ramp up, keeps them running for
+ * the run time, stops them with stopMotors() and waits for the rest time.
+ * The cycle time is measured from the start to the end of the rest, so it
+ * includes the ramps and the SPI transfers. The cycles during which a fault
+ * reaction has stopped the motors are aborted: they continue with the
+ * rest and are not counted in the cycle times. The faults asserted during
+ * the test are counted for every class. The test is executed without
+ * waiting, except for the ramps of the start and stop.
+ */
+class SoakTest {
+  public:
+
+    //! Current phase of the test
+    uint8_t phase;
+    //! Run time (ms) every cycle, after the acceleration
+    uint16_t runTime;
+    //! Rest time (ms) every cycle, after the deceleration
+    uint16_t restTime;
+    //! Cycles to execute, 0 = until stopped
+    unsigned long maxCycles;
+    //! Time (s) between two summaries, 0 = no summaries
+    uint16_t reportTime;
+    //! Completed cycles
+    unsigned long cycles;
+    //! Cycles aborted by a fault reaction
+    unsigned long aborted;
+    //! Min time (ms) of a completed cycle
+    unsigned long minCycle;
+    //! Max time (ms) of a completed cycle
+    unsigned long maxCycle;
+    //! Total time (ms) of the completed cycles
+    unsigned long totalTime;
+    //! Time (ms) when the test has been started
+    unsigned long startTime;
+    //! Time (ms) when the test has been stopped, valid when not running
+    unsigned long endTime;
+
+    /**
+     * \brief Initialise with the default cycle, without test in progress
+     */
+    void begin(void);
+
+    /**
+     * \brief Reset the statistics and start the first cycle
+     *
+     * \param motor The motor control class
+     * \return false if there are no enabled motors or a test is in progress
+     */
+    boolean start(MotorControl &motor);
+
+    /**
+     * \brief Stop the test. The motors are not stopped
+     */
+    void stop(void);
+
+    /**
+     * \brief Execute the test. Should be called once every control tick
+     *
+     * \param motor The motor control class
+     * \return true if the motors have been started or stopped
+     */
+    boolean update(MotorControl &motor);
+
+    /**
+     * \brief Check if a summary should be sent
+     *
+     * \return true once every report time while the test is in progress
+     */
+    boolean reportDue(void);
+
+    /**
+     * \brief Completed cycles every minute since the start of the test
+     */
+    unsigned long cyclesPerMinute(void);
+
+    /**
+     * \brief Faults of a class asserted since the start of the test
+     *
+     * \param motor The motor control class
+     * \param fault The fault class (FAULT_SPI, FAULT_LOAD, ...)
+     */
+    unsigned int faults(MotorControl &motor, int fault);
+
+  private:
+
+    //! Time (ms) when the current cycle has been started
+    unsigned long cycleTime;
+    //! Time (ms) when the current phase has been started
+    unsigned long phaseTime;
+    //! Time (ms) of the last summary
+    unsigned long reportLast;
+    //! Fault stops counter when the current cycle has been started
+    unsigned int faultStops;
+    //! The current cycle has been aborted
+    boolean cycleAborted;
+    //! Fault counters when the test has been started
+    unsigned int faultBase[FAULT_CLASSES];
+
+    /**
+     * Start a cycle
+     *
+     * \param motor The motor control class
+     */
+    void startCycle(MotorControl &motor);
+};
+
+#endif
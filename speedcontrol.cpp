@@ -0,0 +1,169 @@
+/**
+ *  \file speedcontrol.cpp
+ *  \brief This file defines functions and predefined instances from speedcontrol.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "speedcontrol.h"
+
+//! Pulses counted by the interrupts since the last read
+static volatile uint16_t tachPulses[SPEED_INPUTS];
+
+//! Tachometer interrupt of the first input
+static void tachPulse0(void) {
+  tachPulses[0]++;
+}
+
+//! Tachometer interrupt of the second input
+static void tachPulse1(void) {
+  tachPulses[1]++;
+}
+
+//! Interrupt routine of every tachometer input
+static void (* const tachInterrupt[SPEED_INPUTS])(void) = { tachPulse0, tachPulse1 };
+
+void SpeedControl::begin(void) {
+  int j;
+
+  for(j = 0; j < SPEED_INPUTS; j++) {
+    loops[j].motor = NO_MOTOR;
+  }
+  kp = SPEED_DEFAULT_KP;
+  ki = SPEED_DEFAULT_KI;
+  ticks = lateTicks = 0;
+  tickTime = readTime = millis();
+}
+
+boolean SpeedControl::attach(int motor, uint8_t pin) {
+  int j;
+
+  if(digitalPinToInterrupt(pin) == NOT_AN_INTERRUPT)
+    return false;
+
+  // A motor has only one input
+  detach(motor);
+  for(j = 0; j < SPEED_INPUTS; j++) {
+    if(loops[j].motor == NO_MOTOR) {
+      loops[j].pin = pin;
+      loops[j].target = 0;
+      loops[j].speed = 0;
+      loops[j].integral = 0;
+      loops[j].dc = 0;
+      tachPulses[j] = 0;
+      pinMode(pin, INPUT);
+      attachInterrupt(digitalPinToInterrupt(pin), tachInterrupt[j], RISING);
+      loops[j].motor = motor;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void SpeedControl::detach(int motor) {
+  int j;
+
+  j = findLoop(motor);
+  if(j >= 0) {
+    detachInterrupt(digitalPinToInterrupt(loops[j].pin));
+    loops[j].motor = NO_MOTOR;
+  }
+}
+
+boolean SpeedControl::usesPin(uint8_t pin) {
+  int j;
+
+  for(j = 0; j < SPEED_INPUTS; j++) {
+    if( (loops[j].motor != NO_MOTOR) && (loops[j].pin == pin) )
+      return true;
+  }
+
+  return false;
+}
+
+boolean SpeedControl::setTarget(int motor, uint16_t target) {
+  int j;
+
+  j = findLoop(motor);
+  if(j < 0)
+    return false;
+
+  loops[j].target = target;
+  return true;
+}
+
+int SpeedControl::findLoop(int motor) {
+  int j;
+
+  for(j = 0; j < SPEED_INPUTS; j++) {
+    if(loops[j].motor == motor)
+      return j;
+  }
+
+  return -1;
+}
+
+void SpeedControl::update(MotorControl &motor) {
+  int j;
+  uint16_t pulses;
+  uint8_t channel;
+  unsigned long now, elapsed;
+
+  now = millis();
+  if((now - tickTime) < SPEED_PERIOD)
+    return;
+
+  // Fixed rate ticks, without recovering the ticks lost in a long loop
+  ticks++;
+  tickTime += SPEED_PERIOD;
+  if((now - tickTime) >= SPEED_PERIOD) {
+    lateTicks++;
+    tickTime = now;
+  }
+  // The speed is calculated on the real time between two reads
+  elapsed = now - readTime;
+  readTime = now;
+
+  for(j = 0; j < SPEED_INPUTS; j++) {
+    if(loops[j].motor == NO_MOTOR)
+      continue;
+
+    noInterrupts();
+    pulses = tachPulses[j];
+    tachPulses[j] = 0;
+    interrupts();
+    loops[j].speed = ((unsigned long)pulses * 1000) / elapsed;
+
+    channel = motor.internalStatus[loops[j].motor].channelPWM;
+    if( (loops[j].target == 0) || (channel == tle94112.TLE_NOPWM) ||
+        !motor.internalStatus[loops[j].motor].isRunning ) {
+      // Restart from zero when the loop is closed again
+      loops[j].integral = 0;
+      continue;
+    }
+
+    control(loops[j]);
+    // The small corrections are not ramps: the diagnostic filters ramp
+    // window is not restarted, else the open load would never be detected
+    if(loops[j].dc != motor.channelDC[channel - 1])
+      motor.motorPWMDither(channel - 1, loops[j].dc);
+  }
+}
+
+void SpeedControl::control(speedLoop &loop) {
+  long error, output;
+
+  error = (long)loop.target - (long)loop.speed;
+
+  // The integral term alone can't exceed the duty cycle range
+  loop.integral += (long)ki * error;
+  loop.integral = constrain(loop.integral, 0L, (long)DUTYCYCLE_MAX * SPEED_GAIN_SCALE);
+
+  output = ((long)kp * error + loop.integral) / SPEED_GAIN_SCALE;
+  loop.dc = (uint8_t)constrain(output, (long)DUTYCYCLE_MIN, (long)DUTYCYCLE_MAX);
+}
@@ -0,0 +1,129 @@
+/**
+ *  \file speedcontrol.h
+ *  \brief Closed loop speed control of the motors with a tachometer input
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _SPEEDCONTROL
+#define _SPEEDCONTROL
+
+#include "motorcontrol.h"
+
+#define SPEED_INPUTS 2          ///< Number of tachometer inputs
+#define SPEED_PERIOD 50         ///< Control tick (ms)
+#define SPEED_GAIN_SCALE 256    ///< The gains are expressed in 1/SPEED_GAIN_SCALE units
+#define SPEED_DEFAULT_KP 64     ///< Default proportional gain (duty cycle every pulse/s)
+#define SPEED_DEFAULT_KI 16     ///< Default integral gain (duty cycle every pulse/s every tick)
+#define SPEED_MAX_GAIN 0x7fff   ///< Max gain value, to not overflow the calculations
+
+/**
+ * Speed control loop of a motor
+ */
+struct speedLoop {
+  int motor;            ///< Controlled motor (base 0), NO_MOTOR if the input is not used
+  uint8_t pin;          ///< Tachometer pin, should support the external interrupts
+  uint16_t target;      ///< Target speed (pulses/s), 0 for open loop
+  uint16_t speed;       ///< Last measured speed (pulses/s)
+  long integral;        ///< Integral term, scaled by SPEED_GAIN_SCALE
+  uint8_t dc;           ///< Last duty cycle set by the controller
+};
+
+/**
+ * \brief PI speed controllers fed by the tachometer pulses
+ *
+ * The pulses of every tachometer input are counted by an interrupt and
+ * converted to speed every control tick. When a target speed is set and
+ * the motor is running, the duty cycle of the PWM channel assigned to the
+ * motor is set by the PI controller, so the channel should not be shared
+ * with other motors. The integral term is limited to the duty cycle
+ * range to avoid the windup while the output is saturated.
+ */
+class SpeedControl {
+  public:
+
+    //! Speed control loops, one every tachometer input
+    speedLoop loops[SPEED_INPUTS];
+    //! Proportional gain
+    uint16_t kp;
+    //! Integral gain
+    uint16_t ki;
+    //! Number of control ticks
+    unsigned long ticks;
+    //! Number of control ticks executed later than a whole period
+    unsigned long lateTicks;
+
+    /**
+     * \brief Initialise the controllers, without tachometer inputs
+     */
+    void begin(void);
+
+    /**
+     * \brief Connect a tachometer input to a motor
+     *
+     * \param motor The motor (base 0)
+     * \param pin The tachometer pin, should support the external interrupts
+     * \return false if the pin has no interrupt or all the inputs are used
+     */
+    boolean attach(int motor, uint8_t pin);
+
+    /**
+     * \brief Disconnect the tachometer input of a motor
+     *
+     * \param motor The motor (base 0)
+     */
+    void detach(int motor);
+
+    /**
+     * \brief Set the target speed of a motor
+     *
+     * \param motor The motor (base 0)
+     * \param target The speed in pulses/s, 0 to return to open loop
+     * \return false if the motor has no tachometer input
+     */
+    boolean setTarget(int motor, uint16_t target);
+
+    /**
+     * \brief Check if a pin is used as tachometer input
+     *
+     * \param pin The digital pin
+     * \return true if the pin is attached to a motor
+     */
+    boolean usesPin(uint8_t pin);
+
+    /**
+     * \brief Measure the speed and update the duty cycles every control
+     * tick. Should be called once every main loop
+     *
+     * \param motor The motor control class
+     */
+    void update(MotorControl &motor);
+
+    /**
+     * \brief Search the control loop of a motor
+     *
+     * \param motor The motor (base 0)
+     * \return The loop index, -1 if the motor has no tachometer input
+     */
+    int findLoop(int motor);
+
+  private:
+
+    //! Time (ms) when the current tick should have started
+    unsigned long tickTime;
+    //! Time (ms) when the pulses have been read the last time
+    unsigned long readTime;
+
+    /**
+     * Calculate the duty cycle of a control loop
+     *
+     * \param loop The control loop
+     */
+    void control(speedLoop &loop);
+};
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ *  \file telemetry.cpp
+ *  \brief This file defines functions and predefined instances from telemetry.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "telemetry.h"
+
+void Telemetry::begin(void) {
+  isEnabled = false;
+  period = TELEMETRY_PERIOD;
+  txHead = txTail = txCount = 0;
+  sequence = 0;
+  sentFrames = droppedFrames = 0;
+  loopTime = maxLoopTime = 0;
+  frameTime = millis();
+  updateTime = micros();
+}
+
+void Telemetry::enable(boolean enable) {
+  isEnabled = enable;
+  maxLoopTime = 0;
+  frameTime = millis();
+}
+
+void Telemetry::setPeriod(uint16_t ms) {
+  if(ms < TELEMETRY_MIN_PERIOD)
+    period = TELEMETRY_MIN_PERIOD;
+  else
+    period = ms;
+}
+
+void Telemetry::update(MotorControl &motor) {
+  unsigned long now;
+
+  now = micros();
+  loopTime = now - updateTime;
+  updateTime = now;
+  if(loopTime > maxLoopTime)
+    maxLoopTime = loopTime;
+
+  if(isEnabled && ((millis() - frameTime) >= period)) {
+    frameTime += period;
+    // Don't try to recover the frames lost during a long loop
+    if((millis() - frameTime) >= period)
+      frameTime = millis();
+    buildFrame(motor);
+  }
+
+  // Frames built before disabling are sent anyway
+  sendFrames();
+}
+
+void Telemetry::buildFrame(MotorControl &motor) {
+  int j;
+  uint8_t status;
+  unsigned long timeStamp;
+
+  if((TELEMETRY_BUFFER_SIZE - txCount) < TELEMETRY_FRAME_SIZE) {
+    droppedFrames++;
+    return;
+  }
+
+  checksum = 0;
+  put(TELEMETRY_SYNC1);
+  put(TELEMETRY_SYNC2);
+  put(TELEMETRY_FRAME_SIZE);
+  put(sequence++);
+  timeStamp = millis();
+  for(j = 0; j < 4; j++) {
+    put((uint8_t)(timeStamp >> (j * 8)));
+  }
+  for(j = 0; j < MAX_MOTORS; j++) {
+    status = motor.internalStatus[j].channelPWM << TELEMETRY_PWM_SHIFT;
+    if(motor.internalStatus[j].isRunning)
+      status |= TELEMETRY_RUNNING;
+    if(motor.internalStatus[j].isEnabled)
+      status |= TELEMETRY_ENABLED;
+    if(motor.internalStatus[j].motorDirection == MOTOR_DIRECTION_CCW)
+      status |= TELEMETRY_CCW;
+    if(motor.hasLayout(j))
+      status |= TELEMETRY_LAYOUT;
+    put(status);
+  }
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    put(motor.channelDC[j]);
+  }
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    put(motor.appliedDC[j]);
+  }
+  put(motor.derateFactor);
+  put(motor.budgetFactor);
+  put(motor.diagnosticStatus);
+  put16(loopTime);
+  put16(maxLoopTime);
+  put16(droppedFrames);
+  put(checksum);
+}
+
+void Telemetry::sendFrames(void) {
+  int j;
+
+  // A frame is sent only if it fits completely in the serial buffer,
+  // so the other serial messages can't be mixed with the frame bytes
+  while( (txCount >= TELEMETRY_FRAME_SIZE) &&
+         (Serial.availableForWrite() >= TELEMETRY_FRAME_SIZE) ) {
+    for(j = 0; j < TELEMETRY_FRAME_SIZE; j++) {
+      Serial.write(txBuffer[txTail]);
+      txTail = (txTail + 1) & (TELEMETRY_BUFFER_SIZE - 1);
+    }
+    txCount -= TELEMETRY_FRAME_SIZE;
+    sentFrames++;
+  }
+}
+
+void Telemetry::put(uint8_t data) {
+  txBuffer[txHead] = data;
+  txHead = (txHead + 1) & (TELEMETRY_BUFFER_SIZE - 1);
+  txCount++;
+  checksum ^= data;
+}
+
+void Telemetry::put16(unsigned long data) {
+  if(data > 0xffff)
+    data = 0xffff;
+  put((uint8_t)data);
+  put((uint8_t)(data >> 8));
+}
@@ -0,0 +1,146 @@
+/**
+ *  \file telemetry.h
+ *  \brief Binary telemetry frames of the motors status sent on the serial
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _TELEMETRY
+#define _TELEMETRY
+
+#include "motorcontrol.h"
+
+#define TELEMETRY_SYNC1 0xAA        ///< First frame synchronisation byte
+#define TELEMETRY_SYNC2 0x55        ///< Second frame synchronisation byte
+#define TELEMETRY_PERIOD 100        ///< Default time (ms) between two frames
+#define TELEMETRY_MIN_PERIOD 10     ///< Min time (ms) between two frames
+#define TELEMETRY_BUFFER_SIZE 64    ///< Transmission ring buffer size (power of 2)
+
+/**
+ * Frame layout, multi-byte values are little endian:
+ *
+ * | Offset | Size | Content                                      |
+ * |--------|------|----------------------------------------------|
+ * | 0      | 2    | TELEMETRY_SYNC1, TELEMETRY_SYNC2             |
+ * | 2      | 1    | Frame length, including sync and checksum    |
+ * | 3      | 1    | Sequence number                              |
+ * | 4      | 4    | Time stamp (ms)                              |
+ * | 8      | 6    | Motors status, one byte every motor          |
+ * | 14     | 3    | Requested duty cycle of every PWM channel    |
+ * | 17     | 3    | Duty cycle written to every PWM channel,     |
+ * |        |      | after the derate and budget factors          |
+ * | 20     | 1    | Derate factor (%)                            |
+ * | 21     | 1    | Power budget factor (%)                      |
+ * | 22     | 1    | TLE94112 diagnostic status                   |
+ * | 23     | 2    | Last loop time (us, saturated)               |
+ * | 25     | 2    | Max loop time (us, saturated)                |
+ * | 27     | 2    | Dropped frames (saturated)                   |
+ * | 29     | 1    | XOR of all the previous bytes                |
+ */
+#define TELEMETRY_FRAME_SIZE (2 + 1 + 1 + 4 + MAX_MOTORS + AVAIL_PWM_CHANNELS * 2 + 1 + 1 + 1 + 2 + 2 + 2 + 1)
+
+// Motor status byte
+#define TELEMETRY_RUNNING 0x01      ///< Motor running
+#define TELEMETRY_ENABLED 0x02      ///< Motor enabled
+#define TELEMETRY_CCW 0x04          ///< Counterclockwise direction
+#define TELEMETRY_LAYOUT 0x08       ///< Half bridges assigned to the motor
+#define TELEMETRY_PWM_SHIFT 4       ///< PWM channel (0 = no PWM) in the high nibble
+
+/**
+ * \brief Periodic binary telemetry of the motors status
+ *
+ * The frames are built at the configured rate in a ring buffer that
+ * is sent only when the serial transmission buffer can accept a whole
+ * frame, so the main loop never waits for the serial. When the ring
+ * buffer is full the new frame is dropped and counted.
+ */
+class Telemetry {
+  public:
+
+    //! Telemetry frames enabled
+    boolean isEnabled;
+    //! Time (ms) between two frames
+    uint16_t period;
+    //! Number of frames sent
+    unsigned long sentFrames;
+    //! Number of frames dropped because the ring buffer was full
+    unsigned long droppedFrames;
+    //! Last main loop time (us)
+    unsigned long loopTime;
+    //! Max main loop time (us) since telemetry has been enabled
+    unsigned long maxLoopTime;
+
+    /**
+     * \brief Initialise the telemetry, disabled with the default period
+     */
+    void begin(void);
+
+    /**
+     * \brief Enable or disable the telemetry frames
+     *
+     * \param enable true to start sending the frames
+     */
+    void enable(boolean enable);
+
+    /**
+     * \brief Set the time between two frames
+     *
+     * \param ms The period in ms, not less than TELEMETRY_MIN_PERIOD
+     */
+    void setPeriod(uint16_t ms);
+
+    /**
+     * \brief Measure the loop time, build a frame when it is due and send
+     * the buffered frames. Should be called once every main loop
+     *
+     * \param motor The motor control class to report
+     */
+    void update(MotorControl &motor);
+
+  private:
+
+    //! Transmission ring buffer
+    uint8_t txBuffer[TELEMETRY_BUFFER_SIZE];
+    //! Next byte to write in the ring buffer
+    uint8_t txHead;
+    //! Next byte to send from the ring buffer
+    uint8_t txTail;
+    //! Number of bytes in the ring buffer
+    uint8_t txCount;
+    //! Frame sequence number
+    uint8_t sequence;
+    //! Frame checksum being calculated
+    uint8_t checksum;
+    //! Time (ms) of the last frame
+    unsigned long frameTime;
+    //! Time (us) of the last update, to measure the loop time
+    unsigned long updateTime;
+
+    /**
+     * Build a frame in the ring buffer, if there is enough space
+     *
+     * \param motor The motor control class to report
+     */
+    void buildFrame(MotorControl &motor);
+
+    /**
+     * Send the buffered frames that fit in the serial transmission buffer
+     */
+    void sendFrames(void);
+
+    /**
+     * Add a byte to the ring buffer and to the checksum
+     */
+    void put(uint8_t data);
+
+    /**
+     * Add a 16 bits value to the ring buffer, saturated
+     */
+    void put16(unsigned long data);
+};
+
+#endif
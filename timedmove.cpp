@@ -0,0 +1,218 @@
+/**
+ *  \file timedmove.cpp
+ *  \brief This file defines functions and predefined instances from timedmove.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "timedmove.h"
+
+void TimedMove::begin(void) {
+  phase = MOVE_IDLE;
+  motors = channels = 0;
+  lastDuration = lastBudget = 0;
+}
+
+boolean TimedMove::runTime(MotorControl &motor, unsigned long time) {
+  // A move without duration would never stop
+  if((phase != MOVE_IDLE) || (time == 0))
+    return false;
+
+  duration = time * 1000;
+  budget = 0;
+  return start(motor);
+}
+
+boolean TimedMove::runBudget(MotorControl &motor, unsigned long dcTime) {
+  if((phase != MOVE_IDLE) || (dcTime == 0))
+    return false;
+
+  duration = 0;
+  budget = (unsigned long long)dcTime * 1000 * DUTYCYCLE_MAX;
+  return start(motor);
+}
+
+boolean TimedMove::start(MotorControl &motor) {
+  int j, count;
+  uint8_t channel;
+  unsigned long ramp;
+
+  // The selected motor, or all the enabled motors
+  motors = channels = 0;
+  count = 0;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if( ((motor.currentMotor == 0) || (motor.currentMotor == (j + 1))) &&
+        motor.internalStatus[j].isEnabled && motor.hasLayout(j) ) {
+      motors |= 1 << j;
+      count++;
+      if(motor.internalStatus[j].channelPWM != tle94112.TLE_NOPWM)
+        channels |= 1 << (motor.internalStatus[j].channelPWM - 1);
+    }
+  }
+  if(motors == 0)
+    return false;
+
+  rampTime = 0;
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if( (channels & (1 << j)) && (channelRamp(motor, j) > rampTime) )
+      rampTime = channelRamp(motor, j);
+  }
+
+  // Budget consumed by the deceleration, the average of the motors duty
+  // cycle. The channels with a shorter ramp run at the max duty cycle
+  // until their deceleration begins
+  rampBudget = 0;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(!(motors & (1 << j)))
+      continue;
+    channel = motor.internalStatus[j].channelPWM;
+    if(channel == tle94112.TLE_NOPWM) {
+      rampBudget += (unsigned long long)DUTYCYCLE_MAX * rampTime;
+    }
+    else {
+      ramp = channelRamp(motor, channel - 1);
+      rampBudget += (unsigned long long)motor.dutyCyclePWM[channel - 1].maxDC * (rampTime - ramp) +
+                    (unsigned long long)(motor.dutyCyclePWM[channel - 1].maxDC +
+                    motor.dutyCyclePWM[channel - 1].minDC) * ramp / 2;
+    }
+  }
+  rampBudget /= count;
+
+  endTime = duration;
+  consumed = 0;
+  lastTime = 0;
+  faultStops = motor.faultStopCount;
+  phase = MOVE_RUN;
+
+  startTime = micros();
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(motors & (1 << j))
+      motor.motorConfigHB(j);
+  }
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if(channels & (1 << j))
+      motor.motorPWMSet(j, channelDC(motor, j, 0));
+  }
+
+  return true;
+}
+
+void TimedMove::stop(MotorControl &motor) {
+  if(phase != MOVE_IDLE)
+    finish(motor);
+}
+
+boolean TimedMove::update(MotorControl &motor) {
+  int j, count;
+  unsigned long time, dcSum;
+  uint8_t channel, dc;
+
+  if(phase == MOVE_IDLE)
+    return false;
+
+  // A fault reaction has stopped the motors
+  if(faultStops != motor.faultStopCount) {
+    finish(motor);
+    return true;
+  }
+
+  time = micros() - startTime;
+
+  // Budget consumed with the duty cycle set by the previous update
+  dcSum = 0;
+  count = 0;
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(motors & (1 << j)) {
+      channel = motor.internalStatus[j].channelPWM;
+      dcSum += (channel == tle94112.TLE_NOPWM) ? DUTYCYCLE_MAX : motor.channelDC[channel - 1];
+      count++;
+    }
+  }
+  consumed += (unsigned long long)(dcSum / count) * (time - lastTime);
+  lastTime = time;
+
+  if(phase == MOVE_RUN) {
+    if( ((duration > 0) && ((time + rampTime) >= endTime)) ||
+        ((budget > 0) && ((consumed + rampBudget) >= budget)) ) {
+      if(budget > 0)
+        endTime = time + rampTime;
+      phase = MOVE_STOPPING;
+    }
+  }
+
+  if( (phase == MOVE_STOPPING) && (time >= endTime) ) {
+    finish(motor);
+    lastDuration = time;
+    return true;
+  }
+
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if(channels & (1 << j)) {
+      dc = channelDC(motor, j, time);
+      if(dc != motor.channelDC[j])
+        motor.motorPWMSet(j, dc);
+    }
+  }
+
+  return false;
+}
+
+unsigned long TimedMove::channelRamp(MotorControl &motor, int channel) {
+  if( !motor.dutyCyclePWM[channel].useRamp ||
+      (motor.dutyCyclePWM[channel].maxDC <= motor.dutyCyclePWM[channel].minDC) )
+    return 0;
+
+  return (unsigned long)(motor.dutyCyclePWM[channel].maxDC - motor.dutyCyclePWM[channel].minDC) *
+         RAMP_STEP_DELAY * 1000;
+}
+
+uint8_t TimedMove::channelDC(MotorControl &motor, int channel, unsigned long time) {
+  unsigned long ramp, rampStart;
+  uint8_t minDC, maxDC, dc;
+
+  ramp = channelRamp(motor, channel);
+  maxDC = motor.dutyCyclePWM[channel].maxDC;
+  if(ramp == 0)
+    return maxDC;
+  minDC = motor.dutyCyclePWM[channel].minDC;
+
+  // Acceleration
+  if(time < ramp)
+    dc = minDC + ((unsigned long long)(maxDC - minDC) * time) / ramp;
+  else
+    dc = maxDC;
+
+  // Deceleration, ending at the stop time
+  if(phase == MOVE_STOPPING) {
+    rampStart = (endTime > ramp) ? (endTime - ramp) : 0;
+    if(time >= rampStart) {
+      if((time - rampStart) >= ramp)
+        dc = minDC;
+      else
+        dc = min(dc, (uint8_t)(maxDC - ((unsigned long long)(maxDC - minDC) * (time - rampStart)) / ramp));
+    }
+  }
+
+  return dc;
+}
+
+void TimedMove::finish(MotorControl &motor) {
+  int j;
+
+  // As stopMotors(): the PWM first, then the half bridges as the stop mode
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if(channels & (1 << j))
+      motor.motorPWMHalt(j);
+  }
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(motors & (1 << j))
+      motor.motorStopHB(j);
+  }
+
+  lastBudget = consumed / ((unsigned long long)1000 * DUTYCYCLE_MAX);
+  phase = MOVE_IDLE;
+}
@@ -0,0 +1,138 @@
+/**
+ *  \file timedmove.h
+ *  \brief Moves of a motor or a group of motors for a time or a duty cycle budget
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _TIMEDMOVE
+#define _TIMEDMOVE
+
+#include "motorcontrol.h"
+
+// Move phases
+#define MOVE_IDLE 0         ///< No move in progress
+#define MOVE_RUN 1          ///< Accelerating or running at the max duty cycle
+#define MOVE_STOPPING 2     ///< Decelerating before the stop
+
+/**
+ * \brief Timed moves executed without waiting
+ *
+ * The moved motors are started together and stopped exactly when the
+ * duration is expired, or when the duty cycle budget is consumed. The
+ * budget is expressed in ms at the max duty cycle (DUTYCYCLE_MAX) and
+ * is consumed with the average duty cycle of the PWM channels used by
+ * the motors. The PWM channels with the acceleration enabled ramp from
+ * the min to the max duty cycle at the same rate of the start command
+ * (RAMP_STEP_DELAY every step), and decelerate at the end of the move
+ * so that all the channels reach the min duty cycle at the stop time.
+ * The ramps are part of the move duration and budget.
+ */
+class TimedMove {
+  public:
+
+    //! Current phase of the move
+    uint8_t phase;
+    //! Moved motors (bit 0 = first motor)
+    uint8_t motors;
+    //! Real duration (us) of the last completed move
+    unsigned long lastDuration;
+    //! Budget consumed by the last move (ms at the max duty cycle)
+    unsigned long lastBudget;
+
+    /**
+     * \brief Initialise without any move in progress
+     */
+    void begin(void);
+
+    /**
+     * \brief Start the selected motor (all the enabled motors if no motor is
+     * selected) for a time
+     *
+     * \param motor The motor control class
+     * \param time The duration (ms), including the ramps
+     * \return false if the duration is 0, there are no motors to move or a
+     * move is in progress
+     */
+    boolean runTime(MotorControl &motor, unsigned long time);
+
+    /**
+     * \brief Start the selected motor (all the enabled motors if no motor is
+     * selected) until a duty cycle budget is consumed
+     *
+     * \param motor The motor control class
+     * \param dcTime The budget (ms at the max duty cycle), including the ramps
+     * \return false if the budget is 0, there are no motors to move or a
+     * move is in progress
+     */
+    boolean runBudget(MotorControl &motor, unsigned long dcTime);
+
+    /**
+     * \brief Stop the move immediately
+     *
+     * \param motor The motor control class
+     */
+    void stop(MotorControl &motor);
+
+    /**
+     * \brief Update the duty cycles and stop the motors at the end of the
+     * move. Should be called once every main loop
+     *
+     * \param motor The motor control class
+     * \return true if the move has been completed or aborted
+     */
+    boolean update(MotorControl &motor);
+
+  private:
+
+    //! PWM channels used by the moved motors (bit 0 = first channel)
+    uint8_t channels;
+    //! Time (us) when the move has been started
+    unsigned long startTime;
+    //! Time (us) from the start when the motors stop, known when decelerating
+    //! for a budget move
+    unsigned long endTime;
+    //! Move duration (us), 0 for a budget move
+    unsigned long duration;
+    //! Budget (duty cycle * us) to consume, 0 for a time move
+    unsigned long long budget;
+    //! Budget consumed (duty cycle * us)
+    unsigned long long consumed;
+    //! Time (us) of the last update, since the start
+    unsigned long lastTime;
+    //! Longest ramp (us) of the moved channels
+    unsigned long rampTime;
+    //! Budget needed (duty cycle * us) to decelerate all the channels
+    unsigned long long rampBudget;
+    //! Fault stops counter when the move has been started
+    unsigned int faultStops;
+
+    /**
+     * Start the motors and the PWM channels
+     *
+     * \param motor The motor control class
+     * \return false if there are no motors to move
+     */
+    boolean start(MotorControl &motor);
+
+    /**
+     * Ramp time of a PWM channel (us), 0 if the acceleration is disabled
+     */
+    unsigned long channelRamp(MotorControl &motor, int channel);
+
+    /**
+     * Duty cycle of a PWM channel at a time since the start
+     */
+    uint8_t channelDC(MotorControl &motor, int channel, unsigned long time);
+
+    /**
+     * Stop the moved motors and the PWM channels
+     */
+    void finish(MotorControl &motor);
+};
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ *  \file trace.cpp
+ *  \brief This file defines functions and predefined instances from trace.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "trace.h"
+#include "commands.h"
+
+//! Command keywords of the command events
+static const char commandKeywords[] PROGMEM = COMMAND_KEYWORDS;
+
+TraceRecorder trace;
+
+void TraceRecorder::begin(void) {
+  head = count = 0;
+  isFrozen = false;
+  freezeOnFault = true;
+}
+
+void TraceRecorder::record(uint8_t type, uint8_t data1, uint8_t data2, uint8_t data3) {
+  traceEvent* event;
+
+  if(isFrozen)
+    return;
+
+  event = &events[head];
+  event->time = millis();
+  event->type = type;
+  event->data[0] = data1;
+  event->data[1] = data2;
+  event->data[2] = data3;
+
+  if(++head >= TRACE_EVENTS)
+    head = 0;
+  if(count < TRACE_EVENTS)
+    count++;
+}
+
+void TraceRecorder::recordCommand(const char* command) {
+  uint8_t index, found, length, foundLength;
+  unsigned long argument;
+  boolean matching;
+  char c;
+  int j;
+
+  // Longest keyword the command starts with
+  index = length = foundLength = 0;
+  found = COMMAND_UNKNOWN;
+  matching = true;
+  for(j = 0; ; j++) {
+    c = pgm_read_byte(&commandKeywords[j]);
+    if( (c == ' ') || (c == '\0') ) {
+      if(matching && (length > foundLength)) {
+        found = index;
+        foundLength = length;
+      }
+      if(c == '\0')
+        break;
+      index++;
+      length = 0;
+      matching = true;
+    }
+    else if(matching && (command[length] == c))
+      length++;
+    else
+      matching = false;
+  }
+
+  // First number after the keyword
+  command += foundLength;
+  while( (*command != '\0') && !isdigit(*command) )
+    command++;
+  argument = 0;
+  while(isdigit(*command)) {
+    argument = argument * 10 + (*command++ - '0');
+    if(argument > 0xffff)
+      argument = 0xffff;
+  }
+  record(TRACE_COMMAND, found, argument & 0xff, argument >> 8);
+}
+
+void TraceRecorder::freeze(boolean fault) {
+  record(TRACE_FREEZE, (uint8_t)fault, 0, 0);
+  isFrozen = true;
+}
+
+void TraceRecorder::faultFreeze(void) {
+  if(freezeOnFault && !isFrozen)
+    freeze(true);
+}
+
+void TraceRecorder::dump(void) {
+  int j, k;
+  uint8_t index;
+
+  index = (head + TRACE_EVENTS - count) % TRACE_EVENTS;
+  for(j = 0; j < count; j++) {
+    printHex(events[index].time, 8);
+    Serial.write(events[index].type);
+    for(k = 0; k < 3; k++) {
+      printHex(events[index].data[k], 2);
+    }
+    Serial.println();
+    if(++index >= TRACE_EVENTS)
+      index = 0;
+  }
+}
+
+void TraceRecorder::printHex(unsigned long value, int digits) {
+  uint8_t nibble;
+
+  while(digits-- > 0) {
+    nibble = (value >> (digits * 4)) & 0x0f;
+    Serial.write(nibble < 10 ? ('0' + nibble) : ('A' + nibble - 10));
+  }
+}
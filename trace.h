@@ -0,0 +1,113 @@
+/**
+ *  \file trace.h
+ *  \brief Flight recorder of the TLE94112 settings, diagnostics and commands
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _TRACE
+#define _TRACE
+
+#include <Arduino.h>
+
+#define TRACE_EVENTS 32   ///< Number of events kept in the recorder
+
+// Event types. The three data bytes depend on the type
+#define TRACE_HB 'H'        ///< configHB: half bridge, state, PWM channel + freewheeling << 4
+#define TRACE_PWM 'P'       ///< configPWM: PWM channel, frequency, duty cycle
+#define TRACE_DIAG 'D'      ///< Diagnostic status with errors: status, 0, 0
+#define TRACE_FAULT 'F'     ///< Fault reaction: fault class, reaction, 0
+#define TRACE_COMMAND 'C'   ///< Dispatched command: keyword index in COMMAND_KEYWORDS, argument (16 bits)
+#define TRACE_FREEZE 'Z'    ///< Recorder frozen: 1 if frozen by a fault, 0, 0
+
+/**
+ * Single recorded event
+ */
+struct traceEvent {
+  unsigned long time;   ///< Time stamp (ms)
+  uint8_t type;         ///< Event type
+  uint8_t data[3];      ///< Event data
+};
+
+/**
+ * \brief Ring buffer of the last TRACE_EVENTS events
+ *
+ * The recorder is frozen when a fault is notified, so the events
+ * leading to the fault are kept until it is cleared.
+ * The dump is one line every event, oldest first, with the time stamp
+ * in ms (8 hex digits), the event type character and the three data bytes
+ * (2 hex digits each), e.g. 0001A2F4H030201
+ */
+class TraceRecorder {
+  public:
+
+    //! Recorder frozen, the new events are ignored
+    boolean isFrozen;
+    //! Freeze the recorder when a fault is notified
+    boolean freezeOnFault;
+
+    /**
+     * \brief Clear the recorder and start recording
+     */
+    void begin(void);
+
+    /**
+     * \brief Record an event, if not frozen
+     *
+     * \param type The event type
+     * \param data1 First event data byte
+     * \param data2 Second event data byte
+     * \param data3 Third event data byte
+     */
+    void record(uint8_t type, uint8_t data1, uint8_t data2, uint8_t data3);
+
+    /**
+     * \brief Record a dispatched command: the index of the longest keyword
+     * of COMMAND_KEYWORDS the command starts with (COMMAND_UNKNOWN if none)
+     * and the first decimal number after the keyword, saturated to 16 bits
+     * (0 if none)
+     *
+     * \param command The command string
+     */
+    void recordCommand(const char* command);
+
+    /**
+     * \brief Stop recording
+     *
+     * \param fault true if frozen by a fault
+     */
+    void freeze(boolean fault);
+
+    /**
+     * \brief Freeze the recorder if freezeOnFault is set
+     */
+    void faultFreeze(void);
+
+    /**
+     * \brief Dump the recorded events to the serial, oldest first
+     */
+    void dump(void);
+
+  private:
+
+    //! Events ring buffer
+    traceEvent events[TRACE_EVENTS];
+    //! Next event to write
+    uint8_t head;
+    //! Number of recorded events
+    uint8_t count;
+
+    /**
+     * Print a value as a fixed number of hex digits
+     */
+    void printHex(unsigned long value, int digits);
+};
+
+//! Flight recorder instance, used by all the classes
+extern TraceRecorder trace;
+
+#endif
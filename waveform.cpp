@@ -0,0 +1,110 @@
+/**
+ *  \file waveform.cpp
+ *  \brief This file defines functions and predefined instances from waveform.h
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0 Release Candidate
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#include "waveform.h"
+
+//! First quarter of the sine, WAVE_PEAK * sin(step * 2 pi / WAVE_STEPS)
+static const int8_t sineTable[WAVE_STEPS / 4 + 1] PROGMEM = {
+  0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+  49, 51, 54, 57, 60, 63, 65, 68, 71, 73, 76, 78, 81, 83, 85, 88,
+  90, 92, 94, 96, 98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+  117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+  127 };
+
+void WaveGenerator::begin(void) {
+  int j;
+
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    waves[j].shape = WAVE_NONE;
+  }
+  writes = 0;
+  startTime = millis();
+}
+
+void WaveGenerator::set(int channel, const waveChannel &wave) {
+  int j;
+  boolean active;
+
+  // The time base starts with the first waveform
+  active = false;
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if(waves[j].shape != WAVE_NONE)
+      active = true;
+  }
+  if(!active)
+    startTime = millis();
+
+  waves[channel] = wave;
+}
+
+void WaveGenerator::update(MotorControl &motor) {
+  int j, dc;
+  uint8_t step;
+  unsigned long time;
+
+  time = millis() - startTime;
+  for(j = 0; j < AVAIL_PWM_CHANNELS; j++) {
+    if( (waves[j].shape == WAVE_NONE) || !channelRunning(motor, j) )
+      continue;
+
+    step = (uint8_t)(((time % waves[j].period) * WAVE_STEPS) / waves[j].period +
+                     ((unsigned long)waves[j].phase * WAVE_STEPS) / 360);
+    dc = waves[j].offset + (shapeValue(waves[j].shape, step) * waves[j].amplitude) / WAVE_PEAK;
+    dc = constrain(dc, 0, DUTYCYCLE_MAX);
+
+    // The waveform steps don't restart the diagnostic filters ramp window,
+    // else the open load detection would be suppressed while running
+    if(dc != motor.channelDC[j]) {
+      motor.motorPWMDither(j, (uint8_t)dc);
+      writes++;
+    }
+  }
+}
+
+int WaveGenerator::shapeValue(uint8_t shape, uint8_t step) {
+  uint8_t quarter;
+
+  quarter = step % (WAVE_STEPS / 4);
+  switch(shape) {
+    case WAVE_SINE:
+      // The other quarters are symmetric to the first one
+      if(step < WAVE_STEPS / 4)
+        return (int8_t)pgm_read_byte(&sineTable[quarter]);
+      else if(step < WAVE_STEPS / 2)
+        return (int8_t)pgm_read_byte(&sineTable[WAVE_STEPS / 4 - quarter]);
+      else if(step < WAVE_STEPS * 3 / 4)
+        return -(int8_t)pgm_read_byte(&sineTable[quarter]);
+      else
+        return -(int8_t)pgm_read_byte(&sineTable[WAVE_STEPS / 4 - quarter]);
+    case WAVE_TRIANGLE:
+      if(step < WAVE_STEPS / 4)
+        return ((int)step * WAVE_PEAK) / (WAVE_STEPS / 4);
+      else if(step < WAVE_STEPS * 3 / 4)
+        return ((WAVE_STEPS / 2 - (int)step) * WAVE_PEAK) / (WAVE_STEPS / 4);
+      else
+        return (((int)step - WAVE_STEPS) * WAVE_PEAK) / (WAVE_STEPS / 4);
+    case WAVE_SQUARE:
+      return (step < WAVE_STEPS / 2) ? WAVE_PEAK : -WAVE_PEAK;
+  }
+
+  return 0;
+}
+
+boolean WaveGenerator::channelRunning(MotorControl &motor, int channel) {
+  int j;
+
+  for(j = 0; j < MAX_MOTORS; j++) {
+    if(motor.internalStatus[j].isRunning && (motor.internalStatus[j].channelPWM == (channel + 1)))
+      return true;
+  }
+
+  return false;
+}
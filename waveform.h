@@ -0,0 +1,104 @@
+/**
+ *  \file waveform.h
+ *  \brief Periodic duty cycle waveforms on the PWM channels
+ *
+ *  \author Enrico Miglino <balearicdynamics@gmail.com> \n
+ *  Balearic Dynamics sl <www.balearicdynamics.com> SPAIN
+ *  \date July 2017
+ *  \version 1.0
+ *  Licensed under GNU LGPL 3.0
+ */
+
+#ifndef _WAVEFORM
+#define _WAVEFORM
+
+#include "motorcontrol.h"
+
+// Waveform shapes
+#define WAVE_NONE 0         ///< No waveform on the channel
+#define WAVE_SINE 1         ///< Sine
+#define WAVE_TRIANGLE 2     ///< Triangle, in phase with the sine
+#define WAVE_SQUARE 3       ///< Square, high in the first half period
+#define WAVE_SHAPES 4
+
+#define WAVE_STEPS 256          ///< Steps of a period, the lookup table has a quarter of them
+#define WAVE_PEAK 127           ///< Peak value of the shapes
+#define WAVE_MIN_PERIOD 10      ///< Min period (ms)
+#define WAVE_MAX_PERIOD 60000   ///< Max period (ms)
+#define WAVE_MAX_PHASE 359      ///< Max phase (degrees)
+
+/**
+ * Waveform settings of a PWM channel
+ */
+struct waveChannel {
+  uint8_t shape;          ///< WAVE_NONE, WAVE_SINE, ...
+  uint8_t amplitude;      ///< Peak duty cycle change from the offset
+  uint8_t offset;         ///< Duty cycle at the middle of the waveform
+  uint16_t period;        ///< Period (ms)
+  uint16_t phase;         ///< Phase (degrees) from the common time base
+};
+
+/**
+ * \brief Duty cycle of the PWM channels following a periodic waveform
+ *
+ * The duty cycle is offset + amplitude * shape, limited to the duty cycle
+ * range, where the shape goes from -1 to 1. The sine is read from a
+ * quarter period lookup table in flash, the triangle and the square are
+ * calculated. The waveforms of all the channels have the same time base,
+ * started when the first waveform is set, so the phases of channels with
+ * the same period are kept. A channel follows its waveform only while a
+ * motor using it is running, updated every control tick without waiting;
+ * the duty cycle is written only when it changes.
+ */
+class WaveGenerator {
+  public:
+
+    //! Waveform of every PWM channel
+    waveChannel waves[AVAIL_PWM_CHANNELS];
+    //! Duty cycle writes to the TLE94112
+    unsigned long writes;
+
+    /**
+     * \brief Initialise without waveforms
+     */
+    void begin(void);
+
+    /**
+     * \brief Set the waveform of a PWM channel
+     *
+     * \param channel The PWM channel (base 0)
+     * \param wave The waveform settings, WAVE_NONE to stop the waveform
+     */
+    void set(int channel, const waveChannel &wave);
+
+    /**
+     * \brief Update the duty cycle of the channels with a waveform.
+     * Should be called once every control tick
+     *
+     * \param motor The motor control class
+     */
+    void update(MotorControl &motor);
+
+  private:
+
+    //! Time (ms) of the common time base start
+    unsigned long startTime;
+
+    /**
+     * Value of a shape, -WAVE_PEAK to WAVE_PEAK
+     *
+     * \param shape The shape, WAVE_SINE, ...
+     * \param step The step of the period, 0 to WAVE_STEPS - 1
+     */
+    int shapeValue(uint8_t shape, uint8_t step);
+
+    /**
+     * Check if a running motor uses a PWM channel
+     *
+     * \param motor The motor control class
+     * \param channel The PWM channel (base 0)
+     */
+    boolean channelRunning(MotorControl &motor, int channel);
+};
+
+#endif